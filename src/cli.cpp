@@ -0,0 +1,562 @@
+/*
+Stackistry - astronomical image stacking
+Copyright (C) 2016, 2017 Filip Szczerek <ga.software@yahoo.com>
+
+This file is part of Stackistry.
+
+Stackistry is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Stackistry is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Stackistry.  If not, see <http://www.gnu.org/licenses/>.
+
+File description:
+    Command-line (headless) batch processing program file.
+*/
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <glibmm/fileutils.h>
+#include <glibmm/init.h>
+#include <glibmm/keyfile.h>
+#include <glibmm/miscutils.h>
+#include <skry/skry.h>
+
+#include "job.h"
+#include "output_fmt.h"
+#include "utils.h"
+#include "worker.h"
+
+
+/// Process exit codes
+namespace ExitCode
+{
+    const int ALL_JOBS_SUCCEEDED = 0;
+    const int SOME_JOBS_FAILED   = 1;
+    const int INVALID_USAGE      = 2;
+}
+
+/// Names of job settings; used both as command-line options (preceded by "--") and as manifest file keys
+namespace Setting
+{
+    const char *alignment          = "align";
+    const char *anchors            = "anchors";
+    const char *qualityCriterion   = "quality-criterion";
+    const char *qualityThreshold   = "quality-threshold";
+    const char *refPoints          = "ref-points";
+    const char *refPtSpacing       = "refpt-spacing";
+    const char *refPtBrightThresh  = "refpt-brightness-threshold";
+    const char *refPtStructThresh  = "refpt-structure-threshold";
+    const char *refPtStructScale   = "refpt-structure-scale";
+    const char *refPtBlockSize     = "refpt-block-size";
+    const char *refPtSearchRadius  = "refpt-search-radius";
+    const char *flatField          = "flat-field";
+    const char *outputFormat       = "output-format";
+    const char *outputDir          = "output-dir";
+    const char *noOutput           = "no-output";
+    const char *cfaPattern         = "cfa";
+}
+
+/// Manifest file keys specifying a job's input
+namespace ManifestKey
+{
+    const char *source = "source"; ///< Video file or folder with images
+    const char *images = "images"; ///< List of image files
+}
+
+namespace Option
+{
+    const char *manifest  = "manifest";
+    const char *readAhead = "read-ahead";
+    const char *help      = "help";
+}
+
+typedef std::vector<std::pair<std::string, std::string>> SettingList_t;
+
+/// Job of the batch; 'job' is null if it could not be set up (then 'setupResult' contains the reason)
+struct BatchJob_t
+{
+    std::string source; ///< As specified by the user
+    std::unique_ptr<Job_t> job;
+    enum SKRY_result setupResult;
+};
+
+/// Returns 'true' if 'name' is one of the names in namespace Setting
+static bool IsKnownSetting(const std::string &name)
+{
+    for (const char *setting: { Setting::alignment, Setting::anchors, Setting::qualityCriterion,
+                                Setting::qualityThreshold, Setting::refPoints, Setting::refPtSpacing,
+                                Setting::refPtBrightThresh, Setting::refPtStructThresh, Setting::refPtStructScale,
+                                Setting::refPtBlockSize, Setting::refPtSearchRadius, Setting::flatField,
+                                Setting::outputFormat, Setting::outputDir, Setting::noOutput, Setting::cfaPattern })
+    {
+        if (name == setting)
+            return true;
+    }
+    return false;
+}
+
+template<typename T>
+static bool ConvertString(const std::string &str, T &result)
+{
+    std::stringstream ss(str);
+    ss >> result;
+    return !ss.fail() && ss.eof();
+}
+
+static std::string ToLower(std::string s)
+{
+    std::transform(s.begin(), s.end(), s.begin(), [](char c) { return (char)std::tolower(c); });
+    return s;
+}
+
+/// Parses a list of points: "x1,y1;x2,y2;..."
+static bool ParsePoints(const std::string &str, std::vector<struct SKRY_point> &points)
+{
+    points.clear();
+    std::stringstream ss(str);
+    std::string ptStr;
+    while (std::getline(ss, ptStr, ';'))
+    {
+        if (ptStr.empty())
+            continue;
+
+        size_t sep = ptStr.find(',');
+        struct SKRY_point pt;
+        if (sep == std::string::npos
+            || !ConvertString(ptStr.substr(0, sep), pt.x)
+            || !ConvertString(ptStr.substr(sep + 1), pt.y))
+        {
+            return false;
+        }
+        points.push_back(pt);
+    }
+    return !points.empty();
+}
+
+static void PrintUsage(const char *progName)
+{
+    std::cout <<
+        "Usage: " << progName << " [options] [source...]\n\n"
+        "Stacks each source (a video file or a folder of BMP/TIFF images) without starting the GUI.\n"
+        "Options are applied to all jobs; settings in a manifest file override them.\n\n"
+        "Options:\n"
+        "  --manifest=FILE                    read jobs from FILE (one group per job; keys are\n"
+        "                                     'source' or 'images' and the settings below)\n"
+        "  --align=anchors|centroid           video stabilization method\n"
+        "  --anchors=X,Y[;X,Y...]             video stabilization anchors (default: automatic)\n"
+        "  --quality-criterion=percent-best|min-rel-quality|number-best\n"
+        "  --quality-threshold=N              interpreted according to the quality criterion\n"
+        "  --ref-points=X,Y[;X,Y...]          reference points (default: automatic placement)\n"
+        "  --refpt-spacing=N                  automatic placement: spacing in pixels\n"
+        "  --refpt-brightness-threshold=N     automatic placement: brightness threshold (%)\n"
+        "  --refpt-structure-threshold=F      automatic placement: structure threshold\n"
+        "  --refpt-structure-scale=N          automatic placement: structure scale\n"
+        "  --refpt-block-size=N               reference block size\n"
+        "  --refpt-search-radius=N            search radius\n"
+        "  --flat-field=FILE                  flat-field image\n"
+        "  --cfa=RGGB|GRBG|GBRG|BGGR          treat mono input as raw color\n"
+        "  --output-format=bmp8|tiff16|tiff16z|png8|png16|tiff32f|fits32f\n"
+        "                                     stacked image format (tiff16z: deflate-compressed)\n"
+        "  --output-dir=DIR                   save stacks in DIR (default: source's folder)\n"
+        "  --no-output                        do not save the stacked images\n"
+        "  --read-ahead=N                     read up to N MiB of frame data in advance\n"
+        "                                     (default: " << Utils::Const::Defaults::ReadAheadBufferSizeMB << "; 0 = disabled)\n"
+        "  --help                             show this text\n\n"
+        "Exit code: " << ExitCode::ALL_JOBS_SUCCEEDED << " if all jobs succeeded, "
+                      << ExitCode::SOME_JOBS_FAILED << " if any job failed, "
+                      << ExitCode::INVALID_USAGE << " on invalid usage.\n"
+        "For each job a status line is printed: \"<job number> <status code> <source>\",\n"
+        "where status code 0 means success. A job whose source cannot be opened or whose\n"
+        "settings are invalid fails without affecting the other jobs." << std::endl;
+}
+
+/// Returns 'false' and sets 'errorMsg' if 'name' or 'value' is invalid
+static bool ApplySetting(Job_t &job, const std::string &name, const std::string &value, std::string &errorMsg)
+{
+    bool valid = true;
+
+    if (name == Setting::alignment)
+    {
+        if (value == "anchors")
+            job.alignmentMethod = SKRY_IMG_ALGN_ANCHORS;
+        else if (value == "centroid")
+            job.alignmentMethod = SKRY_IMG_ALGN_CENTROID;
+        else
+            valid = false;
+    }
+    else if (name == Setting::anchors)
+    {
+        valid = ParsePoints(value, job.anchors);
+        job.automaticAnchorPlacement = !valid;
+    }
+    else if (name == Setting::qualityCriterion)
+    {
+        if (value == "percent-best")
+            job.quality.criterion = SKRY_PERCENTAGE_BEST;
+        else if (value == "min-rel-quality")
+            job.quality.criterion = SKRY_MIN_REL_QUALITY;
+        else if (value == "number-best")
+            job.quality.criterion = SKRY_NUMBER_BEST;
+        else
+            valid = false;
+    }
+    else if (name == Setting::qualityThreshold)
+        valid = ConvertString(value, job.quality.threshold);
+    else if (name == Setting::refPoints)
+    {
+        valid = ParsePoints(value, job.refPoints);
+        job.automaticRefPointsPlacement = !valid;
+    }
+    else if (name == Setting::refPtSpacing)
+        valid = ConvertString(value, job.refPtAutoPlacementParams.spacing);
+    else if (name == Setting::refPtBrightThresh)
+    {
+        float percent;
+        valid = ConvertString(value, percent) && percent >= 0 && percent <= 100;
+        if (valid)
+            job.refPtAutoPlacementParams.brightnessThreshold = percent / 100.0f;
+    }
+    else if (name == Setting::refPtStructThresh)
+        valid = ConvertString(value, job.refPtAutoPlacementParams.structureThreshold);
+    else if (name == Setting::refPtStructScale)
+        valid = ConvertString(value, job.refPtAutoPlacementParams.structureScale);
+    else if (name == Setting::refPtBlockSize)
+        valid = ConvertString(value, job.refPtBlockSize);
+    else if (name == Setting::refPtSearchRadius)
+        valid = ConvertString(value, job.refPtSearchRadius);
+    else if (name == Setting::flatField)
+        job.flatFieldFileName = value;
+    else if (name == Setting::cfaPattern)
+    {
+        valid = false;
+        for (unsigned pattern = 0; pattern < SKRY_CFA_MAX; pattern++)
+            if (ToLower(value) == ToLower(SKRY_CFA_pattern_str[pattern]))
+            {
+                job.cfaPattern = (enum SKRY_CFA_pattern)pattern;
+                job.imgSeq.ReinterpretAsCFA(job.cfaPattern);
+                valid = true;
+            }
+    }
+    else if (name == Setting::outputFormat)
+    {
+        if (value == "bmp8")
+            job.outputFmt = OutputFormat::BMP_8;
+        else if (value == "tiff16")
+            job.outputFmt = OutputFormat::TIFF_16;
+        else if (value == "png8")
+            job.outputFmt = OutputFormat::PNG_8;
+        else if (value == "tiff16z")
+            job.outputFmt = OutputFormat::TIFF_16_DEFLATE;
+        else if (value == "png16")
+            job.outputFmt = OutputFormat::PNG_16;
+        else if (value == "tiff32f")
+            job.outputFmt = OutputFormat::TIFF_32F;
+        else if (value == "fits32f")
+            job.outputFmt = OutputFormat::FITS_32F;
+        else
+            valid = false;
+    }
+    else if (name == Setting::outputDir)
+    {
+        job.outputSaveMode = Utils::Const::OutputSaveMode::SPECIFIED_PATH;
+        job.destDir = value;
+        valid = Glib::file_test(value, Glib::FileTest::FILE_TEST_IS_DIR);
+    }
+    else if (name == Setting::noOutput)
+        job.outputSaveMode = Utils::Const::OutputSaveMode::NONE;
+    else
+    {
+        errorMsg = "unknown setting: " + name;
+        return false;
+    }
+
+    if (!valid)
+        errorMsg = "invalid value of " + name + ": " + value;
+
+    return valid;
+}
+
+/// Returns an image list consisting of all BMP and TIFF files in 'dir' (sorted by name)
+static std::vector<std::string> GetImageFilesInDir(const std::string &dir)
+{
+    std::vector<std::string> fileNames;
+    try
+    {
+        for (const std::string &fname: Glib::Dir(dir))
+        {
+            std::string ext = ToLower(fname.substr(fname.find_last_of('.') == std::string::npos ? fname.length() : fname.find_last_of('.')));
+            if (ext == ".bmp" || ext == ".tif" || ext == ".tiff")
+                fileNames.push_back(Glib::build_filename(dir, fname));
+        }
+    }
+    catch (Glib::FileError &exc)
+    {
+        std::cerr << exc.what() << std::endl;
+    }
+    std::sort(fileNames.begin(), fileNames.end());
+    return fileNames;
+}
+
+/// Returns null on failure and sets 'result'
+static std::unique_ptr<Job_t> CreateJob(const std::string &source, const std::vector<std::string> &imageFiles,
+                                        enum SKRY_result &result)
+{
+    std::unique_ptr<Job_t> job;
+    result = SKRY_SUCCESS;
+
+    if (!imageFiles.empty() || Glib::file_test(source, Glib::FileTest::FILE_TEST_IS_DIR))
+    {
+        std::vector<std::string> fileNames = imageFiles.empty() ? GetImageFilesInDir(source) : imageFiles;
+        if (fileNames.size() <= 1)
+        {
+            std::cerr << "At least two image files are required: " << source << std::endl;
+            result = SKRY_INVALID_PARAMETERS;
+            return nullptr;
+        }
+        job.reset(new Job_t { libskry::c_ImageSequence::InitImageList(fileNames) });
+        job->sourcePath = imageFiles.empty() ? source : Glib::path_get_dirname(fileNames[0]);
+        job->sourceFileNames = fileNames;
+    }
+    else
+    {
+        job.reset(new Job_t { libskry::c_ImageSequence::InitVideoFile(source.c_str(), &result) });
+        job->sourcePath = source;
+    }
+
+    if (!job->imgSeq)
+    {
+        if (result == SKRY_SUCCESS)
+            result = SKRY_CANNOT_OPEN_FILE;
+        std::cerr << "Could not open " << source << ": " << Utils::GetErrorMsg(result) << std::endl;
+        return nullptr;
+    }
+
+    SetDefaultSettings(*job);
+    return job;
+}
+
+static bool ApplySettings(Job_t &job, const SettingList_t &settings)
+{
+    for (auto &setting: settings)
+    {
+        std::string errorMsg;
+        if (!ApplySetting(job, setting.first, setting.second, errorMsg))
+        {
+            std::cerr << job.sourcePath << ": " << errorMsg << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+/// Creates a job and applies 'settings'; on failure, the returned job is null
+static BatchJob_t SetUpJob(const std::string &source, const std::vector<std::string> &imageFiles,
+                           const SettingList_t &settings)
+{
+    BatchJob_t batchJob { source.empty() ? imageFiles[0] : source, nullptr, SKRY_SUCCESS };
+
+    batchJob.job = CreateJob(source, imageFiles, batchJob.setupResult);
+    if (batchJob.job && !ApplySettings(*batchJob.job, settings))
+    {
+        batchJob.job.reset();
+        batchJob.setupResult = SKRY_INVALID_PARAMETERS;
+    }
+
+    return batchJob;
+}
+
+/// Appends jobs specified in 'manifestFileName'; returns 'false' if the file cannot be read
+/** Jobs which cannot be set up are appended as failed. */
+static bool LoadManifest(const std::string &manifestFileName, const SettingList_t &commonSettings,
+                         std::vector<BatchJob_t> &jobs)
+{
+    Glib::KeyFile manifest;
+    try
+    {
+        manifest.load_from_file(manifestFileName);
+
+        for (const Glib::ustring &group: manifest.get_groups())
+        {
+            std::string source;
+            std::vector<std::string> imageFiles;
+            SettingList_t settings = commonSettings;
+
+            for (const Glib::ustring &key: manifest.get_keys(group))
+            {
+                if (key == ManifestKey::source)
+                    source = manifest.get_string(group, key);
+                else if (key == ManifestKey::images)
+                {
+                    for (const Glib::ustring &fname: manifest.get_string_list(group, key))
+                        imageFiles.push_back(fname);
+                }
+                else
+                    settings.push_back({ key, manifest.get_string(group, key) });
+            }
+
+            if (source.empty() && imageFiles.empty())
+            {
+                std::cerr << manifestFileName << ": no source specified for job " << group << std::endl;
+                jobs.push_back({ group, nullptr, SKRY_INVALID_PARAMETERS });
+                continue;
+            }
+
+            jobs.push_back(SetUpJob(source, imageFiles, settings));
+        }
+    }
+    catch (Glib::Error &exc)
+    {
+        std::cerr << manifestFileName << ": " << exc.what() << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    Glib::init();
+    Utils::SetAppLaunchPath(argv[0]);
+
+    SettingList_t commonSettings;
+    std::vector<std::string> sources;
+    std::vector<std::string> manifests;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::strncmp(argv[i], "--", 2) != 0)
+        {
+            sources.push_back(argv[i]);
+            continue;
+        }
+
+        std::string arg(argv[i] + 2);
+        size_t eqPos = arg.find('=');
+        std::string name = arg.substr(0, eqPos);
+        std::string value = (eqPos == std::string::npos ? "" : arg.substr(eqPos + 1));
+
+        if (name == Option::help)
+        {
+            PrintUsage(argv[0]);
+            return ExitCode::ALL_JOBS_SUCCEEDED;
+        }
+        else if (name == Option::manifest)
+            manifests.push_back(value);
+        else if (name == Option::readAhead)
+        {
+            size_t sizeMB;
+            if (!ConvertString(value, sizeMB) || sizeMB > Utils::Const::MaxReadAheadBufferSizeMB)
+            {
+                std::cerr << "invalid value of " << name << ": " << value << std::endl;
+                return ExitCode::INVALID_USAGE;
+            }
+            Worker::SetReadAheadBufferSize(sizeMB << 20);
+        }
+        else if (IsKnownSetting(name))
+            commonSettings.push_back({ name, value });
+        else
+        {
+            std::cerr << "unknown option: " << name << std::endl;
+            return ExitCode::INVALID_USAGE;
+        }
+    }
+
+    if (sources.empty() && manifests.empty())
+    {
+        PrintUsage(argv[0]);
+        return ExitCode::INVALID_USAGE;
+    }
+
+    SKRY_initialize();
+    SKRY_set_clock_func(Utils::ClockSec);
+    Utils::EnumerateSupportedOutputFmts();
+
+    // A source or setting value which turns out to be invalid fails only its job
+    std::vector<BatchJob_t> jobs;
+    for (auto &source: sources)
+        jobs.push_back(SetUpJob(source, { }, commonSettings));
+
+    for (auto &manifest: manifests)
+        if (!LoadManifest(manifest, commonSettings, jobs))
+        {
+            SKRY_deinitialize();
+            return ExitCode::INVALID_USAGE;
+        }
+
+    size_t numFailed = 0;
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        if (!jobs[i].job)
+        {
+            numFailed++;
+            std::cout << i + 1 << " " << (int)jobs[i].setupResult << " " << jobs[i].source << std::endl;
+            continue;
+        }
+
+        Job_t &job = *jobs[i].job;
+        std::cout << "Processing job " << i + 1 << "/" << jobs.size() << ": " << job.sourcePath << std::endl;
+
+        double tStart = Utils::ClockSec();
+        Worker::RunProcessing(&job);
+        enum SKRY_result result = Worker::GetLastResult();
+        job.imgSeq.Deactivate();
+
+        for (size_t phase = 0; phase < job.phaseFramesPerSec.size(); phase++)
+            if (job.phaseFramesPerSec[phase] > 0)
+                std::cout << Worker::GetProcPhaseStr((Worker::ProcPhase)phase) << ": "
+                          << job.phaseFramesPerSec[phase] << " frames/s" << std::endl;
+
+        bool failed = false;
+        if (result != SKRY_SUCCESS && result != SKRY_LAST_STEP)
+        {
+            std::cerr << job.sourcePath << ": " << Utils::GetErrorMsg(result) << std::endl;
+            failed = true;
+        }
+        else if (!job.stackedImg)
+        {
+            std::cerr << job.sourcePath << ": failed to obtain the image stack" << std::endl;
+            result = SKRY_OUT_OF_MEMORY;
+            failed = true;
+        }
+        else if (job.outputSaveMode != Utils::Const::OutputSaveMode::NONE)
+        {
+            std::string destPath;
+            if (SKRY_SUCCESS != (result = AutoSaveStack(job, destPath)))
+            {
+                std::cerr << "Could not save stack as " << destPath << ": " << Utils::GetErrorMsg(result) << std::endl;
+                failed = true;
+            }
+            else
+                std::cout << "Saved " << destPath << " (" << Utils::ClockSec() - tStart << " s)" << std::endl;
+        }
+
+        if (failed)
+            numFailed++;
+
+        // Status code: 0 on success, otherwise the libskry error code
+        std::cout << i + 1 << " " << (failed ? (int)result : 0) << " " << job.sourcePath << std::endl;
+
+        // Release the job's images and stacks before processing the next one
+        jobs[i].job.reset();
+    }
+
+    SKRY_deinitialize();
+
+    return (numFailed == 0 ? ExitCode::ALL_JOBS_SUCCEEDED : ExitCode::SOME_JOBS_FAILED);
+}
@@ -21,6 +21,7 @@ File description:
     Application configuration implementation.
 */
 
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 
@@ -37,6 +38,7 @@ namespace Group
 {
     const char *UI = "UI";
     const char *Output = "Output";
+    const char *Processing = "Processing";
 }
 
 namespace Key
@@ -60,8 +62,15 @@ namespace Key
     const char *numQualityHistBins = "NumQualityHistogramBins";
 
     const char *exportInactiveFramesQuality = "ExportInactiveFramesQuality";
+    const char *binaryQualityExport = "BinaryQualityExport";
 
     const char *UIlanguage = "UILanguage";
+
+    const char *maxConcurrentJobs = "MaxConcurrentJobs";
+    const char *readAheadBufferSizeMB = "ReadAheadBufferSizeMB";
+    const char *frameCacheSizeMB = "FrameCacheSizeMB";
+    const char *compactFrameCache = "CompactFrameCache";
+    const char *maxNotificationRate = "MaxProgressNotificationRate";
 }
 
 const char *CONFIG_FILE_NAME = ".stackistry";
@@ -230,10 +239,38 @@ c_Property<bool> ExportInactiveFramesQuality(
     []() { return 1 == GetInt(Group::Output, Key::exportInactiveFramesQuality); },
     [](const bool &b) { configFile.set_integer(Group::Output, Key::exportInactiveFramesQuality, (int)b); });
 
+c_Property<bool> BinaryQualityExport(
+    []() { return 1 == GetInt(Group::Output, Key::binaryQualityExport); },
+    [](const bool &b) { configFile.set_integer(Group::Output, Key::binaryQualityExport, (int)b); });
+
 c_Property<size_t> NumQualityHistogramBins(
     []() { return (size_t)GetUnsignedVal(Group::UI, Key::numQualityHistBins, Utils::Const::Defaults::NumQualityHistogramBins); },
     [](const size_t &n) { configFile.set_integer(Group::UI, Key::numQualityHistBins, n); });
 
+c_Property<size_t> MaxConcurrentJobs(
+    []() { return std::min((size_t)GetUnsignedVal(Group::Processing, Key::maxConcurrentJobs, Utils::Const::Defaults::MaxConcurrentJobs),
+                           Utils::Const::MaxConcurrentJobsLimit); },
+    [](const size_t &n) { configFile.set_integer(Group::Processing, Key::maxConcurrentJobs, n); });
+
+c_Property<size_t> ReadAheadBufferSizeMB(
+    []() { return std::min((size_t)GetUnsignedVal(Group::Processing, Key::readAheadBufferSizeMB, Utils::Const::Defaults::ReadAheadBufferSizeMB),
+                           Utils::Const::MaxReadAheadBufferSizeMB); },
+    [](const size_t &n) { configFile.set_integer(Group::Processing, Key::readAheadBufferSizeMB, n); });
+
+c_Property<size_t> FrameCacheSizeMB(
+    []() { return std::min((size_t)GetUnsignedVal(Group::Processing, Key::frameCacheSizeMB, Utils::Const::Defaults::FrameCacheSizeMB),
+                           Utils::Const::MaxFrameCacheSizeMB); },
+    [](const size_t &n) { configFile.set_integer(Group::Processing, Key::frameCacheSizeMB, n); });
+
+c_Property<bool> CompactFrameCache(
+    []() { return 1 == GetInt(Group::Processing, Key::compactFrameCache); },
+    [](const bool &b) { configFile.set_integer(Group::Processing, Key::compactFrameCache, (int)b); });
+
+c_Property<unsigned> MaxNotificationRate(
+    []() { return std::max(1u, std::min(GetUnsignedVal(Group::Processing, Key::maxNotificationRate, Utils::Const::Defaults::MaxNotificationRate),
+                                        Utils::Const::MaxNotificationRateLimit)); },
+    [](const unsigned &n) { configFile.set_integer(Group::Processing, Key::maxNotificationRate, n); });
+
 
 bool Initialize()
 {
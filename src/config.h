@@ -76,8 +76,25 @@ namespace Configuration
     extern c_Property<bool> MainWndMaximized;
     extern c_Property<std::string> LastOpenDir;
     extern c_Property<bool> ExportInactiveFramesQuality;
+    /// If true, quality data is exported automatically in binary format (instead of text)
+    extern c_Property<bool> BinaryQualityExport;
     extern c_Property<size_t> NumQualityHistogramBins;
 
+    /// Max. number of jobs processed simultaneously (each one by its own worker thread)
+    extern c_Property<size_t> MaxConcurrentJobs;
+
+    /// Max. amount of frame data (in MiB) read ahead of the currently processed frame; 0 = no reading ahead
+    extern c_Property<size_t> ReadAheadBufferSizeMB;
+
+    /// Max. size (in MiB) of the cache of decoded frames; 0 = no caching
+    extern c_Property<size_t> FrameCacheSizeMB;
+
+    /// If 'true', 8-bit frames are cached in their decoded format (see FrameCache::SetLimits())
+    extern c_Property<bool> CompactFrameCache;
+
+    /// Max. number of processing progress updates per second shown in the main window
+    extern c_Property<unsigned> MaxNotificationRate;
+
     /// format: <language>_<country>, e.g. "pl_PL"; empty = system default language
     extern c_Property<std::string> UILanguage;
 }
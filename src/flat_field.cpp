@@ -0,0 +1,188 @@
+/*
+Stackistry - astronomical image stacking
+Copyright (C) 2016, 2017 Filip Szczerek <ga.software@yahoo.com>
+
+This file is part of Stackistry.
+
+Stackistry is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Stackistry is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Stackistry.  If not, see <http://www.gnu.org/licenses/>.
+
+File description:
+    Flat-field creation implementation.
+*/
+
+#include <algorithm>
+#include <vector>
+
+#include "flat_field.h"
+#include "utils.h"
+
+
+/// Min. interval (in seconds) between progress notifications
+const double NOTIFICATION_INTERVAL = 0.1;
+
+c_FlatFieldCreator::c_FlatFieldCreator(const std::string &videoPath, size_t frameStep)
+: m_VideoPath(videoPath), m_FrameStep(std::max(frameStep, (size_t)1))
+{
+}
+
+c_FlatFieldCreator::~c_FlatFieldCreator()
+{
+    if (m_Thread)
+    {
+        RequestAbort();
+        m_Thread->join();
+    }
+}
+
+void c_FlatFieldCreator::Start()
+{
+    m_IsRunning = true;
+    m_Thread = Glib::Threads::Thread::create(sigc::mem_fun(*this, &c_FlatFieldCreator::ThreadFunc));
+}
+
+void c_FlatFieldCreator::RequestAbort()
+{
+    m_AbortRequested = true;
+}
+
+void c_FlatFieldCreator::ConnectProgressSignal(const sigc::slot<void>& slot)
+{
+    m_Dispatcher.connect(slot);
+}
+
+void c_FlatFieldCreator::NotifyProgress()
+{
+    double now = Utils::ClockSec();
+    double lastTime = m_LastNotificationTime;
+    if (now - lastTime >= NOTIFICATION_INTERVAL
+        && m_LastNotificationTime.compare_exchange_strong(lastTime, now))
+    {
+        m_Dispatcher();
+    }
+}
+
+void c_FlatFieldCreator::ThreadFunc()
+{
+    enum SKRY_result result = SKRY_SUCCESS;
+    libskry::c_Image flatField = CreateFlatField(result);
+
+    m_FlatField = std::move(flatField);
+    m_Result = result;
+    m_IsRunning = false;
+    m_Dispatcher();
+}
+
+libskry::c_Image c_FlatFieldCreator::CreateFlatField(enum SKRY_result &result)
+{
+    libskry::c_Image firstImg;
+    size_t imgCount;
+    { libskry::c_ImageSequence imgSeq = libskry::c_ImageSequence::InitVideoFile(m_VideoPath.c_str(), &result);
+        if (!imgSeq)
+            return libskry::c_Image();
+
+        imgCount = imgSeq.GetImageCount();
+        firstImg = imgSeq.GetImageByIdx(0, &result);
+        if (!firstImg)
+            return libskry::c_Image();
+    }
+
+    const unsigned width = firstImg.GetWidth(),
+                   height = firstImg.GetHeight();
+    const size_t numFrames = (imgCount + m_FrameStep - 1) / m_FrameStep;
+    m_NumFrames = numFrames;
+
+    std::vector<double> sum(width * height, 0.0);
+    size_t numSummed = 0;
+    std::atomic<int> threadResult(SKRY_SUCCESS);
+
+    #pragma omp parallel
+    {
+        // Each thread accumulates its range of frames using its own instance of the video
+        std::vector<double> partialSum(width * height, 0.0);
+        size_t numPartial = 0;
+
+        enum SKRY_result openResult;
+        libskry::c_ImageSequence imgSeq = libskry::c_ImageSequence::InitVideoFile(m_VideoPath.c_str(), &openResult);
+        if (!imgSeq)
+            threadResult = openResult;
+
+        #pragma omp for schedule(static)
+        for (size_t i = 0; i < numFrames; i++)
+        {
+            if (m_AbortRequested || threadResult != SKRY_SUCCESS)
+                continue;
+
+            enum SKRY_result imgResult;
+            libskry::c_Image img = imgSeq.GetImageByIdx(i * m_FrameStep, &imgResult);
+            if (!img)
+            {
+                threadResult = imgResult;
+                continue;
+            }
+            if (img.GetWidth() != width || img.GetHeight() != height)
+            {
+                threadResult = SKRY_INVALID_IMG_DIMENSIONS;
+                continue;
+            }
+
+            libskry::c_Image monoImg = libskry::c_Image::ConvertPixelFormat(img, SKRY_PIX_MONO32F);
+            for (unsigned y = 0; y < height; y++)
+            {
+                const float *line = static_cast<const float *>(monoImg.GetLine(y));
+                double *sumLine = &partialSum[y * width];
+                for (unsigned x = 0; x < width; x++)
+                    sumLine[x] += line[x];
+            }
+            numPartial++;
+
+            m_NumFramesDone++;
+            NotifyProgress();
+        }
+
+        #pragma omp critical
+        {
+            for (size_t i = 0; i < sum.size(); i++)
+                sum[i] += partialSum[i];
+            numSummed += numPartial;
+        }
+    }
+
+    if (threadResult != SKRY_SUCCESS)
+    {
+        result = (enum SKRY_result)(int)threadResult;
+        return libskry::c_Image();
+    }
+    if (m_AbortRequested || numSummed == 0)
+        return libskry::c_Image();
+
+    // The average of frames, normalized to its brightest pixel
+    double maxSum = *std::max_element(sum.begin(), sum.end());
+    if (maxSum <= 0.0)
+    {
+        result = SKRY_INVALID_PARAMETERS;
+        return libskry::c_Image();
+    }
+
+    libskry::c_Image flatField(width, height, SKRY_PIX_MONO32F, nullptr, false);
+    for (unsigned y = 0; y < height; y++)
+    {
+        float *line = static_cast<float *>(flatField.GetLine(y));
+        const double *sumLine = &sum[y * width];
+        for (unsigned x = 0; x < width; x++)
+            line[x] = (float)(sumLine[x] / maxSum);
+    }
+
+    result = SKRY_SUCCESS;
+    return flatField;
+}
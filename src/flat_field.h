@@ -0,0 +1,107 @@
+/*
+Stackistry - astronomical image stacking
+Copyright (C) 2016, 2017 Filip Szczerek <ga.software@yahoo.com>
+
+This file is part of Stackistry.
+
+Stackistry is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Stackistry is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Stackistry.  If not, see <http://www.gnu.org/licenses/>.
+
+File description:
+    Flat-field creation header.
+*/
+
+#ifndef STACKISTRY_FLAT_FIELD_HEADER
+#define STACKISTRY_FLAT_FIELD_HEADER
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+
+#include <glibmm/dispatcher.h>
+#include <glibmm/threads.h>
+#include <skry/skry_cpp.hpp>
+
+
+/// Creates a flat-field by averaging frames of a video in a background thread
+/** Frames are decoded and accumulated in parallel: each thread opens its own instance of the video
+    and sums a contiguous range of frames; the partial sums are added at the end. The result
+    is normalized so that its brightest pixel equals 1.
+
+    Has to be created and used by the main thread. */
+class c_FlatFieldCreator
+{
+public:
+    /// Every 'frameStep'-th frame of the video is used (1 = all frames)
+    c_FlatFieldCreator(const std::string &videoPath, size_t frameStep);
+    c_FlatFieldCreator(const c_FlatFieldCreator &) = delete;
+    c_FlatFieldCreator &operator=(const c_FlatFieldCreator &) = delete;
+
+    /// Aborts the creation (if running) and waits for it to finish
+    ~c_FlatFieldCreator();
+
+    void Start();
+
+    /// Makes the creation finish as soon as possible; does not wait for it
+    void RequestAbort();
+
+    /// Connects a slot called in the main thread on progress and when the creation finishes
+    void ConnectProgressSignal(const sigc::slot<void>& slot);
+
+    /// Returns 'true' until the creation finishes (successfully or not)
+    bool IsRunning() const { return m_IsRunning; }
+
+    size_t GetNumFramesDone() const { return m_NumFramesDone; }
+
+    /// Returns the number of frames to use (known after the video has been opened; 0 before)
+    size_t GetNumFrames() const { return m_NumFrames; }
+
+    const std::string &GetVideoPath() const { return m_VideoPath; }
+
+    /// Can be called after the creation finishes; the image is invalid on failure or abort
+    /** Format of the flat-field is SKRY_PIX_MONO32F. */
+    const libskry::c_Image &GetFlatField() const { return m_FlatField; }
+
+    /// Can be called after the creation finishes
+    enum SKRY_result GetResult() const { return m_Result; }
+
+    bool WasAborted() const { return m_AbortRequested; }
+
+private:
+    std::string m_VideoPath;
+    size_t m_FrameStep;
+
+    std::atomic<bool> m_IsRunning{false};
+    std::atomic<bool> m_AbortRequested{false};
+    std::atomic<size_t> m_NumFramesDone{0};
+    std::atomic<size_t> m_NumFrames{0};
+    /// Value of Utils::ClockSec() when the last progress notification was sent
+    std::atomic<double> m_LastNotificationTime{0.0};
+
+    // Set by the creation thread before it finishes
+    libskry::c_Image m_FlatField;
+    enum SKRY_result m_Result = SKRY_SUCCESS;
+
+    Glib::Threads::Thread *m_Thread = nullptr;
+    Glib::Dispatcher m_Dispatcher;
+
+    void ThreadFunc();
+
+    /// Called by the creation threads after each frame
+    void NotifyProgress();
+
+    /// Returns the flat-field or an invalid image; 'result' receives the error code
+    libskry::c_Image CreateFlatField(enum SKRY_result &result);
+};
+
+#endif // STACKISTRY_FLAT_FIELD_HEADER
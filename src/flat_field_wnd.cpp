@@ -0,0 +1,189 @@
+/*
+Stackistry - astronomical image stacking
+Copyright (C) 2016, 2017 Filip Szczerek <ga.software@yahoo.com>
+
+This file is part of Stackistry.
+
+Stackistry is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Stackistry is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Stackistry.  If not, see <http://www.gnu.org/licenses/>.
+
+File description:
+    Flat-field creation window implementation.
+*/
+
+#include <glibmm/i18n.h>
+#include <glibmm/main.h>
+#include <glibmm/miscutils.h>
+#include <gtkmm/box.h>
+#include <gtkmm/messagedialog.h>
+
+#include "flat_field_wnd.h"
+#include "output_fmt.h"
+#include "utils.h"
+
+
+c_FlatFieldWindow::c_FlatFieldWindow()
+{
+    set_title(_("Flat-field Creation"));
+    set_border_width(Utils::Const::widgetPaddingInPixels);
+    set_default_size(400, -1);
+
+    InitControls();
+}
+
+void c_FlatFieldWindow::InitControls()
+{
+    Gtk::Box *contents = Gtk::manage(new Gtk::VBox());
+    contents->show();
+
+    m_Info.set_alignment(Gtk::Align::ALIGN_START);
+    m_Info.show();
+    contents->pack_start(m_Info, Gtk::PackOptions::PACK_SHRINK, Utils::Const::widgetPaddingInPixels);
+
+    m_Progress.set_show_text(true);
+    m_Progress.show();
+    contents->pack_start(m_Progress, Gtk::PackOptions::PACK_SHRINK, Utils::Const::widgetPaddingInPixels);
+
+    m_Cancel.set_label(_("Cancel"));
+    m_Cancel.set_tooltip_text(_("Cancel creation of all flat-fields"));
+    m_Cancel.signal_clicked().connect(sigc::mem_fun(*this, &c_FlatFieldWindow::OnCancel));
+    m_Cancel.set_halign(Gtk::Align::ALIGN_END);
+    m_Cancel.show();
+    contents->pack_end(m_Cancel, Gtk::PackOptions::PACK_SHRINK, Utils::Const::widgetPaddingInPixels);
+
+    add(*contents);
+}
+
+void c_FlatFieldWindow::AddTask(const std::string &videoPath, size_t frameStep,
+                                const std::string &destPath, OutputFormat outputFmt)
+{
+    m_Tasks.push({ videoPath, frameStep, destPath, outputFmt });
+
+    if (!m_Creator)
+        StartNextTask();
+    else
+        UpdateInfo();
+
+    show();
+    present();
+}
+
+void c_FlatFieldWindow::StartNextTask()
+{
+    if (m_Tasks.empty())
+    {
+        hide();
+        return;
+    }
+
+    m_CurrentTask = m_Tasks.front();
+    m_Tasks.pop();
+
+    m_Creator.reset(new c_FlatFieldCreator(m_CurrentTask.videoPath, m_CurrentTask.frameStep));
+    m_IsTaskFinished = false;
+    m_Creator->ConnectProgressSignal(sigc::mem_fun(*this, &c_FlatFieldWindow::OnProgress));
+    m_Creator->Start();
+
+    m_Cancel.set_sensitive(true);
+    UpdateInfo();
+}
+
+void c_FlatFieldWindow::UpdateInfo()
+{
+    Glib::ustring info = Glib::ustring::compose(_("Creating flat-field from %1"),
+                                                Glib::path_get_basename(m_CurrentTask.videoPath));
+    if (!m_Tasks.empty())
+        info += "\n" + Glib::ustring::compose(_("Queued: %1"), m_Tasks.size());
+    m_Info.set_text(info);
+
+    size_t numFrames = m_Creator ? m_Creator->GetNumFrames() : 0;
+    size_t numDone = m_Creator ? m_Creator->GetNumFramesDone() : 0;
+    m_Progress.set_fraction(numFrames ? (double)numDone / numFrames : 0.0);
+    m_Progress.set_text(Glib::ustring::format(numDone, "/", numFrames));
+}
+
+void c_FlatFieldWindow::OnProgress()
+{
+    if (!m_Creator || m_IsTaskFinished)
+        return;
+
+    if (m_Creator->IsRunning())
+    {
+        UpdateInfo();
+        return;
+    }
+
+    // Progress notifications still queued when the thread finished are delivered too;
+    // the flag has to be set before FinishTask(), whose error message runs a nested main loop
+    m_IsTaskFinished = true;
+    FinishTask();
+
+    // The creator cannot be destroyed from within its own notification
+    m_Cancel.set_sensitive(false);
+    Glib::signal_idle().connect_once([this]()
+        {
+            m_Creator.reset();
+            StartNextTask();
+        });
+}
+
+void c_FlatFieldWindow::FinishTask()
+{
+    if (m_Creator->WasAborted())
+        return;
+
+    enum SKRY_result result = m_Creator->GetResult();
+    const libskry::c_Image &flatField = m_Creator->GetFlatField();
+    Glib::ustring errorMsg;
+
+    if (!flatField)
+        errorMsg = Glib::ustring::compose(_("Failed to create flat-field from %1:\n%2"),
+                                          m_CurrentTask.videoPath, Utils::GetErrorMsg(result));
+    else
+    {
+        enum SKRY_pixel_format pixFmt = Utils::FindMatchingFormat(m_CurrentTask.outputFmt, 1);
+        libskry::c_Image finalImg = libskry::c_Image::ConvertPixelFormat(flatField, pixFmt);
+        if (SKRY_SUCCESS != (result = OutputFmt::Save(finalImg, m_CurrentTask.destPath.c_str(), m_CurrentTask.outputFmt)))
+            errorMsg = Glib::ustring::compose(_("Error saving %1:\n%2"),
+                                              m_CurrentTask.destPath, Utils::GetErrorMsg(result));
+    }
+
+    if (!errorMsg.empty())
+    {
+        Gtk::MessageDialog msg(*this, errorMsg, false, Gtk::MessageType::MESSAGE_ERROR, Gtk::ButtonsType::BUTTONS_OK, true);
+        msg.set_title(_("Error"));
+        msg.run();
+    }
+}
+
+void c_FlatFieldWindow::OnCancel()
+{
+    while (!m_Tasks.empty())
+        m_Tasks.pop();
+
+    if (m_Creator)
+    {
+        m_Creator->RequestAbort();
+        m_Info.set_text(_("Canceling..."));
+        m_Cancel.set_sensitive(false);
+    }
+}
+
+void c_FlatFieldWindow::Finalize()
+{
+    while (!m_Tasks.empty())
+        m_Tasks.pop();
+
+    // Waits for the creation thread
+    m_Creator.reset();
+}
@@ -0,0 +1,90 @@
+/*
+Stackistry - astronomical image stacking
+Copyright (C) 2016, 2017 Filip Szczerek <ga.software@yahoo.com>
+
+This file is part of Stackistry.
+
+Stackistry is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Stackistry is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Stackistry.  If not, see <http://www.gnu.org/licenses/>.
+
+File description:
+    Flat-field creation window header.
+*/
+
+#ifndef STACKISTRY_FLAT_FIELD_WINDOW_HEADER
+#define STACKISTRY_FLAT_FIELD_WINDOW_HEADER
+
+#include <memory>
+#include <queue>
+#include <string>
+
+#include <gtkmm/button.h>
+#include <gtkmm/label.h>
+#include <gtkmm/progressbar.h>
+#include <gtkmm/window.h>
+#include <skry/skry_cpp.hpp>
+
+#include "flat_field.h"
+#include "output_fmt.h"
+
+
+/// Shows the progress of queued flat-field creation tasks, performed one at a time in the background
+class c_FlatFieldWindow: public Gtk::Window
+{
+    struct Task_t
+    {
+        std::string videoPath;
+        size_t frameStep;
+        std::string destPath;
+        OutputFormat outputFmt;
+    };
+
+    std::queue<Task_t> m_Tasks;
+    Task_t m_CurrentTask;
+    std::unique_ptr<c_FlatFieldCreator> m_Creator;
+    /// Set once the completion of 'm_Creator' has been handled; later notifications are ignored
+    bool m_IsTaskFinished = false;
+
+    Gtk::Label m_Info;
+    Gtk::ProgressBar m_Progress;
+    Gtk::Button m_Cancel;
+
+    void InitControls();
+
+    void StartNextTask();
+
+    void UpdateInfo();
+
+    /// Saves the flat-field created by 'm_Creator' (or reports an error)
+    void FinishTask();
+
+    // Internal signal handlers -------------
+
+    void OnProgress();
+    void OnCancel();
+    // --------------------------------------
+
+public:
+
+    c_FlatFieldWindow();
+
+    /// Queues the creation of a flat-field from the video at 'videoPath'; shows the window
+    /** The flat-field is saved to 'destPath'. Every 'frameStep'-th frame of the video is used. */
+    void AddTask(const std::string &videoPath, size_t frameStep,
+                 const std::string &destPath, OutputFormat outputFmt);
+
+    /// Aborts the current and cancels queued tasks; waits until the current one finishes
+    void Finalize();
+};
+
+#endif // STACKISTRY_FLAT_FIELD_WINDOW_HEADER
@@ -0,0 +1,210 @@
+/*
+Stackistry - astronomical image stacking
+Copyright (C) 2016, 2017 Filip Szczerek <ga.software@yahoo.com>
+
+This file is part of Stackistry.
+
+Stackistry is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Stackistry is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Stackistry.  If not, see <http://www.gnu.org/licenses/>.
+
+File description:
+    Decoded frame cache implementation.
+*/
+
+#include <iterator>
+#include <list>
+#include <map>
+#include <utility>
+
+#include <glibmm/threads.h>
+
+#include "frame_cache.h"
+
+
+namespace FrameCache
+{
+
+struct Entry_t
+{
+    SeqId_t seqId;
+    size_t imgIdx;
+    ImagePtr_t img;
+    size_t size; ///< Size of 'img' in bytes
+};
+
+typedef std::pair<SeqId_t, size_t> Key_t;
+
+/// Most recently used entries first
+static std::list<Entry_t> entries;
+static std::map<Key_t, std::list<Entry_t>::iterator> entryIndex;
+
+static SeqId_t lastSeqId = 0;
+
+static size_t totalSize = 0;
+static size_t maxSize = 0;
+static bool compactMode = false;
+
+static Glib::Threads::Mutex mtx; ///< Access guard for the variables above
+
+#define LOCK() Glib::Threads::Mutex::Lock lock(mtx)
+
+const size_t BGRA8_BYTES_PER_PIXEL = 4;
+
+static size_t GetSize(const libskry::c_Image &img)
+{
+    return img.GetLineStrideInBytes() * img.GetHeight();
+}
+
+/// Returns 'img' if it is BGRA8, otherwise its BGRA8 conversion
+static ImagePtr_t ToBGRA8(const ImagePtr_t &img)
+{
+    if (img->GetPixelFormat() == SKRY_PIX_BGRA8)
+        return img;
+    else
+        return std::make_shared<const libskry::c_Image>(
+            libskry::c_Image::ConvertPixelFormat(*img, SKRY_PIX_BGRA8, SKRY_DEMOSAIC_HQLINEAR));
+}
+
+/// Has to be called with 'mtx' locked
+static void RemoveEntry(std::list<Entry_t>::iterator entry)
+{
+    totalSize -= entry->size;
+    entryIndex.erase(Key_t(entry->seqId, entry->imgIdx));
+    entries.erase(entry);
+}
+
+/// Has to be called with 'mtx' locked
+static void EvictExcess()
+{
+    while (totalSize > maxSize)
+        RemoveEntry(std::prev(entries.end()));
+}
+
+SeqId_t NewSequenceId()
+{
+    LOCK();
+    return ++lastSeqId;
+}
+
+void SetLimits(size_t maxBytes, bool compact)
+{
+    LOCK();
+
+    if (compact != compactMode)
+    {
+        entries.clear();
+        entryIndex.clear();
+        totalSize = 0;
+        compactMode = compact;
+    }
+    maxSize = maxBytes;
+    EvictExcess();
+}
+
+/// Returns the image converted to BGRA8 or, if 'convert' is false, in the format it is cached in
+static ImagePtr_t GetImage(SeqId_t seqId, const libskry::c_ImageSequence &imgSeq, size_t imgIdx,
+                           enum SKRY_result *result, bool convert)
+{
+    Key_t key(seqId, imgIdx);
+    ImagePtr_t cachedImg;
+    bool compact;
+    size_t maxBytes;
+
+    { LOCK();
+
+        auto cached = entryIndex.find(key);
+        if (cached != entryIndex.end())
+        {
+            entries.splice(entries.begin(), entries, cached->second);
+            cachedImg = cached->second->img;
+        }
+
+        compact = compactMode;
+        maxBytes = maxSize;
+    }
+
+    if (cachedImg)
+    {
+        if (result)
+            *result = SKRY_SUCCESS;
+        // Conversion (if any) is done without holding the lock
+        return convert ? ToBGRA8(cachedImg) : cachedImg;
+    }
+
+    // Decode without holding the lock, other threads may use the cache in the meantime
+    libskry::c_Image decoded = imgSeq.GetImageByIdx(imgIdx, result);
+    if (!decoded)
+        return nullptr;
+    ImagePtr_t img = std::make_shared<const libskry::c_Image>(std::move(decoded));
+
+    // In compact mode formats taking less memory than BGRA8 are stored as decoded
+    bool storeDecoded = (compact && img->GetBytesPerPixel() < BGRA8_BYTES_PER_PIXEL);
+    size_t size = (storeDecoded ? GetSize(*img) : (size_t)img->GetWidth() * img->GetHeight() * BGRA8_BYTES_PER_PIXEL);
+    bool store = (size <= maxBytes);
+
+    // Convert only if the caller or the cache needs it
+    ImagePtr_t bgraImg;
+    if (convert || (store && !storeDecoded))
+        bgraImg = ToBGRA8(img);
+
+    if (store)
+    { LOCK();
+
+        if (compact == compactMode && size <= maxSize && entryIndex.find(key) == entryIndex.end())
+        {
+            entries.push_front({ seqId, imgIdx, storeDecoded ? img : bgraImg, size });
+            entryIndex[key] = entries.begin();
+            totalSize += size;
+            EvictExcess();
+        }
+    }
+
+    if (convert)
+        return bgraImg;
+    else
+        return storeDecoded || !store ? img : bgraImg;
+}
+
+ImagePtr_t GetImage(SeqId_t seqId, const libskry::c_ImageSequence &imgSeq, size_t imgIdx, enum SKRY_result *result)
+{
+    return GetImage(seqId, imgSeq, imgIdx, result, true);
+}
+
+ImagePtr_t GetImageAsCached(SeqId_t seqId, const libskry::c_ImageSequence &imgSeq, size_t imgIdx, enum SKRY_result *result)
+{
+    return GetImage(seqId, imgSeq, imgIdx, result, false);
+}
+
+void Invalidate(SeqId_t seqId)
+{
+    LOCK();
+
+    auto first = entryIndex.lower_bound(Key_t(seqId, 0));
+    while (first != entryIndex.end() && first->first.first == seqId)
+    {
+        auto next = std::next(first);
+        RemoveEntry(first->second);
+        first = next;
+    }
+}
+
+void Clear()
+{
+    LOCK();
+
+    entries.clear();
+    entryIndex.clear();
+    totalSize = 0;
+}
+
+} // namespace FrameCache
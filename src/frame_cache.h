@@ -0,0 +1,79 @@
+/*
+Stackistry - astronomical image stacking
+Copyright (C) 2016, 2017 Filip Szczerek <ga.software@yahoo.com>
+
+This file is part of Stackistry.
+
+Stackistry is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Stackistry is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Stackistry.  If not, see <http://www.gnu.org/licenses/>.
+
+File description:
+    Decoded frame cache header.
+*/
+
+#ifndef STACKISTRY_FRAME_CACHE_HEADER
+#define STACKISTRY_FRAME_CACHE_HEADER
+
+#include <cstddef>
+#include <memory>
+
+#include <skry/skry_cpp.hpp>
+
+
+/** Preview cache of decoded frames of image sequences, shared by all jobs. Used for frames
+    displayed by Stackistry outside of processing (frame selection, the best frame
+    preview), so that a frame is not decoded again when revisited. Processing phases
+    are not served by the cache: libskry decodes frames internally during each step
+    and has no means of accepting already decoded ones.
+    Least recently used frames are evicted when the cache exceeds its size limit.
+    Thread-safe. */
+namespace FrameCache
+{
+    /// Images are shared with the cache and must not be modified
+    typedef std::shared_ptr<const libskry::c_Image> ImagePtr_t;
+
+    /// Identifies an image sequence in the cache (see NewSequenceId())
+    typedef size_t SeqId_t;
+
+    /// Returns an identifier not returned before during the program's run
+    /** Frames are cached per identifier (not per c_ImageSequence object), so that a new sequence
+        never receives frames of a destroyed one, even if not invalidated or created at the same address. */
+    SeqId_t NewSequenceId();
+
+    /// Sets the max. total size of cached frames (0 disables caching)
+    /** If 'compact' is true, frames whose decoded pixel format takes less memory
+        than BGRA8 (e.g. 8-bit mono or raw color) are stored in that format and
+        converted on each access; otherwise all frames are stored as BGRA8. */
+    void SetLimits(size_t maxBytes, bool compact);
+
+    /// Returns the image at 'imgIdx' (absolute index) of 'imgSeq' (identified by 'seqId') converted to BGRA8
+    /** The image is decoded only if it is not cached. Returns null on error. */
+    ImagePtr_t GetImage(SeqId_t seqId, const libskry::c_ImageSequence &imgSeq, size_t imgIdx,
+                        enum SKRY_result *result = nullptr);
+
+    /// Returns the image at 'imgIdx' (absolute index) of 'imgSeq' as it is cached
+    /** Same as GetImage(), but the image may be returned in its decoded format (without
+        conversion to BGRA8); for callers which can handle any pixel format. */
+    ImagePtr_t GetImageAsCached(SeqId_t seqId, const libskry::c_ImageSequence &imgSeq, size_t imgIdx,
+                                enum SKRY_result *result = nullptr);
+
+    /// Removes all images of sequence 'seqId' from the cache
+    /** Has to be called when the sequence's images are to be decoded differently; should be called
+        when the sequence is destroyed (to free memory sooner than by eviction). */
+    void Invalidate(SeqId_t seqId);
+
+    /// Removes all images from the cache
+    void Clear();
+}
+
+#endif // STACKISTRY_FRAME_CACHE_HEADER
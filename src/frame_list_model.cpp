@@ -0,0 +1,197 @@
+/*
+Stackistry - astronomical image stacking
+Copyright (C) 2016, 2017 Filip Szczerek <ga.software@yahoo.com>
+
+This file is part of Stackistry.
+
+Stackistry is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Stackistry is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Stackistry.  If not, see <http://www.gnu.org/licenses/>.
+
+File description:
+    Frame list model implementation.
+*/
+
+#include "frame_list_model.h"
+
+
+Glib::RefPtr<c_FrameListModel> c_FrameListModel::create(const std::vector<uint8_t> &activeFlags)
+{
+    return Glib::RefPtr<c_FrameListModel>(new c_FrameListModel(activeFlags));
+}
+
+c_FrameListModel::c_FrameListModel(const std::vector<uint8_t> &activeFlags)
+: Glib::ObjectBase(typeid(c_FrameListModel)), // registers a custom GType
+  Glib::Object(),
+  m_ActiveFlags(activeFlags),
+  m_Stamp(1)
+{ }
+
+void c_FrameListModel::ChangeActive(const std::vector<size_t> &frameIndices, Change change)
+{
+    for (size_t idx: frameIndices)
+    {
+        switch (change)
+        {
+        case Change::ACTIVATE:   m_ActiveFlags[idx] = 1; break;
+        case Change::DEACTIVATE: m_ActiveFlags[idx] = 0; break;
+        case Change::TOGGLE:     m_ActiveFlags[idx] = !m_ActiveFlags[idx]; break;
+        }
+    }
+    m_BulkChangedSignal.emit();
+}
+
+void c_FrameListModel::ActivateAll()
+{
+    m_ActiveFlags.assign(m_ActiveFlags.size(), 1);
+    m_BulkChangedSignal.emit();
+}
+
+void c_FrameListModel::SetIter(iterator &iter, size_t frameIdx) const
+{
+    iter.set_stamp(m_Stamp);
+    iter.gobj()->user_data = GSIZE_TO_POINTER(frameIdx);
+}
+
+size_t c_FrameListModel::GetFrameIdx(const iterator &iter)
+{
+    return GPOINTER_TO_SIZE(iter.gobj()->user_data);
+}
+
+Gtk::TreeModelFlags c_FrameListModel::get_flags_vfunc() const
+{
+    return Gtk::TREE_MODEL_LIST_ONLY | Gtk::TREE_MODEL_ITERS_PERSIST;
+}
+
+int c_FrameListModel::get_n_columns_vfunc() const
+{
+    return m_Columns.size();
+}
+
+GType c_FrameListModel::get_column_type_vfunc(int index) const
+{
+    return m_Columns.types()[index];
+}
+
+void c_FrameListModel::get_value_vfunc(const iterator &iter, int column, Glib::ValueBase &value) const
+{
+    if (!iter_is_valid(iter))
+        return;
+
+    size_t frameIdx = GetFrameIdx(iter);
+    if (column == m_Columns.index.index())
+    {
+        Glib::Value<size_t> indexVal;
+        indexVal.init(Glib::Value<size_t>::value_type());
+        indexVal.set(frameIdx);
+        value.init(Glib::Value<size_t>::value_type());
+        value = indexVal;
+    }
+    else if (column == m_Columns.active.index())
+    {
+        Glib::Value<bool> activeVal;
+        activeVal.init(Glib::Value<bool>::value_type());
+        activeVal.set(m_ActiveFlags[frameIdx] != 0);
+        value.init(Glib::Value<bool>::value_type());
+        value = activeVal;
+    }
+}
+
+void c_FrameListModel::set_value_impl(const iterator &row, int column, const Glib::ValueBase &value)
+{
+    // Only the "active" state can be edited
+    if (!iter_is_valid(row) || column != m_Columns.active.index())
+        return;
+
+    Glib::Value<bool> activeVal;
+    activeVal.init(value.gobj());
+    m_ActiveFlags[GetFrameIdx(row)] = activeVal.get();
+
+    row_changed(get_path(row), row);
+}
+
+bool c_FrameListModel::iter_next_vfunc(const iterator &iter, iterator &iterNext) const
+{
+    if (iter_is_valid(iter) && GetFrameIdx(iter) + 1 < m_ActiveFlags.size())
+    {
+        SetIter(iterNext, GetFrameIdx(iter) + 1);
+        return true;
+    }
+    else
+    {
+        iterNext.set_stamp(0);
+        return false;
+    }
+}
+
+bool c_FrameListModel::iter_children_vfunc(const iterator &/*parent*/, iterator &/*iter*/) const
+{
+    // Rows have no children (root rows are provided by iter_nth_root_child_vfunc())
+    return false;
+}
+
+bool c_FrameListModel::iter_has_child_vfunc(const iterator &/*iter*/) const
+{
+    return false;
+}
+
+int c_FrameListModel::iter_n_children_vfunc(const iterator &/*iter*/) const
+{
+    return 0;
+}
+
+int c_FrameListModel::iter_n_root_children_vfunc() const
+{
+    return m_ActiveFlags.size();
+}
+
+bool c_FrameListModel::iter_nth_child_vfunc(const iterator &/*parent*/, int /*n*/, iterator &/*iter*/) const
+{
+    return false;
+}
+
+bool c_FrameListModel::iter_nth_root_child_vfunc(int n, iterator &iter) const
+{
+    if (n >= 0 && (size_t)n < m_ActiveFlags.size())
+    {
+        SetIter(iter, n);
+        return true;
+    }
+    else
+        return false;
+}
+
+bool c_FrameListModel::iter_parent_vfunc(const iterator &/*child*/, iterator &/*iter*/) const
+{
+    return false;
+}
+
+Gtk::TreeModel::Path c_FrameListModel::get_path_vfunc(const iterator &iter) const
+{
+    Path path;
+    if (iter_is_valid(iter))
+        path.push_back(GetFrameIdx(iter));
+    return path;
+}
+
+bool c_FrameListModel::get_iter_vfunc(const Path &path, iterator &iter) const
+{
+    if (path.size() == 1)
+        return iter_nth_root_child_vfunc(path[0], iter);
+    else
+        return false;
+}
+
+bool c_FrameListModel::iter_is_valid(const iterator &iter) const
+{
+    return iter.get_stamp() == m_Stamp && GetFrameIdx(iter) < m_ActiveFlags.size();
+}
@@ -0,0 +1,114 @@
+/*
+Stackistry - astronomical image stacking
+Copyright (C) 2016, 2017 Filip Szczerek <ga.software@yahoo.com>
+
+This file is part of Stackistry.
+
+Stackistry is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Stackistry is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Stackistry.  If not, see <http://www.gnu.org/licenses/>.
+
+File description:
+    Frame list model header.
+*/
+
+#ifndef STACKISTRY_FRAME_LIST_MODEL_HEADER
+#define STACKISTRY_FRAME_LIST_MODEL_HEADER
+
+#include <cstdint>
+#include <vector>
+
+#include <glibmm/object.h>
+#include <gtkmm/treemodel.h>
+
+
+/// List of frames and their "active" state; rows are not stored, but created on demand from the active flags
+/** Changes of many frames at once are not reported per row; instead, 'signal_BulkChanged' is emitted once. */
+class c_FrameListModel: public Glib::Object, public Gtk::TreeModel
+{
+public:
+
+    class c_Columns: public Gtk::TreeModelColumnRecord
+    {
+    public:
+        Gtk::TreeModelColumn<size_t> index;
+        Gtk::TreeModelColumn<bool> active;
+
+        c_Columns()
+        {
+            add(index);
+            add(active);
+        }
+    };
+
+    enum class Change { ACTIVATE, DEACTIVATE, TOGGLE };
+
+    /// Element count of 'activeFlags' = number of frames
+    static Glib::RefPtr<c_FrameListModel> create(const std::vector<uint8_t> &activeFlags);
+
+    const c_Columns &GetColumns() const { return m_Columns; }
+
+    const std::vector<uint8_t> &GetActiveFlags() const { return m_ActiveFlags; }
+
+    bool IsActive(size_t frameIdx) const { return m_ActiveFlags[frameIdx] != 0; }
+
+    /// Applies 'change' to the specified frames; emits 'signal_BulkChanged' once
+    void ChangeActive(const std::vector<size_t> &frameIndices, Change change);
+
+    /// Activates all frames; emits 'signal_BulkChanged' once
+    void ActivateAll();
+
+    sigc::signal<void> signal_BulkChanged() { return m_BulkChangedSignal; }
+
+protected:
+
+    c_FrameListModel(const std::vector<uint8_t> &activeFlags);
+
+    // Gtk::TreeModel implementation -------
+    virtual Gtk::TreeModelFlags get_flags_vfunc() const;
+    virtual int get_n_columns_vfunc() const;
+    virtual GType get_column_type_vfunc(int index) const;
+    virtual void get_value_vfunc(const iterator &iter, int column, Glib::ValueBase &value) const;
+    virtual void set_value_impl(const iterator &row, int column, const Glib::ValueBase &value);
+    virtual bool iter_next_vfunc(const iterator &iter, iterator &iterNext) const;
+    virtual bool iter_children_vfunc(const iterator &parent, iterator &iter) const;
+    virtual bool iter_has_child_vfunc(const iterator &iter) const;
+    virtual int iter_n_children_vfunc(const iterator &iter) const;
+    virtual int iter_n_root_children_vfunc() const;
+    virtual bool iter_nth_child_vfunc(const iterator &parent, int n, iterator &iter) const;
+    virtual bool iter_nth_root_child_vfunc(int n, iterator &iter) const;
+    virtual bool iter_parent_vfunc(const iterator &child, iterator &iter) const;
+    virtual Path get_path_vfunc(const iterator &iter) const;
+    virtual bool get_iter_vfunc(const Path &path, iterator &iter) const;
+    virtual bool iter_is_valid(const iterator &iter) const;
+    // -------------------------------------
+
+private:
+
+    c_Columns m_Columns;
+
+    /// Element [i] is non-zero if frame 'i' is active
+    std::vector<uint8_t> m_ActiveFlags;
+
+    /// Identifies iterators created by this model
+    int m_Stamp;
+
+    sigc::signal<void> m_BulkChangedSignal;
+
+    /// Makes 'iter' refer to the row of the specified frame
+    void SetIter(iterator &iter, size_t frameIdx) const;
+
+    /// Returns index of the frame referred to by 'iter'
+    static size_t GetFrameIdx(const iterator &iter);
+};
+
+#endif // STACKISTRY_FRAME_LIST_MODEL_HEADER
@@ -0,0 +1,189 @@
+/*
+Stackistry - astronomical image stacking
+Copyright (C) 2016, 2017 Filip Szczerek <ga.software@yahoo.com>
+
+This file is part of Stackistry.
+
+Stackistry is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Stackistry is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Stackistry.  If not, see <http://www.gnu.org/licenses/>.
+
+File description:
+    Background frame loader implementation.
+*/
+
+#include <utility>
+
+#include "frame_loader.h"
+
+
+c_FrameLoader::c_FrameLoader(FrameCache::SeqId_t seqId, const libskry::c_ImageSequence &imgSeq, size_t numPrefetched)
+: m_SeqId(seqId), m_ImgSeq(imgSeq), m_NumPrefetched(numPrefetched)
+{
+    m_Thread = Glib::Threads::Thread::create(sigc::mem_fun(*this, &c_FrameLoader::ThreadFunc));
+}
+
+c_FrameLoader::~c_FrameLoader()
+{
+    { Glib::Threads::Mutex::Lock lock(m_Mtx);
+        m_Finish = true;
+        m_CondWork.signal();
+    }
+    m_Thread->join();
+}
+
+void c_FrameLoader::Request(size_t imgIdx)
+{
+    Glib::Threads::Mutex::Lock lock(m_Mtx);
+
+    if (imgIdx > m_RequestedIdx)
+        m_Direction = 1;
+    else if (imgIdx < m_RequestedIdx)
+        m_Direction = -1;
+
+    m_RequestedIdx = imgIdx;
+    m_IsRequestPending = true;
+    m_IsPrefetchActive = true;
+    m_CondWork.signal();
+}
+
+bool c_FrameLoader::GetLoadedImage(size_t &imgIdx, FrameCache::ImagePtr_t &img)
+{
+    Glib::Threads::Mutex::Lock lock(m_Mtx);
+
+    if (!m_IsLoadedNew)
+        return false;
+
+    imgIdx = m_LoadedIdx;
+    img = std::move(m_LoadedImg);
+    m_IsLoadedNew = false;
+    return true;
+}
+
+void c_FrameLoader::WaitUntilIdle()
+{
+    Glib::Threads::Mutex::Lock lock(m_Mtx);
+
+    m_IsRequestPending = false;
+    m_IsPrefetchActive = false;
+    m_Prefetched.clear();
+
+    while (m_IsDecoding)
+        m_CondIdle.wait(m_Mtx);
+}
+
+void c_FrameLoader::ConnectLoadedSignal(const sigc::slot<void> &slot)
+{
+    m_Dispatcher.connect(slot);
+}
+
+bool c_FrameLoader::IsPrefetchedIdx(size_t imgIdx) const
+{
+    size_t distance = (m_Direction > 0 ? imgIdx - m_PrefetchOrigin : m_PrefetchOrigin - imgIdx);
+    return (imgIdx != m_PrefetchOrigin
+            && (m_Direction > 0) == (imgIdx > m_PrefetchOrigin)
+            && distance <= m_NumPrefetched);
+}
+
+bool c_FrameLoader::GetNextPrefetchIdx(size_t &imgIdx) const
+{
+    if (!m_IsPrefetchActive)
+        return false;
+
+    // Frames closest to the last requested one are decoded first
+    for (size_t distance = 1; distance <= m_NumPrefetched; distance++)
+    {
+        if (m_Direction > 0 ? m_PrefetchOrigin + distance >= m_ImgSeq.GetImageCount()
+                            : distance > m_PrefetchOrigin)
+        {
+            break;
+        }
+
+        size_t idx = (m_Direction > 0 ? m_PrefetchOrigin + distance : m_PrefetchOrigin - distance);
+        if (m_Prefetched.find(idx) == m_Prefetched.end())
+        {
+            imgIdx = idx;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void c_FrameLoader::ThreadFunc()
+{
+    Glib::Threads::Mutex::Lock lock(m_Mtx);
+    while (true)
+    {
+        size_t prefetchIdx = 0;
+        while (!m_Finish && !m_IsRequestPending && !GetNextPrefetchIdx(prefetchIdx))
+            m_CondWork.wait(m_Mtx);
+
+        if (m_Finish)
+            break;
+
+        if (m_IsRequestPending)
+        {
+            // Requests made while decoding are not queued; only the latest one is served
+            size_t imgIdx = m_RequestedIdx;
+            m_IsRequestPending = false;
+
+            FrameCache::ImagePtr_t img;
+            auto prefetched = m_Prefetched.find(imgIdx);
+            if (prefetched != m_Prefetched.end())
+                img = std::move(prefetched->second);
+            else
+            {
+                m_IsDecoding = true;
+                lock.release();
+
+                img = FrameCache::GetImage(m_SeqId, m_ImgSeq, imgIdx);
+
+                lock.acquire();
+                m_IsDecoding = false;
+                m_CondIdle.broadcast();
+            }
+
+            m_LoadedIdx = imgIdx;
+            m_LoadedImg = std::move(img);
+            m_IsLoadedNew = true;
+
+            // Keep only the prefetched frames following the new one in the direction of browsing
+            m_PrefetchOrigin = imgIdx;
+            for (auto it = m_Prefetched.begin(); it != m_Prefetched.end();)
+            {
+                if (IsPrefetchedIdx(it->first))
+                    ++it;
+                else
+                    it = m_Prefetched.erase(it);
+            }
+
+            m_Dispatcher();
+        }
+        else
+        {
+            m_IsDecoding = true;
+            lock.release();
+
+            FrameCache::ImagePtr_t img = FrameCache::GetImage(m_SeqId, m_ImgSeq, prefetchIdx);
+
+            lock.acquire();
+            m_IsDecoding = false;
+            m_CondIdle.broadcast();
+
+            // The request or direction may have changed in the meantime; a frame which failed
+            // to decode is stored too, so that decoding is not retried
+            if (m_IsPrefetchActive && IsPrefetchedIdx(prefetchIdx))
+                m_Prefetched[prefetchIdx] = std::move(img);
+        }
+    }
+}
@@ -0,0 +1,107 @@
+/*
+Stackistry - astronomical image stacking
+Copyright (C) 2016, 2017 Filip Szczerek <ga.software@yahoo.com>
+
+This file is part of Stackistry.
+
+Stackistry is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Stackistry is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Stackistry.  If not, see <http://www.gnu.org/licenses/>.
+
+File description:
+    Background frame loader header.
+*/
+
+#ifndef STACKISTRY_FRAME_LOADER_HEADER
+#define STACKISTRY_FRAME_LOADER_HEADER
+
+#include <cstddef>
+#include <map>
+
+#include <glibmm/dispatcher.h>
+#include <glibmm/threads.h>
+#include <skry/skry_cpp.hpp>
+
+#include "frame_cache.h"
+
+
+/// Decodes frames of an image sequence in a background thread when browsing them interactively
+/** Only the most recently requested frame is decoded; requests made while another frame is being
+    decoded replace each other. Afterwards, up to 'numPrefetched' frames following the requested one
+    in the direction of browsing are decoded in advance. Frames are decoded via FrameCache.
+
+    Must be created and used by the main thread. Except when the loader is idle (see WaitUntilIdle()),
+    'imgSeq' must not be used by other threads for decoding. */
+class c_FrameLoader
+{
+public:
+    c_FrameLoader(FrameCache::SeqId_t seqId, const libskry::c_ImageSequence &imgSeq, size_t numPrefetched);
+    c_FrameLoader(const c_FrameLoader &) = delete;
+    c_FrameLoader &operator=(const c_FrameLoader &) = delete;
+
+    /// Stops the loader thread (after decoding of the current frame completes)
+    ~c_FrameLoader();
+
+    /// Requests decoding of frame 'imgIdx' (absolute index); replaces the previous request if not yet started
+    void Request(size_t imgIdx);
+
+    /// Retrieves the most recently decoded requested frame; returns false if there is none since the previous call
+    /** 'img' is null if decoding failed. */
+    bool GetLoadedImage(size_t &imgIdx, FrameCache::ImagePtr_t &img);
+
+    /// Discards the pending request and prefetched frames, then waits until the current decoding completes
+    /** Afterwards, 'imgSeq' can be used by other threads until the next call to Request(). */
+    void WaitUntilIdle();
+
+    /// Connects a slot called in the main thread after a requested frame has been decoded
+    void ConnectLoadedSignal(const sigc::slot<void> &slot);
+
+private:
+    FrameCache::SeqId_t m_SeqId;
+    const libskry::c_ImageSequence &m_ImgSeq;
+    size_t m_NumPrefetched;
+
+    bool m_IsRequestPending = false;
+    size_t m_RequestedIdx = 0;
+    /// Direction of browsing (1 or -1); determined from the last two requests
+    int m_Direction = 1;
+    /// Index of the last decoded requested frame; prefetching proceeds from here in 'm_Direction'
+    size_t m_PrefetchOrigin = 0;
+    /// If false, no frames are prefetched; changed only by the main thread
+    bool m_IsPrefetchActive = false;
+    /// Decoded frames following 'm_PrefetchOrigin'; key: frame index
+    std::map<size_t, FrameCache::ImagePtr_t> m_Prefetched;
+
+    bool m_IsLoadedNew = false;
+    size_t m_LoadedIdx = 0;
+    FrameCache::ImagePtr_t m_LoadedImg;
+
+    bool m_IsDecoding = false;
+    bool m_Finish = false;
+
+    Glib::Threads::Mutex m_Mtx; ///< Access guard for the variables above
+    Glib::Threads::Cond m_CondWork; ///< Signaled when there is a new request (or the thread is to finish)
+    Glib::Threads::Cond m_CondIdle; ///< Signaled when decoding of a frame completes
+    Glib::Threads::Thread *m_Thread = nullptr;
+
+    Glib::Dispatcher m_Dispatcher;
+
+    void ThreadFunc();
+
+    /// Returns true if frame 'imgIdx' is among those to be prefetched; has to be called with 'm_Mtx' locked
+    bool IsPrefetchedIdx(size_t imgIdx) const;
+
+    /// Returns true and sets 'imgIdx' if there is a frame to prefetch; has to be called with 'm_Mtx' locked
+    bool GetNextPrefetchIdx(size_t &imgIdx) const;
+};
+
+#endif // STACKISTRY_FRAME_LOADER_HEADER
@@ -30,8 +30,10 @@ File description:
 #include <gtkmm/label.h>
 #include <gtkmm/separator.h>
 #include <gtkmm/scrolledwindow.h>
+#include <pangomm/layout.h>
 
 #include "config.h"
+#include "frame_cache.h"
 #include "frame_select.h"
 #include "utils.h"
 
@@ -55,43 +57,60 @@ void c_FrameSelectDlg::OnSyncToggled()
     m_FrameList.view.get_cursor(path, focusCol);
 
     if (m_SyncListWSlider.get_active() && !path.empty()) // 'path' will be always filled
-        m_VideoPos.set_value((*m_FrameList.data->get_iter(path))[m_FrameList.columns.index]);
+        m_VideoPos.set_value(path[0]);
 }
 
 Gtk::Box *c_FrameSelectDlg::CreateFrameListBox()
 {
     get_action_area()->set_border_width(10);
 
-    m_FrameList.data = Gtk::ListStore::create(m_FrameList.columns);
+    // The dialog works on a copy of the flags, so that 'm_ImgSeq' is not modified if the user cancels
+    const uint8_t *activeFlags = m_ImgSeq.GetImgActiveFlags();
+    m_FrameList.data = c_FrameListModel::create(std::vector<uint8_t>(activeFlags, activeFlags + m_ImgSeq.GetImageCount()));
+
+    const c_FrameListModel::c_Columns &columns = m_FrameList.data->GetColumns();
     m_FrameList.view.set_model(m_FrameList.data);
     m_FrameList.view.set_activate_on_single_click(false);
-    m_FrameList.view.append_column_editable(_("Active"), m_FrameList.columns.active);
-    m_FrameList.view.append_column(_("Index"), m_FrameList.columns.index);
+    m_FrameList.view.append_column_editable(_("Active"), columns.active);
+    m_FrameList.view.append_column(_("Index"), columns.index);
+
+    // With fixed sizes the view does not measure every row (which is slow for long sequences)
+    auto getTextWidth = [this](const Glib::ustring &text)
+        {
+            int width, height;
+            m_FrameList.view.create_pango_layout(text)->get_pixel_size(width, height);
+            return width + 4 * (int)Utils::Const::widgetPaddingInPixels;
+        };
+    for (Gtk::TreeViewColumn *column: m_FrameList.view.get_columns())
+        column->set_sizing(Gtk::TreeViewColumnSizing::TREE_VIEW_COLUMN_FIXED);
+    m_FrameList.view.get_column(0)->set_fixed_width(getTextWidth(_("Active")));
+    m_FrameList.view.get_column(1)->set_fixed_width(
+        std::max(getTextWidth(_("Index")), getTextWidth(Glib::ustring::format(m_ImgSeq.GetImageCount()))));
+    m_FrameList.view.set_fixed_height_mode(true);
 
     m_FrameList.view.show();
-    const uint8_t *activeFlags = m_ImgSeq.GetImgActiveFlags();
-    for (size_t i = 0; i < m_ImgSeq.GetImageCount(); i++)
-    {
-        auto row = *m_FrameList.data->append();
-        row[m_FrameList.columns.index] = i;
-        row[m_FrameList.columns.active] = (1 == activeFlags[i]);
-    }
-    m_FrameList.view.columns_autosize();
     m_FrameList.view.get_selection()->set_mode(Gtk::SelectionMode::SELECTION_MULTIPLE);
     m_FrameList.view.set_cursor(Gtk::TreeModel::Path("0"));
     m_FrameList.view.signal_cursor_changed().connect(sigc::mem_fun(*this, &c_FrameSelectDlg::OnFrameListCursorChanged));
     m_FrameList.view.signal_key_press_event().connect(sigc::mem_fun(*this, &c_FrameSelectDlg::OnListKeyPress), false);
 
     m_FrameList.data->signal_row_changed().connect(sigc::slot<void, const Gtk::TreeModel::Path&, const Gtk::TreeModel::iterator&>(
-        [this](const Gtk::TreeModel::Path &path, const Gtk::TreeModel::iterator &iter)
+        [this](const Gtk::TreeModel::Path &path, const Gtk::TreeModel::iterator &)
         {
             // If "active" state of the currently displayed frame changed, refresh it
-            if ((*iter)[m_FrameList.columns.index] == (size_t)m_VideoPos.get_value())
+            if ((size_t)path[0] == m_ShownImgIdx)
             {
-                m_ImgView.Refresh();;
+                m_ImgView.Refresh();
             }
         }
     ));
+    m_FrameList.data->signal_BulkChanged().connect(
+        [this]()
+        {
+            // Rows are not notified individually; the visible ones are re-read when redrawing
+            m_FrameList.view.queue_draw();
+            m_ImgView.Refresh();
+        });
 
     auto listScrWin = Gtk::manage(new Gtk::ScrolledWindow());
     listScrWin->add(m_FrameList.view);
@@ -125,17 +144,16 @@ Gtk::Box *c_FrameSelectDlg::CreateFrameListBox()
 
 void c_FrameSelectDlg::OnActivateAll()
 {
-    for (auto &row: m_FrameList.data->children())
-        row[m_FrameList.columns.active] = true;
+    m_FrameList.data->ActivateAll();
 }
 
 void c_FrameSelectDlg::InitControls()
 {
-    libskry::c_Image firstImg = m_ImgSeq.GetImageByIdx(0);
+    FrameCache::ImagePtr_t firstImg = FrameCache::GetImage(m_SeqId, m_ImgSeq, 0);
     if (!firstImg)
         std::cout << "Failed to load first image " << std::endl;
     else
-        m_ImgView.SetImage(firstImg);
+        m_ImgView.SetImage(*firstImg);
 
     m_ImgView.signal_DrawImageArea().connect(sigc::mem_fun(*this, &c_FrameSelectDlg::OnDrawImage));
     m_ImgView.show();
@@ -162,36 +180,52 @@ void c_FrameSelectDlg::InitControls()
     add_button(_("Cancel"), Gtk::RESPONSE_CANCEL);
 }
 
-c_FrameSelectDlg::c_FrameSelectDlg(libskry::c_ImageSequence &imgSeq)
-: Gtk::Dialog(), m_ImgSeq(imgSeq)
+c_FrameSelectDlg::c_FrameSelectDlg(FrameCache::SeqId_t seqId, libskry::c_ImageSequence &imgSeq)
+: Gtk::Dialog(), m_SeqId(seqId), m_ImgSeq(imgSeq), m_FrameLoader(seqId, imgSeq, Utils::Const::NumPrefetchedFrames), m_ShownImgIdx(0)
 {
     set_title(_("Select frames for processing"));
     InitControls();
     signal_response().connect(sigc::mem_fun(*this, &c_FrameSelectDlg::OnResponse));
+    m_FrameLoader.ConnectLoadedSignal(sigc::mem_fun(*this, &c_FrameSelectDlg::OnFrameLoaded));
     Utils::RestorePosSize(Configuration::FrameSelectDlgPosSize, *this);
 }
 
 void c_FrameSelectDlg::OnResponse(int responseId)
 {
+    // The caller may modify the image sequence after the dialog returns
+    m_FrameLoader.WaitUntilIdle();
+
     Utils::SavePosSize(*this, Configuration::FrameSelectDlgPosSize);
 }
 
 void c_FrameSelectDlg::OnVideoPosScroll()
 {
-    libskry::c_Image img = m_ImgSeq.GetImageByIdx((int)m_VideoPos.get_value());
-
-    if (!img)
-        std::cout << "Failed to load image " << m_VideoPos.get_value() << std::endl;
-    else
-        m_ImgView.SetImage(img);
+    // Decoded in the background; the previous frame is shown until then
+    m_FrameLoader.Request((size_t)m_VideoPos.get_value());
 
     if (m_SyncListWSlider.get_active())
         m_FrameList.view.set_cursor(Gtk::TreeModel::Path(Glib::ustring::format((size_t)m_VideoPos.get_value())));
 }
 
+void c_FrameSelectDlg::OnFrameLoaded()
+{
+    size_t imgIdx;
+    FrameCache::ImagePtr_t img;
+    if (!m_FrameLoader.GetLoadedImage(imgIdx, img))
+        return;
+
+    if (!img)
+        std::cout << "Failed to load image " << imgIdx << std::endl;
+    else
+    {
+        m_ShownImgIdx = imgIdx;
+        m_ImgView.SetImage(*img);
+    }
+}
+
 bool c_FrameSelectDlg::OnDrawImage(const Cairo::RefPtr<Cairo::Context>& cr)
 {
-    if (!m_FrameList.data->children()[(size_t)m_VideoPos.get_value()][m_FrameList.columns.active])
+    if (!m_FrameList.data->IsActive(m_ShownImgIdx))
     {
         int w = m_ImgView.GetImage()->get_width(),
             h = m_ImgView.GetImage()->get_height();
@@ -220,19 +254,13 @@ void c_FrameSelectDlg::OnFrameListCursorChanged()
         Gtk::TreeViewColumn *focus_column;
         m_FrameList.view.get_cursor(path, focus_column);
 
-        m_VideoPos.set_value(((*m_FrameList.data->get_iter(path))[m_FrameList.columns.index]));
+        m_VideoPos.set_value(path[0]);
     }
 }
 
 std::vector<uint8_t> c_FrameSelectDlg::GetActiveFlags() const
 {
-    std::vector<uint8_t> result;
-    result.reserve(m_ImgSeq.GetImageCount());
-
-    for (auto &row: m_FrameList.data->children())
-        result.push_back(row[m_FrameList.columns.active]);
-
-    return result;
+    return m_FrameList.data->GetActiveFlags();
 }
 
 bool c_FrameSelectDlg::OnListKeyPress(GdkEventKey *event)
@@ -240,16 +268,12 @@ bool c_FrameSelectDlg::OnListKeyPress(GdkEventKey *event)
     if (event->keyval == KEY_DEACTIVATE_FRAMES ||
         event->keyval == KEY_TOGGLE_FRAMES)
     {
-        bool toggle = (event->keyval == KEY_TOGGLE_FRAMES);
-
+        std::vector<size_t> frameIndices;
         for (auto &row: m_FrameList.view.get_selection()->get_selected_rows())
-        {
-            auto iter = m_FrameList.data->get_iter(row);
-            if (toggle)
-                (*iter)[m_FrameList.columns.active] = !(*iter)[m_FrameList.columns.active];
-            else
-                (*iter)[m_FrameList.columns.active] = false;
-        }
+            frameIndices.push_back(row[0]);
+
+        m_FrameList.data->ChangeActive(frameIndices, event->keyval == KEY_TOGGLE_FRAMES ? c_FrameListModel::Change::TOGGLE
+                                                                                         : c_FrameListModel::Change::DEACTIVATE);
 
         return true; // prevent normal handling of GDK_KEY_space (after our toggle,
                      // it would re-enable the frame if focus was on the checkboxes column)
@@ -29,47 +29,41 @@ File description:
 
 #include <cairomm/context.h>
 #include <gtkmm/dialog.h>
-#include <gtkmm/liststore.h>
 #include <gtkmm/scale.h>
 #include <gtkmm/togglebutton.h>
 #include <gtkmm/treeview.h>
 #include <skry/skry_cpp.hpp>
 
+#include "frame_list_model.h"
+#include "frame_loader.h"
 #include "img_viewer.h"
 
 
 class c_FrameSelectDlg: public Gtk::Dialog
 {
 public:
-    c_FrameSelectDlg(libskry::c_ImageSequence &imgSeq);
+    /// 'seqId' identifies 'imgSeq' in FrameCache
+    c_FrameSelectDlg(FrameCache::SeqId_t seqId, libskry::c_ImageSequence &imgSeq);
 
     /// Element count = number of images in 'imgSeq'
     std::vector<uint8_t> GetActiveFlags() const;
 
 private:
-    class c_FrameListModelColumns: public Gtk::TreeModelColumnRecord
-    {
-    public:
-        Gtk::TreeModelColumn<size_t> index;
-        Gtk::TreeModelColumn<bool> active;
-
-        c_FrameListModelColumns()
-        {
-            add(index);
-            add(active);
-        }
-    };
-
+    FrameCache::SeqId_t m_SeqId;
     libskry::c_ImageSequence &m_ImgSeq;
 
+    /// Decodes frames selected with the slider; has to be idle when the dialog is not running
+    c_FrameLoader m_FrameLoader;
+    /// Absolute index of the frame shown in 'm_ImgView'; may lag behind the slider while a frame is being decoded
+    size_t m_ShownImgIdx;
+
     c_ImageViewer m_ImgView;
     Gtk::Scale m_VideoPos;
     Gtk::ToggleButton m_SyncListWSlider;
     struct
     {
-        c_FrameListModelColumns      columns;
-        Glib::RefPtr<Gtk::ListStore> data;
-        Gtk::TreeView                view;
+        Glib::RefPtr<c_FrameListModel> data;
+        Gtk::TreeView                  view;
     } m_FrameList;
 
     void InitControls();
@@ -78,6 +72,7 @@ private:
 
     // Signal handlers ----------------------------
     void OnVideoPosScroll();
+    void OnFrameLoaded();
     void OnActivateAll();
     void OnSyncToggled();
     bool OnDrawImage(const Cairo::RefPtr<Cairo::Context>& cr);
@@ -0,0 +1,308 @@
+/*
+Stackistry - astronomical image stacking
+Copyright (C) 2016, 2017 Filip Szczerek <ga.software@yahoo.com>
+
+This file is part of Stackistry.
+
+Stackistry is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Stackistry is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Stackistry.  If not, see <http://www.gnu.org/licenses/>.
+
+File description:
+    Job structure implementation.
+*/
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <sstream>
+
+#include <glib/gstdio.h>
+#include <glibmm/fileutils.h>
+#include <glibmm/miscutils.h>
+#include <glibmm/ustring.h>
+
+#include "job.h"
+#include "output_fmt.h"
+
+
+void SetDefaultSettings(Job_t &job)
+{
+    assert(job.imgSeq);
+
+    job.frameCacheId = FrameCache::NewSequenceId();
+    job.outputSaveMode = Utils::Const::Defaults::saveMode;
+    job.outputFmt = Utils::Const::Defaults::outputFmt;
+    job.alignmentMethod = Utils::Const::Defaults::alignmentMethod;
+    job.refPtAutoPlacementParams.spacing = Utils::Const::Defaults::referencePointSpacing;
+    job.refPtAutoPlacementParams.brightnessThreshold = Utils::Const::Defaults::placementBrightnessThreshold;
+    job.refPtAutoPlacementParams.structureScale = Utils::Const::Defaults::refPtStructureScale;
+    job.refPtAutoPlacementParams.structureThreshold = Utils::Const::Defaults::refPtStructureThreshold;
+    job.quality.criterion = Utils::Const::Defaults::qualityCriterion;
+    job.quality.threshold = Utils::Const::Defaults::qualityThreshold;
+    job.automaticRefPointsPlacement = true;
+    job.automaticAnchorPlacement = true;
+    job.cfaPattern = SKRY_CFA_NONE;
+    job.refPtBlockSize = Utils::Const::Defaults::refPtRefBlockSize;
+    job.refPtSearchRadius = Utils::Const::Defaults::refPtSearchRadius;
+    job.exportQualityData = false;
+    job.qualityDataReadyNotification = false;
+}
+
+std::string GetAlignmentKey(const Job_t &job)
+{
+    std::ostringstream key;
+
+    const std::vector<std::string> &sourceFiles = (job.imgSeq.GetType() == SKRY_IMG_SEQ_IMAGE_FILES
+                                                   ? job.sourceFileNames
+                                                   : std::vector<std::string>{ job.sourcePath });
+    for (const std::string &fname: sourceFiles)
+    {
+        GStatBuf fileStat;
+        if (0 != g_stat(fname.c_str(), &fileStat))
+            return "";
+
+        key << fname << " " << fileStat.st_size << " " << fileStat.st_mtime << "\n";
+    }
+
+    const uint8_t *activeFlags = job.imgSeq.GetImgActiveFlags();
+    for (size_t i = 0; i < job.imgSeq.GetImageCount(); i++)
+        key << (activeFlags[i] ? '1' : '0');
+
+    key << "\n" << (int)job.cfaPattern << " " << (int)job.alignmentMethod << " " << job.automaticAnchorPlacement;
+    for (const struct SKRY_point &anchor: job.anchors)
+        key << " " << anchor.x << "," << anchor.y;
+
+    return key.str();
+}
+
+/// Signature of alignment cache files (see SaveAlignmentCache()); values are stored in native byte order
+const char ALIGNMENT_CACHE_SIGNATURE[8] = { 'S', 'K', 'A', 'L', 'I', 'G', 'N', '1' };
+
+/// Max. length of the key stored in an alignment cache file
+const uint64_t MAX_ALIGNMENT_KEY_LEN = 64 << 20;
+
+static std::string GetAlignmentCachePath(const Job_t &job)
+{
+    std::string source = job.sourcePath;
+    if (!job.sourceFileNames.empty())
+        source += "\n" + job.sourceFileNames[0];
+
+    std::ostringstream fileName;
+    fileName << std::hex << std::hash<std::string>()(source) << ".cache";
+
+    return Glib::build_filename(Glib::get_user_cache_dir(), "stackistry", fileName.str());
+}
+
+bool SaveAlignmentCache(const Job_t &job, const std::string &alignmentKey,
+                        const std::vector<struct SKRY_point> &imgOffsets, const std::vector<SKRY_quality_t> &quality)
+{
+    if (alignmentKey.empty() || imgOffsets.size() != quality.size())
+        return false;
+
+    std::string path = GetAlignmentCachePath(job);
+    if (0 != g_mkdir_with_parents(Glib::path_get_dirname(path).c_str(), 0755))
+        return false;
+
+    std::ofstream file(path, std::ios_base::binary | std::ios_base::trunc);
+    if (!file)
+        return false;
+
+    uint64_t keyLen = alignmentKey.size(), numFrames = quality.size();
+    file.write(ALIGNMENT_CACHE_SIGNATURE, sizeof(ALIGNMENT_CACHE_SIGNATURE));
+    file.write(reinterpret_cast<const char *>(&keyLen), sizeof(keyLen));
+    file.write(alignmentKey.data(), keyLen);
+    file.write(reinterpret_cast<const char *>(&numFrames), sizeof(numFrames));
+    for (const struct SKRY_point &offset: imgOffsets)
+    {
+        int32_t xy[2] = { offset.x, offset.y };
+        file.write(reinterpret_cast<const char *>(xy), sizeof(xy));
+    }
+    for (SKRY_quality_t q: quality)
+    {
+        double value = q;
+        file.write(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    return file.good();
+}
+
+bool ReadAlignmentCache(const Job_t &job, const std::string &alignmentKey,
+                        std::vector<struct SKRY_point> &imgOffsets, std::vector<SKRY_quality_t> &quality)
+{
+    if (alignmentKey.empty())
+        return false;
+
+    std::ifstream file(GetAlignmentCachePath(job), std::ios_base::binary);
+    if (!file)
+        return false;
+
+    char signature[sizeof(ALIGNMENT_CACHE_SIGNATURE)];
+    uint64_t keyLen;
+    if (!file.read(signature, sizeof(signature))
+        || !std::equal(signature, signature + sizeof(signature), ALIGNMENT_CACHE_SIGNATURE)
+        || !file.read(reinterpret_cast<char *>(&keyLen), sizeof(keyLen))
+        || keyLen != alignmentKey.size() || keyLen > MAX_ALIGNMENT_KEY_LEN)
+    {
+        return false;
+    }
+
+    std::string storedKey(keyLen, '\0');
+    uint64_t numFrames;
+    if (!file.read(&storedKey[0], keyLen) || storedKey != alignmentKey
+        || !file.read(reinterpret_cast<char *>(&numFrames), sizeof(numFrames))
+        || numFrames != job.imgSeq.GetActiveImageCount())
+    {
+        return false;
+    }
+
+    imgOffsets.resize(numFrames);
+    for (struct SKRY_point &offset: imgOffsets)
+    {
+        int32_t xy[2];
+        file.read(reinterpret_cast<char *>(xy), sizeof(xy));
+        offset.x = xy[0];
+        offset.y = xy[1];
+    }
+    quality.resize(numFrames);
+    for (SKRY_quality_t &q: quality)
+    {
+        double value;
+        file.read(reinterpret_cast<char *>(&value), sizeof(value));
+        q = value;
+    }
+
+    return (bool)file;
+}
+
+bool LoadAlignmentCache(Job_t &job)
+{
+    std::vector<struct SKRY_point> imgOffsets;
+    std::vector<SKRY_quality_t> quality;
+    if (!ReadAlignmentCache(job, GetAlignmentKey(job), imgOffsets, quality))
+        return false;
+
+    job.quality.imgOffsets = std::move(imgOffsets);
+    job.quality.framesChrono = std::move(quality);
+    job.quality.framesSorted = job.quality.framesChrono;
+    std::sort(job.quality.framesSorted.begin(), job.quality.framesSorted.end(),
+              [](const SKRY_quality_t &a, const SKRY_quality_t &b) { return a > b; });
+    job.quality.generation++;
+
+    return true;
+}
+
+void ReloadQualityData(Job_t &job)
+{
+    job.quality.framesChrono.clear();
+    job.quality.framesSorted.clear();
+    job.quality.imgOffsets.clear();
+    job.quality.streamed.clear();
+    job.quality.generation++;
+
+    LoadAlignmentCache(job);
+}
+
+std::string GetRefPtAlignmentKey(const Job_t &job)
+{
+    std::ostringstream key;
+
+    key << (int)job.quality.criterion << " " << job.quality.threshold << " "
+        << job.refPtBlockSize << " " << job.refPtSearchRadius << " "
+        << job.refPtAutoPlacementParams.spacing << " "
+        << job.refPtAutoPlacementParams.brightnessThreshold << " "
+        << job.refPtAutoPlacementParams.structureThreshold << " "
+        << job.refPtAutoPlacementParams.structureScale << " "
+        << job.automaticRefPointsPlacement;
+
+    for (const struct SKRY_point &refPt: job.refPoints)
+        key << " " << refPt.x << "," << refPt.y;
+
+    return key.str();
+}
+
+bool MergeStreamedQualityData(Job_t &job)
+{
+    auto &quality = job.quality;
+    if (quality.streamed.empty())
+        return false;
+
+    quality.framesChrono.insert(quality.framesChrono.end(), quality.streamed.begin(), quality.streamed.end());
+
+    // Sort only the new values (descending) and merge them with the already sorted ones
+    auto descending = [](const SKRY_quality_t &a, const SKRY_quality_t &b) { return a > b; };
+    size_t numPrevSorted = quality.framesSorted.size();
+    quality.framesSorted.insert(quality.framesSorted.end(), quality.streamed.begin(), quality.streamed.end());
+    std::sort(quality.framesSorted.begin() + numPrevSorted, quality.framesSorted.end(), descending);
+    std::inplace_merge(quality.framesSorted.begin(), quality.framesSorted.begin() + numPrevSorted,
+                       quality.framesSorted.end(), descending);
+
+    quality.streamed.clear();
+    return true;
+}
+
+bool IsQualityDataComplete(const Job_t &job)
+{
+    return !job.quality.framesChrono.empty()
+        && job.quality.framesChrono.size() == job.imgSeq.GetActiveImageCount();
+}
+
+std::string GetDestDir(const Job_t &job)
+{
+    if (job.outputSaveMode == Utils::Const::OutputSaveMode::SOURCE_PATH)
+    {
+        return (job.imgSeq.GetType() == SKRY_IMG_SEQ_IMAGE_FILES
+                ? job.sourcePath
+                : Glib::path_get_dirname(job.sourcePath));
+    }
+    else
+        return job.destDir;
+}
+
+std::string GetAutoSaveStackPath(const Job_t &job, const std::set<std::string> &reservedPaths)
+{
+    std::string destDir = GetDestDir(job);
+
+    std::string destFName = (job.imgSeq.GetType() == SKRY_IMG_SEQ_IMAGE_FILES
+                                ? "stack"
+                                : Glib::path_get_basename(job.sourcePath) + "_stacked");
+    std::string destExt = Utils::GetOutputFormatDescr(job.outputFmt).defaultExtension;
+
+    unsigned replaceCounter = 0;
+    std::string destPath;
+    while (true)
+    {
+        destPath = Glib::build_filename(destDir, destFName +
+                        (replaceCounter ? (std::string)Glib::ustring::format(replaceCounter) + destExt : destExt));
+
+        if (!Glib::file_test(destPath, Glib::FileTest::FILE_TEST_EXISTS)
+            && reservedPaths.find(destPath) == reservedPaths.end())
+        {
+            break;
+        }
+
+        replaceCounter++;
+    }
+
+    return destPath;
+}
+
+enum SKRY_result AutoSaveStack(const Job_t &job, std::string &destPath)
+{
+    assert(job.stackedImg);
+
+    destPath = GetAutoSaveStackPath(job);
+
+    return OutputFmt::ConvertAndSave(*job.stackedImg, destPath.c_str(), job.outputFmt);
+}
@@ -24,21 +24,52 @@ File description:
 #define STACKISTRY_JOB_STRUCT_HEADER
 
 
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
 #include <skry/skry_cpp.hpp>
 
+#include "frame_cache.h"
+#include "utils.h"
+
+
+/// Results of the completed processing phases, retained after processing a job (also if stopped)
+/** Allow subsequent processing to resume after the last completed phase, if neither
+    the source data nor the settings the results depend on have changed. Kept in memory only
+    and only for the most recently finished jobs (see Utils::Const::MaxRetainedCheckpoints),
+    so they do not survive the program's exit or a crash; there are no checkpoints within
+    the stacking phase. libskry's processing objects (including the stacking accumulator)
+    can be neither serialized nor restored, so checkpoints cannot be saved to disk; only the
+    frame quality data are (see SaveAlignmentCache()). */
+struct Checkpoint_t
+{
+    std::string alignmentKey; ///< Value of GetAlignmentKey() for the job when the results were obtained
+    std::unique_ptr<libskry::c_ImageAlignment> imgAlignment; ///< Null if image alignment has not completed
+    std::unique_ptr<libskry::c_QualityEstimation> qualEstimation; ///< Null if quality estimation has not completed
+
+    std::string refPtAlignmentKey; ///< Value of GetRefPtAlignmentKey() for the job when 'refPtAlignment' was obtained
+    std::unique_ptr<libskry::c_RefPointAlignment> refPtAlignment; ///< Null if reference point alignment has not completed
+};
 
 struct Job_t
 {
     libskry::c_ImageSequence imgSeq; // has to be the first field
 
-    enum SKRY_output_format outputFmt;
+    /// Identifies 'imgSeq' in FrameCache; assigned by SetDefaultSettings()
+    FrameCache::SeqId_t frameCacheId;
+
+    OutputFormat outputFmt;
     Utils::Const::OutputSaveMode outputSaveMode;
 
-    /// If worker is running, access must be synchronized using Worker::GetAccessGuard()
-    libskry::c_Image stackedImg;
+    /// Null if the job has not been stacked
+    /** Replaced (not modified) by the worker; other owners can be the background writer saving the image.
+        If worker is running, access must be synchronized using its c_ProcessingContext::GetAccessGuard(). */
+    std::shared_ptr<const libskry::c_Image> stackedImg;
 
     /** Composite of best fragments of all images in 'imgSeq'.
-        If worker is running, access must be synchronized using Worker::GetAccessGuard(). */
+        If worker is running, access must be synchronized using its c_ProcessingContext::GetAccessGuard(). */
     libskry::c_Image bestFragmentsImg;
 
     enum SKRY_img_alignment_method alignmentMethod;
@@ -49,13 +80,26 @@ struct Job_t
         unsigned threshold; ///< Interpreted according to 'criterion'
 
         /// Frame quality in chronological order
+        /** During quality estimation contains the frames estimated so far; modified only by the main thread
+            (see MergeStreamedQualityData()), unless the worker runs without notifications. */
         std::vector<SKRY_quality_t> framesChrono;
 
         /// Frame quality, sorted descending
         std::vector<SKRY_quality_t> framesSorted;
+
+        /// Offsets of frames after image alignment (in chronological order); set together with 'framesChrono'
+        std::vector<struct SKRY_point> imgOffsets;
+
+        /// Quality of frames estimated by the worker thread and not yet appended to 'framesChrono'
+        std::vector<SKRY_quality_t> streamed;
+
+        /// Incremented whenever 'framesChrono' is cleared or replaced (but not when appended to);
+        /// allows caching of values derived from quality data
+        size_t generation;
     } quality;
 
     std::string sourcePath; ///< For image series: directory only; for videos: full path to the video file
+    std::vector<std::string> sourceFileNames; ///< For image series: full paths of the images (in sequence order)
     std::string destDir; ///< Effective if outputSaveMode==OutputSaveMode::SPECIFIED_PATH
 
     bool automaticAnchorPlacement;
@@ -94,8 +138,69 @@ struct Job_t
     /// If 'true', frame quality data will be saved to a file in the same location as the stack
     bool exportQualityData;
 
-    /// 'True' if quality data has been calculated by the worker thread
+    /// 'True' if quality data of all frames has been calculated by the worker thread
     bool qualityDataReadyNotification;
+
+    /// Element [i]: processing rate (in frames per second) achieved in phase Worker::ProcPhase(i)
+    /** Set by the worker thread after completing a phase; a phase skipped thanks to the checkpoint
+        keeps the value from the previous run (0 if never performed). Used also for estimating
+        the remaining processing time. If worker is running, access must be synchronized using
+        its c_ProcessingContext::GetAccessGuard(). */
+    std::vector<double> phaseFramesPerSec;
+
+    /// Set by the worker thread; has to be the last field (refers to 'imgSeq', so must be destroyed first)
+    /** If worker is running, access must be synchronized using its c_ProcessingContext::GetAccessGuard(). */
+    std::unique_ptr<Checkpoint_t> checkpoint;
 };
 
+/// Sets the default processing settings and assigns 'job.frameCacheId'; 'job.imgSeq' has to be already initialized
+void SetDefaultSettings(Job_t &job);
+
+/// Returns a string identifying the job's source data (including modification times) and the settings of image alignment
+/** Returns an empty string if the source files cannot be accessed. */
+std::string GetAlignmentKey(const Job_t &job);
+
+/// Saves per-frame image offsets and quality of the job's active frames to a cache file in the user's cache folder
+/** The file is identified by the job's source and stores 'alignmentKey' (see GetAlignmentKey()), so that it is used
+    only as long as the source data and alignment settings are unchanged. Returns false on error. */
+bool SaveAlignmentCache(const Job_t &job, const std::string &alignmentKey,
+                        const std::vector<struct SKRY_point> &imgOffsets, const std::vector<SKRY_quality_t> &quality);
+
+/// Reads image offsets and quality of the job's active frames from the cache file written by SaveAlignmentCache()
+/** Returns false if there is no cache file or it was not written for 'alignmentKey' (see GetAlignmentKey()). */
+bool ReadAlignmentCache(const Job_t &job, const std::string &alignmentKey,
+                        std::vector<struct SKRY_point> &imgOffsets, std::vector<SKRY_quality_t> &quality);
+
+/// Fills 'job.quality' (frame quality and image offsets) from the cache file written by SaveAlignmentCache()
+/** Returns false if there is no cache file or it does not match the job's current source data and settings.
+    Note that libskry cannot resume processing from these data; they make the quality graph and export
+    available without processing the job. */
+bool LoadAlignmentCache(Job_t &job);
+
+/// Replaces the job's quality data with those valid for its current source data and settings
+/** Clears the quality data, then fills them from the cache file if it matches (see LoadAlignmentCache()).
+    To be called, when the job is not being processed, after changing settings that GetAlignmentKey() depends on. */
+void ReloadQualityData(Job_t &job);
+
+/// Returns a string identifying the job's settings of reference point alignment
+std::string GetRefPtAlignmentKey(const Job_t &job);
+
+/// Appends 'job.quality.streamed' to the frame quality data; returns 'false' if there was nothing to append
+/** The sorted quality is updated by merging, without sorting all frames again. */
+bool MergeStreamedQualityData(Job_t &job);
+
+/// Returns 'true' if quality of all active frames has been estimated
+bool IsQualityDataComplete(const Job_t &job);
+
+/// Returns the folder where the job's output files are saved
+std::string GetDestDir(const Job_t &job);
+
+/// Returns a not yet existing path in GetDestDir() for saving the job's stacked image in its output format
+/** Paths in 'reservedPaths' (e.g. of files still being written) are treated as existing. */
+std::string GetAutoSaveStackPath(const Job_t &job, const std::set<std::string> &reservedPaths = std::set<std::string>());
+
+/// Saves the job's stacked image in GetDestDir(), using its output format and a not yet existing file name
+/** 'destPath' receives the full path of the output file. */
+enum SKRY_result AutoSaveStack(const Job_t &job, std::string &destPath);
+
 #endif // STACKISTRY_JOB_STRUCT_HEADER
@@ -21,7 +21,6 @@ File description:
     Main program file.
 */
 
-#include <chrono>
 #include <iostream>
 #if _WIN32
 #include <windows.h> // For locale functions
@@ -32,6 +31,7 @@ File description:
 #include <skry/skry.h>
 
 #include "config.h"
+#include "frame_cache.h"
 #include "main_window.h"
 #include "utils.h"
 
@@ -51,12 +51,6 @@ void SkryLogCallback(unsigned logEventType, const char *msg)
     std::cout << msg << std::endl;
 }
 
-double ClockSec()
-{
-    return 1.0/1000000 * std::chrono::duration_cast<std::chrono::microseconds>
-               (std::chrono::high_resolution_clock::now().time_since_epoch()).count();
-}
-
 int main(int argc, char *argv[])
 {
     Utils::SetAppLaunchPath(argv[0]);
@@ -100,7 +94,8 @@ int main(int argc, char *argv[])
 //        SKRY_LOG_REF_PT_ALIGNMENT |
 //        SKRY_LOG_QUALITY | SKRY_LOG_STACKING | SKRY_LOG_IMG_ALIGNMENT,
 //        SkryLogCallback);
-    SKRY_set_clock_func(ClockSec);
+    SKRY_set_clock_func(Utils::ClockSec);
+    FrameCache::SetLimits(Configuration::FrameCacheSizeMB << 20, Configuration::CompactFrameCache);
 
     auto app =
       Gtk::Application::create(argc, argv, "Stackistry-application");
@@ -121,8 +116,10 @@ int main(int argc, char *argv[])
 
     auto appResult = app->run(window);
 
-    SKRY_deinitialize();
+    // Workers have to be finished first, otherwise they could still use the cache and libskry
     window.Finalize();
+    FrameCache::Clear();
+    SKRY_deinitialize();
     Configuration::Store();
     return appResult;
 }
@@ -23,7 +23,9 @@ File description:
 
 #include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <fstream>
+#include <functional>
 #include <iomanip>
 #include <iostream>
 #include <vector>
@@ -40,6 +42,7 @@ File description:
 #include <gtkmm/cellrendererprogress.h>
 #include <gtkmm/filechooserdialog.h>
 #include <gtkmm/messagedialog.h>
+#include <gtkmm/spinbutton.h>
 #include <gtkmm/stock.h>
 #include <gtkmm/toolbar.h>
 #include <gtkmm/treemodelcolumn.h>
@@ -49,21 +52,48 @@ File description:
 
 #include "select_points.h"
 #include "config.h"
+#include "frame_cache.h"
 #include "frame_select.h"
 #include "main_window.h"
+#include "output_fmt.h"
 #include "preferences.h"
 #include "settings_dlg.h"
 #include "utils.h"
 #include "worker.h"
 
 
-#define LOCK() Glib::Threads::RecMutex::Lock lock(Worker::GetAccessGuard())
+/// Locks the access guard of the processing context working on the job at 'iter' (if any)
+#define LOCK_JOB(iter) Glib::Threads::RecMutex::Lock lock(GetJobAccessGuard(iter))
 
 #define VERSION_MAJOR 0
 #define VERSION_MINOR 3
 #define VERSION_SUBMINOR 0
 #define VERSION_DATE "2017-06-05"
 
+/// Extension of quality data files in binary format (see ExportQualityData())
+const char * const BINARY_QUALITY_DATA_EXT = ".sqd";
+
+/// Copy of a job's data written by ExportQualityData(), so that the job does not stay locked while writing
+struct QualityExportData_t
+{
+    std::string sourcePath;
+    std::vector<uint8_t> imgActiveFlags; ///< Element [i]: 1 if the i-th image of the sequence is active
+    std::vector<SKRY_quality_t> framesChrono;
+    std::vector<struct SKRY_point> imgOffsets;
+};
+
+/// Returns a copy of the job's quality data to be exported; the job's access guard has to be locked
+static QualityExportData_t GetQualityExportData(const Job_t &job)
+{
+    const uint8_t *imgIsActive = job.imgSeq.GetImgActiveFlags();
+    return QualityExportData_t { job.sourcePath,
+                                 std::vector<uint8_t>(imgIsActive, imgIsActive + job.imgSeq.GetImageCount()),
+                                 job.quality.framesChrono, job.quality.imgOffsets };
+}
+
+static bool ExportQualityData(const std::string &fileName, const std::vector<QualityExportData_t> &jobs,
+                              bool binary, bool exportInactive);
+
 namespace ActionName
 {
     const char *quit = "quit";
@@ -100,6 +130,32 @@ namespace WidgetName
     const char *MenuView = "MenuView";
 }
 
+/// Returns the text shown in the "State" column for a job being processed by 'worker'
+static
+Glib::ustring GetJobStateStr(const Worker::c_ProcessingContext &worker)
+{
+    if (worker.IsPaused())
+        return _("Paused");
+    else
+        return Worker::GetProcPhaseStr(worker.GetPhase());
+}
+
+/// Returns 'seconds' formatted as "m:ss" or "h:mm:ss"
+static
+Glib::ustring FormatDuration(double seconds)
+{
+    unsigned total = (unsigned)(seconds + 0.5);
+    unsigned hours = total / 3600, minutes = (total / 60) % 60, secs = total % 60;
+
+    if (hours > 0)
+        return Glib::ustring::compose("%1:%2:%3", hours,
+                                      Glib::ustring::format(std::setfill(L'0'), std::setw(2), minutes),
+                                      Glib::ustring::format(std::setfill(L'0'), std::setw(2), secs));
+    else
+        return Glib::ustring::compose("%1:%2", minutes,
+                                      Glib::ustring::format(std::setfill(L'0'), std::setw(2), secs));
+}
+
 static
 libskry::c_Image GetFirstActiveImage(libskry::c_ImageSequence &imgSeq, enum SKRY_result &result)
 {
@@ -178,6 +234,7 @@ void c_MainWindow::OnAddImageSeries()
 
         std::shared_ptr<Job_t> newJob = std::make_shared<Job_t>(Job_t { libskry::c_ImageSequence::InitImageList(fileNames) });
         newJob->sourcePath = Glib::path_get_dirname(fileNames[0]);
+        newJob->sourceFileNames = fileNames;
         SetDefaultSettings(*newJob);
 
         if (!newJob->imgSeq)
@@ -186,10 +243,12 @@ void c_MainWindow::OnAddImageSeries()
         }
         else
         {
+            LoadAlignmentCache(*newJob); // quality data of an earlier run, if still valid
             auto row = *m_Jobs.data->append();
             row[m_Jobs.columns.jobSource] = newJob->sourcePath;
             row[m_Jobs.columns.state]     = _("Waiting");
             row[m_Jobs.columns.progressText] = "";
+            row[m_Jobs.columns.outputErrors] = "";
             row[m_Jobs.columns.job]       = newJob;
         }
     }
@@ -204,7 +263,7 @@ void c_MainWindow::PrepareDialog(Gtk::Dialog &dlg)
 
 void c_MainWindow::OnStartProcessing()
 {
-    if (Worker::IsRunning())
+    if (GetNumRunningJobs() > 0)
     {
         std::cerr << "Cannot start processing, worker is still running." << std::endl;
         return;
@@ -216,21 +275,124 @@ void c_MainWindow::OnStartProcessing()
     for (auto &row: m_Jobs.view.get_selection()->get_selected_rows())
         m_JobsToProcess.push(row);
 
-    m_RunningJob = m_Jobs.data->get_iter(m_JobsToProcess.front());
-    m_JobsToProcess.pop();
-    Job_t &job = GetJobAt(m_RunningJob);
-    if (job.anchors.empty() && !job.automaticAnchorPlacement)
+    StartQueuedJobs();
+    UpdateActionsState();
+    UpdateOutputViewZoomControlsState();
+}
+
+void c_MainWindow::StartQueuedJobs()
+{
+    // Setting the anchors runs a dialog, whose main loop may call OnWorkerProgress()
+    // and (if a job finishes meanwhile) this method again; prevent this
+    if (m_StartingJobs)
+        return;
+
+    m_StartingJobs = true;
+
+    while (!m_JobsToProcess.empty() && GetNumRunningJobs() < Configuration::MaxConcurrentJobs)
     {
-        if (!SetAnchors(job))
-        {
-            m_RunningJob = Gtk::ListStore::iterator(nullptr);
-            return;
-        }
+        Gtk::ListStore::iterator itJob = m_Jobs.data->get_iter(m_JobsToProcess.front());
+        m_JobsToProcess.pop();
+
+        Job_t &job = GetJobAt(itJob);
+        if (job.anchors.empty() && !job.automaticAnchorPlacement)
+            if (!SetAnchors(job))
+                continue; // the user canceled, skip this job
+
+        // The job's state will reflect the new processing, not saving of the previous results
+        for (auto &pending: m_PendingOutputs)
+            if (pending.second.row.is_valid() && pending.second.row.get_path() == m_Jobs.data->get_path(itJob))
+                pending.second.row = Gtk::TreeRowReference();
+        (*itJob)[m_Jobs.columns.outputErrors] = "";
+
+        size_t slot = GetIdleSlot();
+        m_RunningJobs[slot] = itJob;
+        m_LastStepNotify[slot] = NONE;
+        m_Workers[slot]->SetPaused(m_ProcessingPaused);
+        m_Workers[slot]->SetReadAheadBufferSize(Configuration::ReadAheadBufferSizeMB << 20);
+        m_Workers[slot]->SetMaxNotificationRate(Configuration::MaxNotificationRate);
+        m_Workers[slot]->StartProcessing(&job);
     }
 
-    Worker::StartProcessing(&job);
-    UpdateActionsState();
-    UpdateOutputViewZoomControlsState();
+    m_StartingJobs = false;
+
+    UpdateVisualizedSlot();
+}
+
+size_t c_MainWindow::GetIdleSlot()
+{
+    for (size_t slot = 0; slot < m_Workers.size(); slot++)
+        if (!m_RunningJobs[slot] && m_Workers[slot]->IsIdle())
+            return slot;
+
+    auto *newWorker = new Worker::c_ProcessingContext();
+    newWorker->ConnectProgressSignal(sigc::mem_fun(*this, &c_MainWindow::OnWorkerProgress));
+    if (m_VisualizedSlot != NONE)
+    {
+        auto zoom = m_Workers[m_VisualizedSlot]->GetZoomFactor();
+        newWorker->SetZoomFactor(std::get<0>(zoom), std::get<1>(zoom));
+    }
+
+    m_Workers.emplace_back(newWorker);
+    m_RunningJobs.emplace_back(nullptr);
+    m_LastStepNotify.push_back(NONE);
+    m_LastVisualizationGeneration.push_back(0);
+    m_StoppingSlots.push_back(false);
+
+    return m_Workers.size() - 1;
+}
+
+Glib::Threads::RecMutex &c_MainWindow::GetJobAccessGuard(const Gtk::ListStore::iterator &iter)
+{
+    size_t slot = GetJobSlot(iter);
+    if (slot != NONE)
+        return m_Workers[slot]->GetAccessGuard();
+    else
+        return m_NotRunningJobGuard;
+}
+
+Gtk::ListStore::iterator c_MainWindow::GetCurrentJobIter()
+{
+    if (GetJobsListFocusedRow())
+        return m_Jobs.data->get_iter(GetJobsListFocusedRow());
+    else
+        return Gtk::ListStore::iterator(nullptr);
+}
+
+size_t c_MainWindow::GetNumRunningJobs() const
+{
+    return std::count_if(m_RunningJobs.begin(), m_RunningJobs.end(),
+                         [](const Gtk::ListStore::iterator &it) { return (bool)it; });
+}
+
+size_t c_MainWindow::GetJobSlot(const Gtk::ListStore::iterator &iter) const
+{
+    if (iter)
+        for (size_t slot = 0; slot < m_RunningJobs.size(); slot++)
+            if (m_RunningJobs[slot] == iter)
+                return slot;
+
+    return NONE;
+}
+
+void c_MainWindow::UpdateVisualizedSlot()
+{
+    size_t slot = GetJobSlot(GetCurrentJobIter());
+
+    for (size_t i = 0; i < m_RunningJobs.size() && slot == NONE; i++)
+        if (m_RunningJobs[i])
+            slot = i;
+
+    if (slot != NONE && slot != m_VisualizedSlot)
+    {
+        m_VisualizedSlot = slot;
+        // Make sure the visualization and status bar get refreshed on the next notification
+        m_LastStepNotify[slot] = NONE;
+    }
+
+    // Only the visualized slot has to spend time on creating visualization images
+    for (size_t i = 0; i < m_Workers.size(); i++)
+        m_Workers[i]->SetVisualizationEnabled(m_ActVisualization->get_active() && i == m_VisualizedSlot);
 }
 
 bool c_MainWindow::SetAnchorsAutomatically(Job_t &job)
@@ -252,25 +414,56 @@ bool c_MainWindow::SetAnchorsAutomatically(Job_t &job)
 
 void c_MainWindow::OnPauseResumeProcessing()
 {
+    SetProcessingPaused(!m_ProcessingPaused);
 }
 
-void c_MainWindow::OnStopProcessing()
+void c_MainWindow::SetProcessingPaused(bool paused)
 {
-    Worker::AbortProcessing();
-    if (m_RunningJob)
+    m_ProcessingPaused = paused;
+
+    for (size_t slot = 0; slot < m_Workers.size(); slot++)
     {
-        (*m_RunningJob)[m_Jobs.columns.progress] = 0;
-        (*m_RunningJob)[m_Jobs.columns.percentageProgress] = 0;
-        (*m_RunningJob)[m_Jobs.columns.progressText] = "";
-        (*m_RunningJob)[m_Jobs.columns.state] = _("Waiting");
-        GetJobAt(m_RunningJob).imgSeq.Deactivate();
-
-        m_RunningJob = Gtk::ListStore::iterator(nullptr);
-        SetStatusBarText(_("Idle"));
+        // A stopping worker must not be paused (it would not finish)
+        if (m_StoppingSlots[slot])
+            continue;
+
+        m_Workers[slot]->SetPaused(paused);
+
+        if (m_RunningJobs[slot])
+            (*m_RunningJobs[slot])[m_Jobs.columns.state] = GetJobStateStr(*m_Workers[slot]);
     }
+
+    auto actPauseResume = m_ActionGroup->get_action(ActionName::pauseResumeProcessing);
+    actPauseResume->set_label(paused ? _("Resume processing") : _("Pause processing"));
+    actPauseResume->set_tooltip(paused ? _("Resume processing") : _("Pause processing"));
+
+    if (paused)
+        SetStatusBarText(_("Paused"));
+}
+
+void c_MainWindow::OnStopProcessing()
+{
     while (!m_JobsToProcess.empty())
         m_JobsToProcess.pop();
 
+    SetProcessingPaused(false);
+
+    // Workers finish asynchronously (see FinishJob()), so that the main loop is not blocked meanwhile
+    bool anyJobStopping = false;
+    for (size_t slot = 0; slot < m_RunningJobs.size(); slot++)
+    {
+        Gtk::ListStore::iterator &runningJob = m_RunningJobs[slot];
+        if (!runningJob)
+            continue;
+
+        m_Workers[slot]->RequestAbort();
+        m_StoppingSlots[slot] = true;
+        anyJobStopping = true;
+
+        (*runningJob)[m_Jobs.columns.state] = _("Stopping...");
+    }
+    SetStatusBarText(anyJobStopping ? _("Stopping...") : _("Idle"));
+
     UpdateActionsState();
     UpdateOutputViewZoomControlsState();
 }
@@ -318,6 +511,9 @@ bool c_MainWindow::SetAnchors(Job_t &job)
         // Modified anchors may modify video size and target framing
         // after image alignment, so old ref. points may be invalid
         job.refPoints.clear();
+
+        ReloadQualityData(job);
+        m_QualityWnd.Update();
     }
     job.imgSeq.Deactivate();
     Utils::SavePosSize(dlg, Configuration::AnchorSelectDlgPosSize);
@@ -332,12 +528,12 @@ void c_MainWindow::OnSetAnchors()
 
 static
 void GetOutputFormatFromFilter(Glib::ustring filterName,
-                               enum SKRY_output_format &outputFmt)
+                               OutputFormat &outputFmt)
 {
     for (auto &outfDescr: Utils::Vars::outputFormatDescription)
         if (filterName == outfDescr.name)
         {
-            outputFmt = outfDescr.skryOutpFmt;
+            outputFmt = outfDescr.outputFmt;
             return;
         }
 
@@ -346,7 +542,7 @@ void GetOutputFormatFromFilter(Glib::ustring filterName,
 
 void c_MainWindow::OnSaveStackedImage()
 {
-    SaveImage(GetCurrentJob().stackedImg, _("Save stacked image"), true);
+    SaveImage(*GetCurrentJob().stackedImg, _("Save stacked image"), true);
 }
 
 void c_MainWindow::OnSaveBestFragmentsImage()
@@ -371,7 +567,7 @@ void c_MainWindow::SaveImage(const libskry::c_Image &img, const Glib::ustring &d
         filter->set_name(filterName);
         dlg.add_filter(filter);
 
-        if (preselectHiBitDephtFilter && !hiBitDepthFilterSelected && OUTPUT_FMT_BITS_PER_CHANNEL[outFmt.skryOutpFmt] >= 16)
+        if (preselectHiBitDephtFilter && !hiBitDepthFilterSelected && OutputFmt::GetBitsPerChannel(outFmt.outputFmt) >= 16)
         {
             dlg.set_filter(filter);
             hiBitDepthFilterSelected = true;
@@ -381,13 +577,11 @@ void c_MainWindow::SaveImage(const libskry::c_Image &img, const Glib::ustring &d
     PrepareDialog(dlg);
     if (dlg.run() == Gtk::ResponseType::RESPONSE_OK)
     {
-        enum SKRY_output_format outpFmt;
+        OutputFormat outpFmt;
 
         GetOutputFormatFromFilter(dlg.get_filter()->get_name(), outpFmt);
-        enum SKRY_pixel_format pixFmt = Utils::FindMatchingFormat(outpFmt, NUM_CHANNELS[img.GetPixelFormat()]);
-        libskry::c_Image finalImg = libskry::c_Image::ConvertPixelFormat(img, pixFmt);
         enum SKRY_result result;
-        if (SKRY_SUCCESS != (result = finalImg.Save(dlg.get_filename().c_str(), outpFmt)))
+        if (SKRY_SUCCESS != (result = OutputFmt::ConvertAndSave(img, dlg.get_filename().c_str(), outpFmt)))
         {
             std::cout << "Failed to save image" << std::endl;
 
@@ -411,8 +605,23 @@ void c_MainWindow::OnSettings()
 
     PrepareDialog(dlg);
     if (Gtk::ResponseType::RESPONSE_OK == dlg.run())
+    {
         for (auto &selJob: m_Jobs.view.get_selection()->get_selected_rows())
-            dlg.ApplySettings(GetJobAt(selJob));
+        {
+            Gtk::ListStore::iterator iter = m_Jobs.data->get_iter(selJob);
+            Job_t &job = GetJobAt(iter);
+
+            // Quality data are valid only for the alignment settings they were obtained with
+            bool isIdle = (GetJobSlot(iter) == NONE);
+            std::string alignmentKey = (isIdle ? GetAlignmentKey(job) : "");
+
+            dlg.ApplySettings(job);
+
+            if (isIdle && GetAlignmentKey(job) != alignmentKey)
+                ReloadQualityData(job);
+        }
+        m_QualityWnd.Update();
+    }
 }
 
 /// The location to enforce all action-sensitivity conditions
@@ -423,17 +632,17 @@ void c_MainWindow::UpdateActionsState()
     for (auto &action: { ActionName::pauseResumeProcessing,
                          ActionName::stopProcessing })
     {
-        m_ActionGroup->get_action(action)->set_sensitive(Worker::IsRunning());
+        m_ActionGroup->get_action(action)->set_sensitive(GetNumRunningJobs() > 0);
     }
 
     for (auto &action: { ActionName::addFolders,
                          ActionName::addImages,
                          ActionName::addVideos })
     {
-        m_ActionGroup->get_action(action)->set_sensitive(!Worker::IsRunning());
+        m_ActionGroup->get_action(action)->set_sensitive(GetNumRunningJobs() == 0);
     }
 
-    m_ActionGroup->get_action(ActionName::startProcessing)->set_sensitive(numSelJobs > 0 && !Worker::IsRunning());
+    m_ActionGroup->get_action(ActionName::startProcessing)->set_sensitive(numSelJobs > 0 && GetNumRunningJobs() == 0);
 
     for (auto &action: { ActionName::setAnchors,
                          ActionName::selectFrames })
@@ -441,31 +650,44 @@ void c_MainWindow::UpdateActionsState()
         m_ActionGroup->get_action(action)->set_sensitive(
             numSelJobs == 1
             && GetJobsListFocusedRow()
-            && !(Worker::IsRunning() && m_RunningJob == m_Jobs.data->get_iter(GetJobsListFocusedRow()))
+            && GetJobSlot(GetCurrentJobIter()) == NONE
         );
     }
 
     m_ActionGroup->get_action(ActionName::settings)->set_sensitive(numSelJobs > 0);
-    m_ActionGroup->get_action(ActionName::removeJobs)->set_sensitive(numSelJobs > 0 && !Worker::IsRunning());
+    m_ActionGroup->get_action(ActionName::removeJobs)->set_sensitive(numSelJobs > 0 && GetNumRunningJobs() == 0);
 
     bool oneJobSelected = (numSelJobs == 1 && GetJobsListFocusedRow());
 
-    { LOCK();
+    { LOCK_JOB(GetCurrentJobIter());
         m_ActionGroup->get_action(ActionName::saveStackedImage)->set_sensitive(
             oneJobSelected && GetCurrentJob().stackedImg);
 
         m_ActionGroup->get_action(ActionName::saveBestFragmentsImage)->set_sensitive(
             oneJobSelected && GetCurrentJob().bestFragmentsImg);
+    }
 
-        m_ActionGroup->get_action(ActionName::exportQualityData)->set_sensitive(
-            oneJobSelected && !GetCurrentJob().quality.framesChrono.empty()
-        );
+    m_ActionGroup->get_action(ActionName::exportQualityData)->set_sensitive(
+        !GetSelectedJobsWithQualityData().empty()
+    );
+}
+
+std::vector<Gtk::ListStore::iterator> c_MainWindow::GetSelectedJobsWithQualityData()
+{
+    std::vector<Gtk::ListStore::iterator> jobs;
+    for (auto &selJob: m_Jobs.view.get_selection()->get_selected_rows())
+    {
+        Gtk::ListStore::iterator iter = m_Jobs.data->get_iter(selJob);
+        LOCK_JOB(iter);
+        if (IsQualityDataComplete(GetJobAt(iter)))
+            jobs.push_back(iter);
     }
+    return jobs;
 }
 
 void c_MainWindow::OnSelectFrames()
 {
-    c_FrameSelectDlg dlg(GetCurrentJob().imgSeq);
+    c_FrameSelectDlg dlg(GetCurrentJob().frameCacheId, GetCurrentJob().imgSeq);
     PrepareDialog(dlg);
     do
     {
@@ -484,8 +706,7 @@ void c_MainWindow::OnSelectFrames()
                 // after image alignment, so old ref. points may be invalid
                 job.refPoints.clear();
 
-                job.quality.framesChrono.clear();
-                job.quality.framesSorted.clear();
+                ReloadQualityData(job);
                 m_QualityWnd.Update();
 
                 break;
@@ -498,28 +719,6 @@ void c_MainWindow::OnSelectFrames()
     GetCurrentJob().imgSeq.Deactivate();
 }
 
-void c_MainWindow::SetDefaultSettings(Job_t &job)
-{
-    assert(job.imgSeq);
-
-    job.outputSaveMode = Utils::Const::Defaults::saveMode;
-    job.outputFmt = Utils::Const::Defaults::outputFmt;
-    job.alignmentMethod = Utils::Const::Defaults::alignmentMethod;
-    job.refPtAutoPlacementParams.spacing = Utils::Const::Defaults::referencePointSpacing;
-    job.refPtAutoPlacementParams.brightnessThreshold = Utils::Const::Defaults::placementBrightnessThreshold;
-    job.refPtAutoPlacementParams.structureScale = Utils::Const::Defaults::refPtStructureScale;
-    job.refPtAutoPlacementParams.structureThreshold = Utils::Const::Defaults::refPtStructureThreshold;
-    job.quality.criterion = Utils::Const::Defaults::qualityCriterion;
-    job.quality.threshold = Utils::Const::Defaults::qualityThreshold;
-    job.automaticRefPointsPlacement = true;
-    job.automaticAnchorPlacement = true;
-    job.cfaPattern = SKRY_CFA_NONE;
-    job.refPtBlockSize = Utils::Const::Defaults::refPtRefBlockSize;
-    job.refPtSearchRadius = Utils::Const::Defaults::refPtSearchRadius;
-    job.exportQualityData = false;
-    job.qualityDataReadyNotification = false;
-}
-
 void c_MainWindow::OnAddVideos()
 {
     Gtk::FileChooserDialog dlg(*this, _("Add video(s)"), Gtk::FileChooserAction::FILE_CHOOSER_ACTION_OPEN);
@@ -570,10 +769,12 @@ void c_MainWindow::OnAddVideos()
             }
             else
             {
+                LoadAlignmentCache(*newJob); // quality data of an earlier run, if still valid
                 auto row = *m_Jobs.data->append();
                 row[m_Jobs.columns.jobSource] = newJob->sourcePath;
                 row[m_Jobs.columns.state]     = _("Waiting");
                 row[m_Jobs.columns.progressText] = "";
+                row[m_Jobs.columns.outputErrors] = "";
                 row[m_Jobs.columns.job]       = newJob;
             }
         }
@@ -625,7 +826,7 @@ void c_MainWindow::InitActions()
     m_ActionGroup->add(Gtk::Action::create(ActionName::startProcessing, _("Start processing"),
                                            _("Start processing selected job(s)")),
                   sigc::mem_fun(*this, &c_MainWindow::OnStartProcessing));
-    m_ActionGroup->add(Gtk::Action::create(ActionName::pauseResumeProcessing, _("Pause processing")),
+    m_ActionGroup->add(Gtk::Action::create(ActionName::pauseResumeProcessing, _("Pause processing"), _("Pause processing")),
                   sigc::mem_fun(*this, &c_MainWindow::OnPauseResumeProcessing));
     m_ActionGroup->add(Gtk::Action::create(ActionName::stopProcessing, _("Stop processing"), _("Stop processing")),
                   sigc::mem_fun(*this, &c_MainWindow::OnStopProcessing));
@@ -672,6 +873,7 @@ void c_MainWindow::InitActions()
 
     "        <menu action='" + WidgetName::MenuProcessing + "'>"
     "            <menuitem action='" + ActionName::startProcessing + "' />"
+    "            <menuitem action='" + ActionName::pauseResumeProcessing + "' />"
     "            <menuitem action='" + ActionName::stopProcessing + "' />"
     "            <separator />"
     "            <menuitem action='" + ActionName::toggleVisualization + "' />"
@@ -696,6 +898,7 @@ void c_MainWindow::InitActions()
     "       <toolitem name='" + ActionName::removeJobs + "' action='" + ActionName::removeJobs + "'/>"
     "       <separator/>"
     "       <toolitem name='" + ActionName::startProcessing + "' action='" + ActionName::startProcessing + "'/>"
+    "       <toolitem name='" + ActionName::pauseResumeProcessing + "' action='" + ActionName::pauseResumeProcessing + "'/>"
     "       <toolitem name='" + ActionName::stopProcessing + "' action='" + ActionName::stopProcessing + "'/>"
     "       <separator/>"
     "       <toolitem action='" + ActionName::toggleVisualization + "'/>"
@@ -726,19 +929,23 @@ void c_MainWindow::OnToggleQualityWnd()
 void c_MainWindow::OnJobCursorChanged()
 {
     UpdateActionsState();
+    UpdateVisualizedSlot();
 
 
     if (GetJobsListFocusedRow())
     {
         m_QualityWnd.SetJob(GetCurrentJobPtr());
 
-        { LOCK();
+        { LOCK_JOB(GetCurrentJobIter());
 
             const Job_t &job = GetCurrentJob();
             switch(m_OutputView.GetOutputImgType())
             {
             case OutputImgType::Stack:
-                m_OutputView.SetImage(job.stackedImg);
+                if (job.stackedImg)
+                    m_OutputView.SetImage(*job.stackedImg);
+                else
+                    m_OutputView.RemoveImage();
                 break;
 
             case OutputImgType::BestFragments:
@@ -803,7 +1010,7 @@ bool c_MainWindow::OnJobBtnPressed(GdkEventButton *event)
 
 void c_MainWindow::OnToggleVisualization()
 {
-    Worker::SetVisualizationEnabled(m_ActVisualization->get_active());
+    UpdateVisualizedSlot();
     UpdateOutputViewZoomControlsState();
 
     if (m_ActVisualization->get_active())
@@ -818,7 +1025,7 @@ void c_MainWindow::UpdateOutputViewZoomControlsState()
     m_OutputView.SetZoomControlsEnabled(
             m_OutputView.GetOutputImgType() != OutputImgType::Visualization
             ||
-            Worker::IsRunning() && m_ActVisualization->get_active());
+            GetNumRunningJobs() > 0 && m_ActVisualization->get_active());
 }
 
 void c_MainWindow::SetStatusBarText(const Glib::ustring &text)
@@ -827,55 +1034,8 @@ void c_MainWindow::SetStatusBarText(const Glib::ustring &text)
     m_StatusBar.push(text);
 }
 
-void c_MainWindow::AutoSaveStack(const Job_t &job)
-{
-    assert(job.stackedImg);
-
-    enum SKRY_pixel_format pixFmt = Utils::FindMatchingFormat(job.outputFmt, NUM_CHANNELS[job.stackedImg.GetPixelFormat()]);
-    libskry::c_Image convImg = libskry::c_Image::ConvertPixelFormat(job.stackedImg, pixFmt);
-
-    std::string destDir = GetDestDir(job);
-
-    std::string destFName = (job.imgSeq.GetType() == SKRY_IMG_SEQ_IMAGE_FILES
-                                ? "stack"
-                                : Glib::path_get_basename(job.sourcePath) + "_stacked");
-    std::string destExt = Utils::GetOutputFormatDescr(job.outputFmt).defaultExtension;
-
-    unsigned replaceCounter = 0;
-    while (Glib::file_test(Glib::build_filename(destDir, destFName +
-                            (replaceCounter ? (std::string)Glib::ustring::format(replaceCounter) + destExt : destExt)),
-                           Glib::FileTest::FILE_TEST_EXISTS))
-    {
-        replaceCounter++;
-    }
-
-    std::string destPath = Glib::build_filename(destDir, destFName +
-                            (replaceCounter ? (std::string)Glib::ustring::format(replaceCounter) + destExt : destExt));
-    if (SKRY_SUCCESS != convImg.Save(destPath.c_str(), job.outputFmt))
-    {
-        std::cout << "Could not save stack as " << destPath << std::endl;
-    }
-}
-
-std::string c_MainWindow::GetDestDir(const Job_t &job) const
-{
-    if (job.outputSaveMode == Utils::Const::OutputSaveMode::SOURCE_PATH)
-    {
-        return (job.imgSeq.GetType() == SKRY_IMG_SEQ_IMAGE_FILES
-                ? job.sourcePath
-                : Glib::path_get_dirname(job.sourcePath));
-    }
-    else
-        return job.destDir;
-}
-
 void c_MainWindow::OnWorkerProgress()
 {
-    LOCK();
-
-    if (!m_RunningJob)
-        return; // an outdated notification, ignore
-
     // As of GTK 3.22 on Linux, something got broken in Glib::Dispatcher() - calling Gtk::Dialog::run() (to have the user
     // set the reference points manually) from OnWorkerProgress() causes a recursive entry into OnWorkerProgress() from
     // the new dialog's main loop.
@@ -883,45 +1043,45 @@ void c_MainWindow::OnWorkerProgress()
     if (m_HandlingManualRefPoints)
         return;
 
+    bool anyJobFinished = false;
+    size_t refPtSlot = NONE; ///< Slot waiting for manual placement of reference points
+
     // Update "Save stacked image", "Save best fragments composite image", "Export quality data"
     // actions' state
     UpdateActionsState();
 
-    if (m_RunningJob)
-    {
-        Job_t &job = GetJobAt(m_RunningJob);
-        if (job.qualityDataReadyNotification)
+    // A slot without a running job may have sent an outdated notification, ignore it
+    for (size_t slot = 0; slot < m_RunningJobs.size(); slot++)
+        if (m_RunningJobs[slot])
         {
-            job.qualityDataReadyNotification = false;
+            // Progress is read without the access guard, so that the worker is not stalled by updating the GUI
+            Worker::Progress_t progress = m_Workers[slot]->GetProgress();
 
-            m_QualityWnd.Update();
-            UpdateActionsState();
+            if (!m_StoppingSlots[slot])
+                UpdateJobProgress(slot, progress);
 
-            if (job.exportQualityData)
+            if (!progress.isRunning)
             {
-                std::string destDir = GetDestDir(job);
-                std::string destFName = "frame_quality";
-
-                // For video files, prepend with the source file name
-                if (job.imgSeq.GetType() != SKRY_IMG_SEQ_IMAGE_FILES)
-                    destFName = Glib::path_get_basename(job.sourcePath) + "_" + destFName;
-
-                std::string destPath = Glib::build_filename(destDir, destFName + ".txt");
-
-                ExportQualityData(destPath, job);
+                Glib::Threads::RecMutex::Lock lock(m_Workers[slot]->GetAccessGuard());
+                FinishJob(slot);
+                anyJobFinished = true;
             }
+            else if (refPtSlot == NONE && !m_StoppingSlots[slot] && m_Workers[slot]->IsWaitingForReferencePoints())
+                refPtSlot = slot;
         }
-    }
-
 
     if (GetJobsListFocusedRow())
-    {
+    { LOCK_JOB(GetCurrentJobIter());
+
         const Job_t &job = GetCurrentJob();
 
         switch (m_OutputView.GetOutputImgType())
         {
         case OutputImgType::Stack:
-            m_OutputView.SetImage(job.stackedImg);
+            if (job.stackedImg)
+                m_OutputView.SetImage(*job.stackedImg);
+            else
+                m_OutputView.RemoveImage();
             break;
 
         case OutputImgType::BestFragments:
@@ -930,96 +1090,340 @@ void c_MainWindow::OnWorkerProgress()
         }
     }
 
-    if (Worker::IsWaitingForReferencePoints())
+    if (anyJobFinished)
     {
-        m_HandlingManualRefPoints = true;
-        struct Job_t &job = GetJobAt(*m_RunningJob);
-        c_SelectPointsDlg dlg(Worker::GetBestQualityAlignedImage(), job.refPoints, { });
-        dlg.set_title(_("Set reference points"));
-        dlg.SetInfoText(_("Place reference points by left-clicking on the image. Avoid blank areas "
-                        "with little or no detail. Click Cancel to set points automatically."));
-        PrepareDialog(dlg);
-        Utils::RestorePosSize(Configuration::SelectRefPointsDlgPosSize, dlg);
-        auto response = dlg.run();
-        if (response == Gtk::ResponseType::RESPONSE_OK)
-            dlg.GetPoints(job.refPoints);
-        else
-            job.automaticRefPointsPlacement = true;
+        StartQueuedJobs();
+        if (GetNumRunningJobs() == 0)
+        {
+            if (m_ProcessingPaused)
+                SetProcessingPaused(false);
+            SetStatusBarText(_("Idle"));
+        }
 
-        Worker::NotifyReferencePointsSet();
-        Utils::SavePosSize(dlg, Configuration::SelectRefPointsDlgPosSize);
-        m_HandlingManualRefPoints = false;
+        UpdateActionsState();
+        UpdateOutputViewZoomControlsState();
     }
 
-    if (Worker::GetStep() != m_LastStepNotify)
+    // Done without holding any access guard, so that other running jobs are not stalled by the dialog
+    if (refPtSlot != NONE)
     {
-        if (Worker::IsVisualizationEnabled() && m_OutputView.GetOutputImgType() == OutputImgType::Visualization)
-            if (Worker::GetVisualizationImage())
-                m_OutputView.SetImage(Worker::GetVisualizationImage());
-
-        (*m_RunningJob)[m_Jobs.columns.state] = Worker::GetProcPhaseStr(Worker::GetPhase());
-        (*m_RunningJob)[m_Jobs.columns.progress] = Worker::GetStep();
-        (*m_RunningJob)[m_Jobs.columns.percentageProgress] =
-            100*Worker::GetStep() / GetJobAt(m_RunningJob).imgSeq.GetActiveImageCount();
-        (*m_RunningJob)[m_Jobs.columns.progressText] =
-            Glib::ustring::format(Worker::GetStep(), "/", GetJobAt(m_RunningJob).imgSeq.GetActiveImageCount());
-
-        SetStatusBarText((*m_RunningJob)[m_Jobs.columns.jobSource] + " \u2013 " +        // /u2013 = N-dash
-                        Worker::GetProcPhaseStr(Worker::GetPhase()) + ", " + _("step") +
-                         " " + (*m_RunningJob)[m_Jobs.columns.progressText]);
-
-        m_LastStepNotify = Worker::GetStep();
+        SetReferencePoints(refPtSlot);
+        // Notifications from other slots were ignored while the dialog was shown
+        OnWorkerProgress();
     }
-    if (!Worker::IsRunning())
+}
+
+void c_MainWindow::UpdateJobProgress(size_t slot, const Worker::Progress_t &progress)
+{
+    Gtk::ListStore::iterator &runningJob = m_RunningJobs[slot];
+    Job_t &job = GetJobAt(runningJob);
+
+    bool qualityDataReady, newQualityData;
+    std::shared_ptr<const std::vector<QualityExportData_t>> exportedData;
+    { LOCK_JOB(runningJob);
+        // Appending here (instead of in the worker thread) lets the quality graph read the data without locking
+        newQualityData = MergeStreamedQualityData(job);
+        qualityDataReady = job.qualityDataReadyNotification;
+        job.qualityDataReadyNotification = false;
+
+        if (qualityDataReady && job.exportQualityData)
+            exportedData = std::make_shared<const std::vector<QualityExportData_t>>(1, GetQualityExportData(job));
+    }
+
+    if (newQualityData || qualityDataReady)
+        m_QualityWnd.Update();
+
+    if (qualityDataReady)
     {
-        SetStatusBarText(_("Idle"));
+        UpdateActionsState();
 
-        (*m_RunningJob)[m_Jobs.columns.progress] = 0;
-        (*m_RunningJob)[m_Jobs.columns.percentageProgress] = 0;
-        (*m_RunningJob)[m_Jobs.columns.progressText] = "";
-        if (Worker::GetLastResult() == SKRY_SUCCESS ||
-            Worker::GetLastResult() == SKRY_LAST_STEP)
+        if (exportedData)
         {
-            (*m_RunningJob)[m_Jobs.columns.state] = _("Processed");
+            std::string destDir = GetDestDir(job);
+            std::string destFName = "frame_quality";
+
+            // For video files, prepend with the source file name
+            if (job.imgSeq.GetType() != SKRY_IMG_SEQ_IMAGE_FILES)
+                destFName = Glib::path_get_basename(job.sourcePath) + "_" + destFName;
+
+            bool binary = Configuration::BinaryQualityExport;
+            bool exportInactive = Configuration::ExportInactiveFramesQuality;
+            std::string destPath = Glib::build_filename(destDir, destFName + (binary ? BINARY_QUALITY_DATA_EXT : ".txt"));
+
+            // Written by the output writer, so that neither the GUI nor the job's worker waits for it
+            unsigned outputId = m_NextOutputId++;
+            m_PendingOutputs[outputId] = { Gtk::TreeRowReference(m_Jobs.data, m_Jobs.data->get_path(runningJob)),
+                                           OutputKind::QUALITY_DATA };
+            m_DeferredOutputs.push_back({ outputId,
+                                          [exportedData, destPath, binary, exportInactive]()
+                                          {
+                                              return ExportQualityData(destPath, *exportedData, binary, exportInactive)
+                                                     ? SKRY_SUCCESS : SKRY_CANNOT_CREATE_FILE;
+                                          },
+                                          destPath });
+            SubmitDeferredOutputs();
         }
-        else
-            (*m_RunningJob)[m_Jobs.columns.state] = Glib::ustring::compose(_("Error: %1"), Utils::GetErrorMsg(Worker::GetLastResult()));
+    }
 
-        Worker::WaitUntilFinished();
+    Worker::c_ProcessingContext &worker = *m_Workers[slot];
 
-        Job_t &job = GetJobAt(m_RunningJob);
-        job.imgSeq.Deactivate();
+    if (slot == m_VisualizedSlot
+        && progress.visualizationGeneration != m_LastVisualizationGeneration[slot]
+        && worker.IsVisualizationEnabled() && m_OutputView.GetOutputImgType() == OutputImgType::Visualization)
+    {
+        // Retrieving the image lets the worker capture the next one
+        auto visImg = worker.GetNewVisualizationImage();
+        if (visImg)
+            m_OutputView.SetImage(visImg);
+        m_LastVisualizationGeneration[slot] = progress.visualizationGeneration;
+    }
+
+    if (progress.step != m_LastStepNotify[slot])
+    {
+        (*runningJob)[m_Jobs.columns.state] = GetJobStateStr(worker);
+        (*runningJob)[m_Jobs.columns.progress] = progress.step;
+        (*runningJob)[m_Jobs.columns.percentageProgress] =
+            progress.total ? 100*progress.step / progress.total : 0;
+        Glib::ustring progressText = Glib::ustring::format(progress.step, "/", progress.total);
+        if (progress.remainingTime >= 0)
+            progressText += " (" + FormatDuration(progress.remainingTime) + ")";
+        (*runningJob)[m_Jobs.columns.progressText] = progressText;
+
+        if (slot == m_VisualizedSlot)
+        {
+            Glib::ustring statusText = (*runningJob)[m_Jobs.columns.jobSource] + " \u2013 " +        // /u2013 = N-dash
+                                       GetJobStateStr(worker) + ", " + _("step") +
+                                       " " + Glib::ustring::format(progress.step, "/", progress.total);
+
+            if (progress.framesPerSec > 0)
+                statusText += ", " + Glib::ustring::compose(_("%1 frames/s"),
+                                                            Glib::ustring::format(std::fixed, std::setprecision(1), progress.framesPerSec));
+            if (progress.remainingTime >= 0)
+                statusText += ", " + Glib::ustring::compose(_("remaining: %1"), FormatDuration(progress.remainingTime));
+
+            double queueRemainingTime = EstimateQueueRemainingTime();
+            if (queueRemainingTime >= 0 && (GetNumRunningJobs() > 1 || !m_JobsToProcess.empty()))
+                statusText += " " + Glib::ustring::compose(_("(all jobs: %1)"), FormatDuration(queueRemainingTime));
+
+            SetStatusBarText(statusText);
+        }
 
-        if (job.outputSaveMode != Utils::Const::OutputSaveMode::NONE && job.stackedImg)
-            AutoSaveStack(job);
+        m_LastStepNotify[slot] = progress.step;
+    }
+}
 
-        job.imgSeq.Deactivate();
+double c_MainWindow::EstimateQueueRemainingTime()
+{
+    double runningRemainingTime = 0;
+    double totalFramesPerSec = 0;
+    size_t numRunning = 0;
 
-        if (m_JobsToProcess.empty())
+    for (size_t slot = 0; slot < m_RunningJobs.size(); slot++)
+        if (m_RunningJobs[slot])
         {
-            m_RunningJob = Gtk::ListStore::iterator(nullptr);
+            Worker::Progress_t progress = m_Workers[slot]->GetProgress();
+            if (progress.remainingTime < 0)
+                return -1;
+
+            runningRemainingTime += progress.remainingTime;
+            totalFramesPerSec += progress.framesPerSec;
+            numRunning++;
         }
+
+    if (numRunning == 0 || totalFramesPerSec <= 0)
+        return -1;
+
+    // Queued jobs are assumed to be processed (in all phases) at the average rate of the running ones
+    double queuedFrames = 0;
+    std::queue<Gtk::TreeModel::Path> queued = m_JobsToProcess;
+    for (; !queued.empty(); queued.pop())
+        queuedFrames += ((size_t)Worker::ProcPhase::NUM_PHASES - 1)
+                        * GetJobAt(queued.front()).imgSeq.GetActiveImageCount();
+
+    // Running jobs share the processing time
+    return (runningRemainingTime + queuedFrames / (totalFramesPerSec / numRunning)) / numRunning;
+}
+
+void c_MainWindow::FinishJob(size_t slot)
+{
+    Gtk::ListStore::iterator &runningJob = m_RunningJobs[slot];
+    Worker::c_ProcessingContext &worker = *m_Workers[slot];
+
+    (*runningJob)[m_Jobs.columns.progress] = 0;
+    (*runningJob)[m_Jobs.columns.percentageProgress] = 0;
+    (*runningJob)[m_Jobs.columns.progressText] = "";
+
+    if (m_StoppingSlots[slot])
+    {
+        worker.WaitUntilFinished();
+        (*runningJob)[m_Jobs.columns.state] = _("Waiting");
+        std::shared_ptr<Job_t> job = GetJobPtrAt(runningJob);
+        job->imgSeq.Deactivate();
+
+        m_StoppingSlots[slot] = false;
+        runningJob = Gtk::ListStore::iterator(nullptr);
+        m_LastStepNotify[slot] = NONE;
+        RetainCheckpoint(job);
+        return;
+    }
+
+    // Errors of outputs written during processing (quality data export) are shown now
+    Glib::ustring outputErrors = (*runningJob)[m_Jobs.columns.outputErrors];
+    if (worker.GetLastResult() == SKRY_SUCCESS ||
+        worker.GetLastResult() == SKRY_LAST_STEP)
+    {
+        (*runningJob)[m_Jobs.columns.state] = (outputErrors.empty() ? _("Processed") : outputErrors);
+    }
+    else
+        (*runningJob)[m_Jobs.columns.state] = Glib::ustring::compose(_("Error: %1"), Utils::GetErrorMsg(worker.GetLastResult()))
+                                              + (outputErrors.empty() ? "" : "; " + outputErrors);
+
+    worker.WaitUntilFinished();
+
+    Job_t &job = GetJobAt(runningJob);
+    job.imgSeq.Deactivate();
+
+    if (job.outputSaveMode != Utils::Const::OutputSaveMode::NONE && job.stackedImg)
+    {
+        // Files still being written are not visible yet, so exclude their names explicitly
+        std::set<std::string> pendingPaths = m_OutputWriter.GetPendingPaths();
+        for (const DeferredOutput_t &deferred: m_DeferredOutputs)
+            pendingPaths.insert(deferred.destPath);
+
+        std::string destPath = GetAutoSaveStackPath(job, pendingPaths);
+        unsigned outputId = m_NextOutputId++;
+        m_PendingOutputs[outputId] = { Gtk::TreeRowReference(m_Jobs.data, m_Jobs.data->get_path(runningJob)),
+                                       OutputKind::STACK };
+        (*runningJob)[m_Jobs.columns.state] = _("Saving...");
+
+        // The writer shares the stacked image; if the job is processed again, it gets a new one
+        std::shared_ptr<const libskry::c_Image> img = job.stackedImg;
+        OutputFormat outputFmt = job.outputFmt;
+        m_DeferredOutputs.push_back({ outputId,
+                                      [img, outputFmt, destPath]() { return OutputFmt::ConvertAndSave(*img, destPath.c_str(), outputFmt); },
+                                      destPath });
+        SubmitDeferredOutputs();
+    }
+
+    std::shared_ptr<Job_t> finishedJob = GetJobPtrAt(runningJob);
+    runningJob = Gtk::ListStore::iterator(nullptr);
+    m_LastStepNotify[slot] = NONE;
+    RetainCheckpoint(finishedJob);
+}
+
+void c_MainWindow::RetainCheckpoint(const std::shared_ptr<Job_t> &job)
+{
+    m_JobsWithCheckpoint.remove_if([&job](const std::weak_ptr<Job_t> &j) { return j.expired() || j.lock() == job; });
+    if (!job->checkpoint)
+        return;
+
+    m_JobsWithCheckpoint.push_back(job);
+
+    auto it = m_JobsWithCheckpoint.begin();
+    while (m_JobsWithCheckpoint.size() > Utils::Const::MaxRetainedCheckpoints && it != m_JobsWithCheckpoint.end())
+    {
+        std::shared_ptr<Job_t> oldest = it->lock();
+
+        // A job being processed again uses its checkpoint; it will be registered anew once finished
+        bool isRunning = false;
+        for (const Gtk::ListStore::iterator &runningJob: m_RunningJobs)
+            if (runningJob && GetJobPtrAt(runningJob) == oldest)
+                isRunning = true;
+
+        if (isRunning)
+            ++it;
         else
         {
-            m_RunningJob = m_Jobs.data->get_iter(m_JobsToProcess.front());
-            m_JobsToProcess.pop();
-            Job_t &job = GetJobAt(m_RunningJob);
-            bool startNextJob = true;
-            if (job.anchors.empty() && !job.automaticAnchorPlacement)
-                if (!SetAnchors(job))
-                    startNextJob = false;
-
-            if (startNextJob)
-                Worker::StartProcessing(&job);
+            oldest->checkpoint.reset();
+            it = m_JobsWithCheckpoint.erase(it);
         }
+    }
+}
 
-        UpdateActionsState();
-        UpdateOutputViewZoomControlsState();
+void c_MainWindow::OnOutputWritten()
+{
+    for (const c_OutputWriter::Result_t &output: m_OutputWriter.GetResults())
+    {
+        if (output.result != SKRY_SUCCESS)
+            std::cout << "Could not save " << output.destPath << std::endl;
+
+        auto pending = m_PendingOutputs.find(output.id);
+        if (pending == m_PendingOutputs.end())
+            continue;
+
+        // Jobs started again in the meantime have had their row references reset (see StartQueuedJobs())
+        if (pending->second.row.is_valid())
+        {
+            Gtk::ListStore::iterator iter = m_Jobs.data->get_iter(pending->second.row.get_path());
+            Gtk::TreeModel::Row row = *iter;
+
+            Glib::ustring errors = row[m_Jobs.columns.outputErrors];
+            if (output.result != SKRY_SUCCESS)
+            {
+                Glib::ustring error = Glib::ustring::compose(_("Error saving %1: %2"),
+                                                             output.destPath, Utils::GetErrorMsg(output.result));
+                errors = (errors.empty() ? error : errors + "; " + error);
+                row[m_Jobs.columns.outputErrors] = errors;
+            }
+
+            // For a running job, the errors are shown once it finishes (see FinishJob()); a job whose stack
+            // is still being written shows "Saving..." until then
+            bool isStackPending = false;
+            for (auto &other: m_PendingOutputs)
+                if (other.first != output.id && other.second.kind == OutputKind::STACK
+                    && other.second.row.is_valid() && other.second.row.get_path() == pending->second.row.get_path())
+                {
+                    isStackPending = true;
+                }
+
+            if (pending->second.kind == OutputKind::STACK)
+                row[m_Jobs.columns.state] = (errors.empty() ? _("Processed") : errors);
+            else if (output.result != SKRY_SUCCESS && GetJobSlot(iter) == NONE && !isStackPending)
+                row[m_Jobs.columns.state] = errors;
+        }
+
+        m_PendingOutputs.erase(pending);
     }
+
+    SubmitDeferredOutputs();
+}
+
+void c_MainWindow::SubmitDeferredOutputs()
+{
+    while (!m_DeferredOutputs.empty())
+    {
+        const DeferredOutput_t &output = m_DeferredOutputs.front();
+        if (!m_OutputWriter.Enqueue(output.id, output.write, output.destPath))
+            break; // the queue is full; retried after the next output has been written
+
+        m_DeferredOutputs.pop_front();
+    }
+}
+
+void c_MainWindow::SetReferencePoints(size_t slot)
+{
+    m_HandlingManualRefPoints = true;
+
+    // The worker thread is waiting for us, no need to lock the access guard
+    struct Job_t &job = GetJobAt(m_RunningJobs[slot]);
+    c_SelectPointsDlg dlg(m_Workers[slot]->GetBestQualityAlignedImage(), job.refPoints, { });
+    dlg.set_title(_("Set reference points"));
+    dlg.SetInfoText(_("Place reference points by left-clicking on the image. Avoid blank areas "
+                    "with little or no detail. Click Cancel to set points automatically."));
+    PrepareDialog(dlg);
+    Utils::RestorePosSize(Configuration::SelectRefPointsDlgPosSize, dlg);
+    auto response = dlg.run();
+    if (response == Gtk::ResponseType::RESPONSE_OK)
+        dlg.GetPoints(job.refPoints);
+    else
+        job.automaticRefPointsPlacement = true;
+
+    m_Workers[slot]->NotifyReferencePointsSet();
+    Utils::SavePosSize(dlg, Configuration::SelectRefPointsDlgPosSize);
+    m_HandlingManualRefPoints = false;
 }
 
 c_MainWindow::c_MainWindow()
-    : m_LastStepNotify(NONE)
 {
     set_title("Stackistry");
     set_border_width(Utils::Const::widgetPaddingInPixels);
@@ -1032,7 +1436,7 @@ c_MainWindow::c_MainWindow()
         maximize();
 
     signal_delete_event().connect(sigc::mem_fun(*this, &c_MainWindow::OnDelete));
-    Worker::ConnectProgressSignal(sigc::mem_fun(*this, &c_MainWindow::OnWorkerProgress));
+    m_OutputWriter.ConnectWrittenSignal(sigc::mem_fun(*this, &c_MainWindow::OnOutputWritten));
 }
 
 void c_MainWindow::SetToolbarIcons()
@@ -1072,6 +1476,10 @@ void c_MainWindow::SetToolbarIcons()
     iconImg->show();
     GetToolButton(ActionName::startProcessing)->set_icon_widget(*iconImg);
 
+    iconImg = Gtk::manage(new Gtk::Image(Utils::LoadIconFromFile("pause.svg", iconSizeInPx, iconSizeInPx)));
+    iconImg->show();
+    GetToolButton(ActionName::pauseResumeProcessing)->set_icon_widget(*iconImg);
+
     iconImg = Gtk::manage(new Gtk::Image(Utils::LoadIconFromFile("qual_graph.svg", iconSizeInPx, iconSizeInPx)));
     iconImg->show();
     GetToolButton(ActionName::toggleQualityWnd)->set_icon_widget(*iconImg);
@@ -1105,8 +1513,9 @@ void c_MainWindow::InitControls()
     m_OutputView.signal_ZoomChanged().connect(sigc::slot<void, int>(
         [this](int zoomPercentVal)
             {
-                if (Worker::IsRunning() && m_OutputView.GetOutputImgType() == OutputImgType::Visualization)
-                    Worker::SetZoomFactor(zoomPercentVal / 100.0, m_OutputView.GetInterpolationMethod());
+                if (GetNumRunningJobs() > 0 && m_OutputView.GetOutputImgType() == OutputImgType::Visualization)
+                    for (auto &worker: m_Workers)
+                        worker->SetZoomFactor(zoomPercentVal / 100.0, m_OutputView.GetInterpolationMethod());
             }
     ));
     m_OutputView.signal_OutputImgTypeChanged().connect(sigc::mem_fun(*this, &c_MainWindow::OnOutputImgTypeChanged));
@@ -1141,6 +1550,19 @@ c_MainWindow::~c_MainWindow()
 
 bool c_MainWindow::OnDelete(GdkEventAny *event)
 {
+    // Checkpoints (Job_t::checkpoint) are kept in memory only, so nothing of the running jobs survives exiting
+    size_t numRunning = std::count_if(m_RunningJobs.begin(), m_RunningJobs.end(),
+                                      [](const Gtk::ListStore::iterator &job) { return (bool)job; });
+    if (numRunning > 0)
+    {
+        Gtk::MessageDialog msg(*this,
+                               Glib::ustring::compose(_("Processing of %1 job(s) is in progress and will be lost. Quit anyway?"), numRunning),
+                               false, Gtk::MessageType::MESSAGE_QUESTION, Gtk::ButtonsType::BUTTONS_YES_NO, true);
+        msg.set_title(_("Quit"));
+        if (msg.run() != Gtk::ResponseType::RESPONSE_YES)
+            return true; // Do not close
+    }
+
     Gdk::Rectangle posSize;
     get_position(posSize.gobj()->x, posSize.gobj()->y);
     get_size(posSize.gobj()->width, posSize.gobj()->height);
@@ -1179,6 +1601,8 @@ void c_MainWindow::OnPreferences()
         toolbar->set_icon_size(Configuration::GetToolIconSize());
         SetToolbarIcons();
 
+        FrameCache::SetLimits(Configuration::FrameCacheSizeMB << 20, Configuration::CompactFrameCache);
+
         if (dlg.GetUILanguage() != std::string(Configuration::UILanguage))
         {
             ShowMsg(*this, _("Information"), _("You have to restart Stackistry for the changes to take effect."),
@@ -1200,7 +1624,23 @@ void c_MainWindow::Finalize()
     Configuration::MainWndPanedPos = m_MainPaned.get_position();
     Utils::SavePosSize(m_QualityWnd, Configuration::QualityWndPosSize);
 
-    Worker::AbortProcessing(); //TODO: show message? status bar text? while waiting
+    m_FlatFieldWnd.Finalize();
+
+    // Let all workers finish simultaneously
+    for (auto &worker: m_Workers)
+        worker->RequestAbort();
+    for (auto &worker: m_Workers)
+        worker->AbortProcessing(); //TODO: show message? status bar text? while waiting
+
+    // Stacks of finished jobs have to be written before libskry is deinitialized
+    while (true)
+    {
+        m_OutputWriter.Flush();
+        bool allSubmitted = m_DeferredOutputs.empty();
+        OnOutputWritten(); // reports the results and submits deferred outputs
+        if (allSubmitted)
+            break;
+    }
 }
 
 void c_MainWindow::OnSelectionChanged()
@@ -1213,6 +1653,7 @@ void c_MainWindow::OnRemoveJobs()
     auto selRows = m_Jobs.view.get_selection()->get_selected_rows();
     for (auto job = selRows.rbegin(); job != selRows.rend(); job++)
     {
+        FrameCache::Invalidate(GetJobAt(m_Jobs.data->get_iter(*job)).frameCacheId);
         m_Jobs.data->erase(m_Jobs.data->get_iter(*job));
     }
 }
@@ -1233,9 +1674,17 @@ void c_MainWindow::OnCreateFlatField()
     fltAvi->set_name("AVI (*.avi)");
     dlgOpen.add_filter(fltAvi);
 
+    Gtk::SpinButton frameStep;
+    frameStep.set_adjustment(Gtk::Adjustment::create(1, 1, 1000, 1, 10, 0));
+    frameStep.set_tooltip_text(_("Use only every N-th frame to create the flat-field faster; 1 uses all frames"));
+    dlgOpen.set_extra_widget(*Utils::PackIntoBox<Gtk::HBox>(
+            { Gtk::manage(new Gtk::Label(_("Use every N-th frame:"))),
+              &frameStep }));
+
     PrepareDialog(dlgOpen);
     if (Gtk::ResponseType::RESPONSE_OK == dlgOpen.run())
     {
+        // Check the video can be opened before asking for the destination
         enum SKRY_result result;
         libskry::c_ImageSequence imgSeq = libskry::c_ImageSequence::InitVideoFile(dlgOpen.get_filename().c_str(), &result);
         if (!imgSeq)
@@ -1247,21 +1696,15 @@ void c_MainWindow::OnCreateFlatField()
             return;
         }
 
-        libskry::c_Image flatField = imgSeq.CreateFlatField(&result);
-        if (!flatField)
-        {
-            ShowMsg(dlgOpen, _("Error"),
-                    Glib::ustring::compose(_("Failed to create flat-field:\n%1"),
-                                     Utils::GetErrorMsg(result)),
-                    Gtk::MessageType::MESSAGE_ERROR);
-            return;
-        }
-
         Gtk::FileChooserDialog dlgSave(_("Save flat-field"), Gtk::FileChooserAction::FILE_CHOOSER_ACTION_SAVE);
         dlgSave.add_button(_("OK"), Gtk::ResponseType::RESPONSE_OK);
         dlgSave.add_button(_("Cancel"), Gtk::ResponseType::RESPONSE_CANCEL);
         for (Utils::Vars::OutputFormatDescr_t &outFmt: Utils::Vars::outputFormatDescription)
         {
+            // The flat-field will be loaded by libskry, which does not read the additional formats
+            if (!OutputFmt::IsNative(outFmt.outputFmt))
+                continue;
+
             auto filter = Gtk::FileFilter::create();
             Glib::ustring filterName = outFmt.name;
             for (auto &pattern: outFmt.patterns)
@@ -1275,18 +1718,10 @@ void c_MainWindow::OnCreateFlatField()
         PrepareDialog(dlgSave);
         if (dlgSave.run() == Gtk::ResponseType::RESPONSE_OK)
         {
-            enum SKRY_output_format outpFmt;
+            OutputFormat outpFmt;
             GetOutputFormatFromFilter(dlgSave.get_filter()->get_name(), outpFmt);
-            enum SKRY_pixel_format pixFmt = Utils::FindMatchingFormat(outpFmt, 1);
-            libskry::c_Image finalImg = libskry::c_Image::ConvertPixelFormat(flatField, pixFmt);
-            if (SKRY_SUCCESS != (result = finalImg.Save(dlgSave.get_filename().c_str(), outpFmt)))
-            {
-                ShowMsg(dlgSave, _("Error"),
-                        Glib::ustring::compose(_("Error saving %1:\n%2"),
-                                         dlgSave.get_filename().c_str(),
-                                         Utils::GetErrorMsg(result)),
-                        Gtk::MessageType::MESSAGE_ERROR);
-            }
+            m_FlatFieldWnd.AddTask(dlgOpen.get_filename(), frameStep.get_value_as_int(),
+                                   dlgSave.get_filename(), outpFmt);
         }
     }
 }
@@ -1325,49 +1760,186 @@ void c_MainWindow::OnAbout()
     msg.run();
 }
 
-/// Returns 'false' on failure
-bool c_MainWindow::ExportQualityData(const std::string &fileName, const Job_t &job) const
+/// Calls 'func' for each frame to be exported, passing its absolute index and its index among active frames (or -1 if inactive)
+template<typename F>
+static void ForEachExportedFrame(const QualityExportData_t &job, bool exportInactive, F func)
 {
-    bool success = false;
-
-    std::ofstream file(fileName.c_str());
-    if (!file.fail())
+    size_t activeImgIdx = 0;
+    for (size_t i = 0; i < job.imgActiveFlags.size(); i++)
     {
-        assert(!job.quality.framesChrono.empty());
+        if (job.imgActiveFlags[i])
+            func(i, (ptrdiff_t)activeImgIdx++);
+        else if (exportInactive)
+            func(i, (ptrdiff_t)-1);
+    }
+}
 
-        file << "Stackistry " << VERSION_MAJOR << "." << VERSION_MINOR << "." << VERSION_SUBMINOR << "\n"
-             << "Normalized frame quality of \"" << job.sourcePath << "\"\n\n"
-             << "Frame;Active frame;Quality\n";
+/// Returns the function normalizing the job's frame quality to [0; 1]
+/** If all frames have the same quality, it is normalized to 1. */
+static std::function<double(SKRY_quality_t)> GetQualityNormalization(const QualityExportData_t &job)
+{
+    if (job.framesChrono.empty())
+        return [](SKRY_quality_t) { return 1.0; };
 
-        auto minmaxQuality = std::minmax_element(job.quality.framesChrono.begin(),
-                                                 job.quality.framesChrono.end());
+    auto minmaxQuality = std::minmax_element(job.framesChrono.begin(),
+                                             job.framesChrono.end());
+    SKRY_quality_t minQuality = *minmaxQuality.first;
+    double range = *minmaxQuality.second - *minmaxQuality.first;
+    if (range == 0)
+        return [](SKRY_quality_t) { return 1.0; };
 
-        double range = *minmaxQuality.second - *minmaxQuality.first;
+    return [minQuality, range](SKRY_quality_t quality) { return (quality - minQuality) / range; };
+}
 
-        const uint8_t *imgIsActive = job.imgSeq.GetImgActiveFlags();
-        bool exportInactive = Configuration::ExportInactiveFramesQuality;
+static void WriteQualityDataText(std::ostream &file, const QualityExportData_t &job, bool exportInactive)
+{
+    file << "Normalized frame quality of \"" << job.sourcePath << "\"\n\n"
+         << "Frame;Active frame;Quality\n";
 
-        size_t activeImgIdx = 0;
-        for (size_t i = 0; i < job.imgSeq.GetImageCount(); i++)
+    auto normalize = GetQualityNormalization(job);
+    ForEachExportedFrame(job, exportInactive,
+        [&](size_t frameIdx, ptrdiff_t activeIdx)
         {
-            if (imgIsActive[i] || exportInactive)
-            {
-                file << i << ";";
+            file << frameIdx << ";";
+            if (activeIdx >= 0)
+                file << activeIdx << ";" << normalize(job.framesChrono[activeIdx]) << "\n";
+            else
+                file << "-1;0\n";
+        });
+}
 
-                if (imgIsActive[i])
-                {
-                    file << activeImgIdx << ";" << (job.quality.framesChrono[activeImgIdx] - *minmaxQuality.first) / range << "\n";
-                    activeImgIdx++;
-                }
-                else if (exportInactive)
-                    file << "-1;0\n";
+template<typename T>
+static void AppendLittleEndian(std::vector<char> &buf, T value)
+{
+    for (size_t i = 0; i < sizeof(T); i++)
+        buf.push_back((char)(((uint64_t)value >> (8 * i)) & 0xFF));
+}
+
+static void AppendLittleEndian(std::vector<char> &buf, float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    AppendLittleEndian<uint32_t>(buf, bits);
+}
+
+template<typename T>
+static void WriteLittleEndian(std::ostream &file, T value)
+{
+    std::vector<char> bytes;
+    AppendLittleEndian(bytes, value);
+    file.write(bytes.data(), bytes.size());
+}
+
+/// Number of values of a column of the binary quality data file encoded at a time before writing them
+const size_t QUALITY_EXPORT_CHUNK_SIZE = 1 << 14;
+
+/// Writes a column of the binary quality data file (see ExportQualityData()) in chunks of QUALITY_EXPORT_CHUNK_SIZE values
+/** 'getValue' receives the same arguments as the function passed to ForEachExportedFrame() and returns the column's value. */
+template<typename T, typename F>
+static void WriteQualityDataColumn(std::ostream &file, const QualityExportData_t &job, bool exportInactive, F getValue)
+{
+    std::vector<char> chunk;
+    chunk.reserve(QUALITY_EXPORT_CHUNK_SIZE * sizeof(T));
+
+    ForEachExportedFrame(job, exportInactive,
+        [&](size_t frameIdx, ptrdiff_t activeIdx)
+        {
+            AppendLittleEndian(chunk, (T)getValue(frameIdx, activeIdx));
+            if (chunk.size() >= QUALITY_EXPORT_CHUNK_SIZE * sizeof(T))
+            {
+                file.write(chunk.data(), chunk.size());
+                chunk.clear();
             }
-        }
+        });
+
+    file.write(chunk.data(), chunk.size());
+}
+
+/// Writes a job's section of the binary quality data file (see ExportQualityData())
+static void WriteQualityDataBinary(std::ostream &file, const QualityExportData_t &job, bool exportInactive)
+{
+    WriteLittleEndian<uint32_t>(file, job.sourcePath.length());
+    file.write(job.sourcePath.data(), job.sourcePath.length());
+
+    uint32_t numRecords = 0;
+    ForEachExportedFrame(job, exportInactive, [&numRecords](size_t, ptrdiff_t) { numRecords++; });
+    WriteLittleEndian<uint32_t>(file, numRecords);
+
+    // Columns are written one after another
+    WriteQualityDataColumn<uint32_t>(file, job, exportInactive,
+        [](size_t frameIdx, ptrdiff_t) { return frameIdx; });
+
+    WriteQualityDataColumn<uint8_t>(file, job, exportInactive,
+        [](size_t, ptrdiff_t activeIdx) { return activeIdx >= 0 ? 1 : 0; });
+
+    auto normalize = GetQualityNormalization(job);
+    WriteQualityDataColumn<float>(file, job, exportInactive,
+        [&](size_t, ptrdiff_t activeIdx)
+        {
+            return activeIdx >= 0 ? (float)normalize(job.framesChrono[activeIdx]) : 0.0f;
+        });
 
-        success = !file.fail();
+    for (int coord = 0; coord < 2; coord++)
+        WriteQualityDataColumn<uint32_t>(file, job, exportInactive,
+            [&](size_t, ptrdiff_t activeIdx)
+            {
+                int32_t offset = 0;
+                if (activeIdx >= 0 && (size_t)activeIdx < job.imgOffsets.size())
+                    offset = (coord == 0 ? job.imgOffsets[activeIdx].x : job.imgOffsets[activeIdx].y);
+                return (uint32_t)offset;
+            });
+}
+
+/** Binary format (all values little-endian):
+
+        char[8]    "SKQUALTY"
+        uint32     format version (1)
+        uint32     number of jobs
+
+    Then for each job:
+
+        uint32     source path length, followed by the path (UTF-8, not terminated)
+        uint32     number of records N
+
+    followed by columns of N values each:
+
+        uint32     absolute frame index
+        uint8      1 if frame is active, 0 otherwise
+        float32    normalized quality (0 for inactive frames)
+        int32      image offset X after alignment (0 for inactive frames)
+        int32      image offset Y after alignment (0 for inactive frames)
+
+    Does not access any data shared with other threads (may be called by the output writer).
+    Returns 'false' on failure. */
+static bool ExportQualityData(const std::string &fileName, const std::vector<QualityExportData_t> &jobs,
+                              bool binary, bool exportInactive)
+{
+    std::ofstream file(fileName.c_str(), binary ? std::ios_base::out | std::ios_base::binary : std::ios_base::out);
+    if (file.fail())
+        return false;
+
+    if (binary)
+    {
+        file.write("SKQUALTY", 8);
+        WriteLittleEndian<uint32_t>(file, 1);
+        WriteLittleEndian<uint32_t>(file, jobs.size());
+    }
+    else
+        file << "Stackistry " << VERSION_MAJOR << "." << VERSION_MINOR << "." << VERSION_SUBMINOR << "\n";
+
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        if (binary)
+            WriteQualityDataBinary(file, jobs[i], exportInactive);
+        else
+        {
+            if (i > 0)
+                file << "\n";
+            WriteQualityDataText(file, jobs[i], exportInactive);
+        }
     }
 
-    return success;
+    return !file.fail();
 }
 
 void c_MainWindow::OnExportQualityData()
@@ -1387,13 +1959,35 @@ void c_MainWindow::OnExportQualityData()
     dlg.add_filter(fltTxt);
     dlg.set_filter(fltTxt);
 
+    auto fltBin = Gtk::FileFilter::create();
+    fltBin->add_pattern(std::string("*") + BINARY_QUALITY_DATA_EXT);
+    fltBin->set_name(Glib::ustring::compose(_("Binary (*%1)"), BINARY_QUALITY_DATA_EXT));
+    dlg.add_filter(fltBin);
+
     PrepareDialog(dlg);
     if (dlg.run() == Gtk::ResponseType::RESPONSE_OK)
     {
         Glib::ustring errorMsg = Glib::ustring::compose(_("Failed to export the quality data as %1."),
                                                         dlg.get_filename().c_str());
 
-        if (!ExportQualityData(dlg.get_filename(), GetCurrentJob()))
+        std::string fileName = dlg.get_filename();
+        std::string binaryExt = BINARY_QUALITY_DATA_EXT;
+        bool binary = (dlg.get_filter() == fltBin
+                       || fileName.length() >= binaryExt.length()
+                          && fileName.compare(fileName.length() - binaryExt.length(), binaryExt.length(), binaryExt) == 0);
+
+        // Each job is locked only while its data is copied; a job whose processing
+        // has been restarted in the meantime is skipped
+        std::vector<QualityExportData_t> exportedData;
+        for (const Gtk::ListStore::iterator &iter: GetSelectedJobsWithQualityData())
+        {
+            LOCK_JOB(iter);
+            if (IsQualityDataComplete(GetJobAt(iter)))
+                exportedData.push_back(GetQualityExportData(GetJobAt(iter)));
+        }
+
+        // Data of all selected jobs is exported to a single file
+        if (!ExportQualityData(fileName, exportedData, binary, Configuration::ExportInactiveFramesQuality))
         {
             ShowMsg(*this, _("Error"),
                     Glib::ustring::compose(errorMsg, dlg.get_filename()),
@@ -1410,15 +2004,20 @@ void c_MainWindow::OnOutputImgTypeChanged()
     {
     case OutputImgType::Visualization:
         {
-            m_OutputView.SetImage(Worker::GetVisualizationImage(), false);
-            auto prevZoom = Worker::GetZoomFactor();
-            m_OutputView.SetZoom(std::get<0>(prevZoom), std::get<1>(prevZoom));
+            if (m_VisualizedSlot != NONE)
+            {
+                m_OutputView.SetImage(m_Workers[m_VisualizedSlot]->GetVisualizationImage(), false);
+                auto prevZoom = m_Workers[m_VisualizedSlot]->GetZoomFactor();
+                m_OutputView.SetZoom(std::get<0>(prevZoom), std::get<1>(prevZoom));
+            }
+            else
+                m_OutputView.SetImage(Cairo::RefPtr<Cairo::ImageSurface>(nullptr), false);
         }
         break;
 
     case OutputImgType::Stack:
-        if (GetJobsListFocusedRow())
-            m_OutputView.SetImage(GetCurrentJob().stackedImg);
+        if (GetJobsListFocusedRow() && GetCurrentJob().stackedImg)
+            m_OutputView.SetImage(*GetCurrentJob().stackedImg);
         else
             m_OutputView.RemoveImage();
         break;
@@ -26,8 +26,12 @@ File description:
 
 #include <climits>
 #include <cstddef>
+#include <deque>
+#include <list>
+#include <map>
 #include <memory>
 #include <queue>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -40,15 +44,19 @@ File description:
 #include <gtkmm/image.h>
 #include <gtkmm/paned.h>
 #include <gtkmm/scrolledwindow.h>
+#include <gtkmm/treerowreference.h>
 #include <gtkmm/toggleaction.h>
 #include <gtkmm/uimanager.h>
 #include <gtkmm/window.h>
 #include <gtkmm/statusbar.h>
 #include <skry/skry_cpp.hpp>
 
+#include "flat_field_wnd.h"
 #include "job.h"
 #include "output_view.h"
+#include "output_writer.h"
 #include "quality_wnd.h"
+#include "worker.h"
 
 
 const size_t NONE = SIZE_MAX;
@@ -70,6 +78,7 @@ private:
     Glib::RefPtr<Gtk::ToggleAction> m_ActVisualization;
     Glib::RefPtr<Gtk::ToggleAction> m_ActQualityWnd;
     c_QualityWindow m_QualityWnd;
+    c_FlatFieldWindow m_FlatFieldWnd;
 
     class c_JobsListModelColumns: public Gtk::TreeModelColumnRecord
     {
@@ -79,6 +88,8 @@ private:
         Gtk::TreeModelColumn<size_t> progress;
         Gtk::TreeModelColumn<unsigned> percentageProgress;
         Gtk::TreeModelColumn<Glib::ustring> progressText;
+        /// Errors of writing the job's outputs since it was last started (not displayed; see OnOutputWritten())
+        Gtk::TreeModelColumn<Glib::ustring> outputErrors;
 
         // Another owner of the shared pointer can be 'm_QualityWnd'
         Gtk::TreeModelColumn<std::shared_ptr<Job_t>> job;
@@ -90,6 +101,7 @@ private:
             add(progress);
             add(percentageProgress);
             add(progressText);
+            add(outputErrors);
             add(job);
         }
     };
@@ -101,16 +113,68 @@ private:
         Gtk::TreeView                view;
     } m_Jobs;
 
-    /// Last step for which a notification has been received from worker; may equal NONE
-    size_t m_LastStepNotify;
+    /// Processing contexts used to run jobs simultaneously; created as needed
+    std::vector<std::unique_ptr<Worker::c_ProcessingContext>> m_Workers;
 
-    Gtk::ListStore::iterator m_RunningJob; ///< May be null
+    /// Element [i]: job processed by m_Workers[i]; may be null
+    std::vector<Gtk::ListStore::iterator> m_RunningJobs;
+
+    /// Element [i]: last step for which a notification has been received from m_Workers[i]; may equal NONE
+    std::vector<size_t> m_LastStepNotify;
+
+    /// Element [i]: visualization generation of the last image retrieved from m_Workers[i]
+    std::vector<unsigned> m_LastVisualizationGeneration;
+
+    /// Element [i]: 'true' if m_Workers[i] has been requested to abort and has not finished yet
+    std::vector<bool> m_StoppingSlots;
+
+    /// Index of the worker whose visualization (and progress in the status bar) is shown; may equal NONE
+    size_t m_VisualizedSlot = NONE;
+
+    /// Used by LOCK_JOB() for jobs not being processed (they are not accessed by worker threads)
+    Glib::Threads::RecMutex m_NotRunningJobGuard;
 
     std::queue<Gtk::TreeModel::Path> m_JobsToProcess;
 
+    /// True if StartQueuedJobs() is in progress
+    bool m_StartingJobs = false;
+
     /// True if handling of manual reference point selection is in progress
     bool m_HandlingManualRefPoints = false;
 
+    /// True if processing of all running jobs has been paused by the user
+    bool m_ProcessingPaused = false;
+
+    /// Saves stacked images of finished jobs in the background
+    c_OutputWriter m_OutputWriter{Utils::Const::MaxQueuedOutputs};
+
+    enum class OutputKind { STACK, QUALITY_DATA };
+
+    struct PendingOutput_t
+    {
+        /// Row of the job; reset if the job is started again before its output is written
+        Gtk::TreeRowReference row;
+        OutputKind kind;
+    };
+
+    /// Outputs of jobs being written (stacked images, quality data); key: output ID passed to c_OutputWriter::Enqueue()
+    std::map<unsigned, PendingOutput_t> m_PendingOutputs;
+
+    struct DeferredOutput_t
+    {
+        unsigned id;
+        c_OutputWriter::WriteFunc_t write;
+        std::string destPath;
+    };
+
+    /// Outputs not accepted by 'm_OutputWriter' yet, because its queue was full; in order of jobs' completion
+    std::deque<DeferredOutput_t> m_DeferredOutputs;
+
+    unsigned m_NextOutputId = 0;
+
+    /// Jobs which have a checkpoint (Job_t::checkpoint), least recently finished first
+    std::list<std::weak_ptr<Job_t>> m_JobsWithCheckpoint;
+
 
     // Signal handlers -------------
     void OnButtonClicked();
@@ -119,9 +183,12 @@ private:
     void OnAddFolders();
     void OnAddImageSeries();
     void OnWorkerProgress();
+    void OnOutputWritten();
     void OnStartProcessing();
     void OnStopProcessing();
     void OnPauseResumeProcessing();
+    /// Pauses or resumes all running jobs and updates the related controls
+    void SetProcessingPaused(bool paused);
     void OnSetAnchors();
     void OnSaveStackedImage();
     void OnSaveBestFragmentsImage();
@@ -149,24 +216,48 @@ private:
     void InitControls();
     void CreateJobsListView();
     void PrepareDialog(Gtk::Dialog &dlg);
-    void ClearRunningJobRef();
+    /// Starts jobs from 'm_JobsToProcess' while there are less than Configuration::MaxConcurrentJobs running
+    void StartQueuedJobs();
+    /// Returns the index of an idle worker in 'm_Workers'; creates a new one if there is none
+    size_t GetIdleSlot();
+    /// Returns the number of jobs being processed by workers
+    size_t GetNumRunningJobs() const;
+    /// Returns the index of worker processing the job at 'iter' or NONE
+    size_t GetJobSlot(const Gtk::ListStore::iterator &iter) const;
+    /// Returns the access guard of the worker processing the job at 'iter' (see also LOCK_JOB())
+    Glib::Threads::RecMutex &GetJobAccessGuard(const Gtk::ListStore::iterator &iter);
+    /// Selects the worker to be visualized: the one processing the focused job or the first running one
+    void UpdateVisualizedSlot();
+    /// Updates the job list row (and other controls) with the progress of m_Workers[slot]
+    void UpdateJobProgress(size_t slot, const Worker::Progress_t &progress);
+    /// Returns the estimated time (in seconds) until all running and queued jobs are completed; negative if unknown
+    double EstimateQueueRemainingTime();
+    /// Handles completion of job processed by m_Workers[slot]
+    void FinishJob(size_t slot);
+    /// Passes 'm_DeferredOutputs' to 'm_OutputWriter' as long as its queue accepts them
+    void SubmitDeferredOutputs();
+    /// Registers the checkpoint of a finished job; releases the oldest ones above Utils::Const::MaxRetainedCheckpoints
+    void RetainCheckpoint(const std::shared_ptr<Job_t> &job);
+    /// Shows the dialog for manual placement of reference points of the job processed by m_Workers[slot]
+    void SetReferencePoints(size_t slot);
     void SetStatusBarText(const Glib::ustring &text);
     Gtk::TreeModel::Path GetJobsListFocusedRow();
     Job_t &GetCurrentJob();
+    /// Returns iterator of the focused row; may be null
+    Gtk::ListStore::iterator GetCurrentJobIter();
     std::shared_ptr<Job_t> GetCurrentJobPtr();
     void SetToolbarIcons();
     Gtk::ToolButton *GetToolButton(const char *actionName);
-    void SetDefaultSettings(Job_t &job);
-    void AutoSaveStack(const Job_t &job);
     bool SetAnchorsAutomatically(Job_t &job); ///< Returns false on failure
     /** Sets the enabled state of certain actions depending
         on current processing state and jobs list selection. */
     void UpdateActionsState();
     /// Returns 'false' if user canceled the selection
     bool SetAnchors(Job_t &job);
-    std::string GetDestDir(const Job_t &job) const;
     /// Returns 'false' on failure
-    bool ExportQualityData(const std::string &fileName, const Job_t &job) const;
+
+    /// Returns selected jobs whose quality data is available
+    std::vector<Gtk::ListStore::iterator> GetSelectedJobsWithQualityData();
     void UpdateOutputViewZoomControlsState();
 };
 
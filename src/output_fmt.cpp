@@ -0,0 +1,599 @@
+/*
+Stackistry - astronomical image stacking
+Copyright (C) 2016, 2017 Filip Szczerek <ga.software@yahoo.com>
+
+This file is part of Stackistry.
+
+Stackistry is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Stackistry is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Stackistry.  If not, see <http://www.gnu.org/licenses/>.
+
+File description:
+    Output formats implementation.
+*/
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+#include "output_fmt.h"
+#include "utils.h"
+
+
+namespace OutputFmt
+{
+
+/// Approx. amount of uncompressed pixel data compressed as a single block (by a single thread)
+const size_t COMPRESSION_BLOCK_SIZE = 256 * 1024;
+
+namespace TiffTag
+{
+    const uint16_t ImageWidth = 256;
+    const uint16_t ImageLength = 257;
+    const uint16_t BitsPerSample = 258;
+    const uint16_t Compression = 259;
+    const uint16_t PhotometricInterpretation = 262;
+    const uint16_t StripOffsets = 273;
+    const uint16_t SamplesPerPixel = 277;
+    const uint16_t RowsPerStrip = 278;
+    const uint16_t StripByteCounts = 279;
+    const uint16_t PlanarConfiguration = 284;
+    const uint16_t Predictor = 317;
+    const uint16_t SampleFormat = 339;
+}
+
+const uint16_t TIFF_SHORT = 3;
+const uint16_t TIFF_LONG = 4;
+
+const uint16_t TIFF_COMPRESSION_NONE = 1;
+const uint16_t TIFF_COMPRESSION_DEFLATE = 8;
+const uint16_t TIFF_PREDICTOR_NONE = 1;
+const uint16_t TIFF_PREDICTOR_HORIZONTAL = 2;
+const uint16_t TIFF_SAMPLE_FORMAT_UINT = 1;
+const uint16_t TIFF_SAMPLE_FORMAT_FLOAT = 3;
+
+const size_t FITS_BLOCK_SIZE = 2880;
+const size_t FITS_CARD_SIZE = 80;
+
+const uint8_t PNG_FILTER_PAETH = 4;
+
+struct TiffField_t
+{
+    uint16_t tag;
+    uint16_t type;
+    std::vector<uint32_t> values;
+};
+
+enum SKRY_output_format GetSkryFormat(OutputFormat outputFmt)
+{
+    switch (outputFmt)
+    {
+    case OutputFormat::BMP_8: return SKRY_BMP_8;
+    case OutputFormat::PNG_8: return SKRY_PNG_8;
+    case OutputFormat::TIFF_16: return SKRY_TIFF_16;
+    default: return SKRY_OUTP_FMT_INVALID;
+    }
+}
+
+OutputFormat FromSkryFormat(enum SKRY_output_format skryFmt)
+{
+    switch (skryFmt)
+    {
+    case SKRY_BMP_8: return OutputFormat::BMP_8;
+    case SKRY_PNG_8: return OutputFormat::PNG_8;
+    case SKRY_TIFF_16: return OutputFormat::TIFF_16;
+    default: return OutputFormat::INVALID;
+    }
+}
+
+bool IsNative(OutputFormat outputFmt)
+{
+    return GetSkryFormat(outputFmt) != SKRY_OUTP_FMT_INVALID;
+}
+
+size_t GetBitsPerChannel(OutputFormat outputFmt)
+{
+    if (IsNative(outputFmt))
+        return OUTPUT_FMT_BITS_PER_CHANNEL[GetSkryFormat(outputFmt)];
+    else if (outputFmt == OutputFormat::TIFF_16_DEFLATE || outputFmt == OutputFormat::PNG_16)
+        return 16;
+    else if (outputFmt == OutputFormat::TIFF_32F || outputFmt == OutputFormat::FITS_32F)
+        return 32;
+    else
+        return 0;
+}
+
+/// Appends 'value' to 'buf' in native byte order
+template<typename T>
+static void Append(std::vector<uint8_t> &buf, T value)
+{
+    uint8_t bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    buf.insert(buf.end(), bytes, bytes + sizeof(T));
+}
+
+static void AppendBigEndian32(std::vector<uint8_t> &buf, uint32_t value)
+{
+    buf.push_back(value >> 24);
+    buf.push_back((value >> 16) & 0xFF);
+    buf.push_back((value >> 8) & 0xFF);
+    buf.push_back(value & 0xFF);
+}
+
+static bool IsHostLittleEndian()
+{
+    const uint16_t value = 1;
+    uint8_t firstByte;
+    std::memcpy(&firstByte, &value, 1);
+    return firstByte == 1;
+}
+
+/// Returns line 'y' of 'img' in 'pixFmt'
+/** If 'img' is in a different format, the line is converted into 'buf' (valid until the next call
+    with the same 'buf'); this way an image is saved in another format without converting all of it. */
+static const void *GetLine(const libskry::c_Image &img, size_t y, enum SKRY_pixel_format pixFmt, libskry::c_Image &buf)
+{
+    if (img.GetPixelFormat() == pixFmt)
+        return img.GetLine(y);
+
+    if (!buf)
+        buf = libskry::c_Image(img.GetWidth(), 1, pixFmt, nullptr, false);
+    libskry::c_Image::ConvertPixelFormatOfSubimage(img, buf, 0, y, img.GetWidth(), 1, 0, 0);
+    return buf.GetLine(0);
+}
+
+static bool Deflate(const uint8_t *input, size_t length, std::vector<uint8_t> &output)
+{
+    uLongf outputLength = compressBound(length);
+    output.resize(outputLength);
+    if (Z_OK != compress2(output.data(), &outputLength, input, length, Z_DEFAULT_COMPRESSION))
+        return false;
+
+    output.resize(outputLength);
+    return true;
+}
+
+/// Writes a single-image TIFF file in native byte order
+/** 'writeStrips' is called to write the (compressed) pixel data of all strips, whose sizes are 'stripByteCounts'. */
+static enum SKRY_result WriteTiff(const char *fileName, unsigned width, unsigned height, size_t numChannels,
+                                  size_t bitsPerSample, uint16_t sampleFormat, uint16_t compression, uint16_t predictor,
+                                  size_t rowsPerStrip, const std::vector<uint32_t> &stripByteCounts,
+                                  const std::function<void(std::ofstream &file)> &writeStrips)
+{
+    std::vector<uint32_t> stripOffsets;
+    uint32_t offset = 8; // pixel data follows the header
+    for (uint32_t stripSize: stripByteCounts)
+    {
+        stripOffsets.push_back(offset);
+        offset += stripSize;
+    }
+    // IFD has to start on a word boundary
+    uint32_t padding = offset % 2;
+    uint32_t ifdOffset = offset + padding;
+
+    // Must be sorted by tag
+    const std::vector<TiffField_t> fields =
+    {
+        { TiffTag::ImageWidth,                TIFF_LONG,  { width } },
+        { TiffTag::ImageLength,               TIFF_LONG,  { height } },
+        { TiffTag::BitsPerSample,             TIFF_SHORT, std::vector<uint32_t>(numChannels, bitsPerSample) },
+        { TiffTag::Compression,               TIFF_SHORT, { compression } },
+        { TiffTag::PhotometricInterpretation, TIFF_SHORT, { numChannels == 1 ? 1u : 2u } }, // BlackIsZero or RGB
+        { TiffTag::StripOffsets,              TIFF_LONG,  stripOffsets },
+        { TiffTag::SamplesPerPixel,           TIFF_SHORT, { (uint32_t)numChannels } },
+        { TiffTag::RowsPerStrip,              TIFF_LONG,  { (uint32_t)rowsPerStrip } },
+        { TiffTag::StripByteCounts,           TIFF_LONG,  stripByteCounts },
+        { TiffTag::PlanarConfiguration,       TIFF_SHORT, { 1 } }, // chunky
+        { TiffTag::Predictor,                 TIFF_SHORT, { predictor } },
+        { TiffTag::SampleFormat,              TIFF_SHORT, std::vector<uint32_t>(numChannels, sampleFormat) }
+    };
+
+    std::vector<uint8_t> ifd;
+    // Values which do not fit in an IFD entry; stored after the IFD
+    std::vector<uint8_t> extraValues;
+    uint32_t extraValuesOffset = ifdOffset + 2 + 12 * fields.size() + 4;
+
+    Append<uint16_t>(ifd, fields.size());
+    for (const TiffField_t &field: fields)
+    {
+        size_t valueSize = (field.type == TIFF_SHORT ? 2 : 4);
+        bool inlineValues = (field.values.size() * valueSize <= 4);
+
+        Append<uint16_t>(ifd, field.tag);
+        Append<uint16_t>(ifd, field.type);
+        Append<uint32_t>(ifd, field.values.size());
+        if (!inlineValues)
+            Append<uint32_t>(ifd, extraValuesOffset + extraValues.size());
+
+        std::vector<uint8_t> &dest = (inlineValues ? ifd : extraValues);
+        for (uint32_t value: field.values)
+        {
+            if (field.type == TIFF_SHORT)
+                Append<uint16_t>(dest, value);
+            else
+                Append<uint32_t>(dest, value);
+        }
+
+        // Inline values are left-justified in the 4-byte value field
+        while ((ifd.size() - 2) % 12 != 0)
+            ifd.push_back(0);
+    }
+    Append<uint32_t>(ifd, 0); // no more IFDs
+
+    std::vector<uint8_t> header;
+    header.push_back(IsHostLittleEndian() ? 'I' : 'M');
+    header.push_back(header.back());
+    Append<uint16_t>(header, 42);
+    Append<uint32_t>(header, ifdOffset);
+
+    std::ofstream file(fileName, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+    if (!file)
+        return SKRY_CANNOT_CREATE_FILE;
+
+    file.write((const char *)header.data(), header.size());
+    writeStrips(file);
+    if (padding)
+        file.put(0);
+    file.write((const char *)ifd.data(), ifd.size());
+    file.write((const char *)extraValues.data(), extraValues.size());
+
+    return file ? SKRY_SUCCESS : SKRY_CANNOT_CREATE_FILE;
+}
+
+static enum SKRY_result SaveTiffDeflate(const libskry::c_Image &img, const char *fileName, enum SKRY_pixel_format pixFmt)
+{
+    size_t numChannels = NUM_CHANNELS[pixFmt];
+    if (BITS_PER_CHANNEL[pixFmt] != 16 || (numChannels != 1 && numChannels != 3))
+        return SKRY_UNSUPPORTED_PIXEL_FORMAT;
+
+    unsigned width = img.GetWidth();
+    unsigned height = img.GetHeight();
+    size_t samplesPerLine = width * numChannels;
+    size_t rowsPerStrip = std::max((size_t)1, COMPRESSION_BLOCK_SIZE / (samplesPerLine * sizeof(uint16_t)));
+    size_t numStrips = (height + rowsPerStrip - 1) / rowsPerStrip;
+
+    std::vector<std::vector<uint8_t>> strips(numStrips);
+    int numFailed = 0;
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < (int)numStrips; i++)
+    {
+        size_t y0 = i * rowsPerStrip;
+        size_t y1 = std::min((size_t)height, y0 + rowsPerStrip);
+
+        std::vector<uint16_t> samples((y1 - y0) * samplesPerLine);
+        libskry::c_Image lineBuf;
+        for (size_t y = y0; y < y1; y++)
+        {
+            uint16_t *line = &samples[(y - y0) * samplesPerLine];
+            std::memcpy(line, GetLine(img, y, pixFmt, lineBuf), samplesPerLine * sizeof(uint16_t));
+
+            // Horizontal differencing; performed from the end, so that the preceding samples are still unmodified
+            for (size_t s = samplesPerLine - 1; s >= numChannels; s--)
+                line[s] -= line[s - numChannels];
+        }
+
+        if (!Deflate((const uint8_t *)samples.data(), samples.size() * sizeof(uint16_t), strips[i]))
+        {
+            #pragma omp atomic
+            numFailed++;
+        }
+    }
+
+    if (numFailed)
+        return SKRY_OUT_OF_MEMORY;
+
+    std::vector<uint32_t> stripByteCounts;
+    for (const std::vector<uint8_t> &strip: strips)
+        stripByteCounts.push_back(strip.size());
+
+    return WriteTiff(fileName, width, height, numChannels, 16, TIFF_SAMPLE_FORMAT_UINT,
+                     TIFF_COMPRESSION_DEFLATE, TIFF_PREDICTOR_HORIZONTAL, rowsPerStrip, stripByteCounts,
+                     [&strips](std::ofstream &file)
+                     {
+                         for (const std::vector<uint8_t> &strip: strips)
+                             file.write((const char *)strip.data(), strip.size());
+                     });
+}
+
+/// Saves an uncompressed 32-bit floating-point TIFF; pixel data is written directly from the image's lines
+static enum SKRY_result SaveTiff32F(const libskry::c_Image &img, const char *fileName, enum SKRY_pixel_format pixFmt)
+{
+    if (pixFmt != SKRY_PIX_MONO32F && pixFmt != SKRY_PIX_RGB32F)
+        return SKRY_UNSUPPORTED_PIXEL_FORMAT;
+
+    size_t numChannels = NUM_CHANNELS[pixFmt];
+    unsigned width = img.GetWidth();
+    unsigned height = img.GetHeight();
+    size_t lineBytes = width * numChannels * sizeof(float);
+    size_t rowsPerStrip = std::max((size_t)1, COMPRESSION_BLOCK_SIZE / lineBytes);
+
+    std::vector<uint32_t> stripByteCounts;
+    for (size_t y = 0; y < height; y += rowsPerStrip)
+        stripByteCounts.push_back(std::min(rowsPerStrip, height - y) * lineBytes);
+
+    return WriteTiff(fileName, width, height, numChannels, 32, TIFF_SAMPLE_FORMAT_FLOAT,
+                     TIFF_COMPRESSION_NONE, TIFF_PREDICTOR_NONE, rowsPerStrip, stripByteCounts,
+                     [&img, pixFmt, height, lineBytes](std::ofstream &file)
+                     {
+                         libskry::c_Image lineBuf;
+                         for (size_t y = 0; y < height; y++)
+                             file.write((const char *)GetLine(img, y, pixFmt, lineBuf), lineBytes);
+                     });
+}
+
+/// Appends a FITS header card "KEYWORD = value" to 'header'
+static void AppendFitsCard(std::string &header, const std::string &keyword, const std::string &value)
+{
+    std::string card = keyword;
+    card.resize(8, ' ');
+    card += "= ";
+    // Fixed format: value right-justified in columns 11-30
+    card += std::string(value.length() < 20 ? 20 - value.length() : 0, ' ') + value;
+    card.resize(FITS_CARD_SIZE, ' ');
+    header += card;
+}
+
+/// Saves a 32-bit floating-point FITS image (RGB images as 3 planes); pixel data is converted and written line by line
+/** Lines are stored bottom-up (FITS images have the origin in the lower left corner). */
+static enum SKRY_result SaveFits32F(const libskry::c_Image &img, const char *fileName, enum SKRY_pixel_format pixFmt)
+{
+    if (pixFmt != SKRY_PIX_MONO32F && pixFmt != SKRY_PIX_RGB32F)
+        return SKRY_UNSUPPORTED_PIXEL_FORMAT;
+
+    size_t numChannels = NUM_CHANNELS[pixFmt];
+    unsigned width = img.GetWidth();
+    unsigned height = img.GetHeight();
+
+    std::string header;
+    AppendFitsCard(header, "SIMPLE", "T");
+    AppendFitsCard(header, "BITPIX", "-32");
+    AppendFitsCard(header, "NAXIS", numChannels == 1 ? "2" : "3");
+    AppendFitsCard(header, "NAXIS1", std::to_string(width));
+    AppendFitsCard(header, "NAXIS2", std::to_string(height));
+    if (numChannels > 1)
+        AppendFitsCard(header, "NAXIS3", std::to_string(numChannels));
+    header += std::string("END").append(FITS_CARD_SIZE - 3, ' ');
+    header.resize((header.length() + FITS_BLOCK_SIZE - 1) / FITS_BLOCK_SIZE * FITS_BLOCK_SIZE, ' ');
+
+    std::ofstream file(fileName, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+    if (!file)
+        return SKRY_CANNOT_CREATE_FILE;
+
+    file.write(header.data(), header.length());
+
+    // Big-endian IEEE 754 values
+    std::vector<uint8_t> line(width * sizeof(float));
+    libskry::c_Image lineBuf;
+    for (size_t ch = 0; ch < numChannels; ch++)
+        for (size_t y = height; y-- > 0;)
+        {
+            const float *src = (const float *)GetLine(img, y, pixFmt, lineBuf);
+            for (size_t x = 0; x < width; x++)
+            {
+                uint32_t value;
+                std::memcpy(&value, &src[x * numChannels + ch], sizeof(value));
+                line[4*x]     = value >> 24;
+                line[4*x + 1] = (value >> 16) & 0xFF;
+                line[4*x + 2] = (value >> 8) & 0xFF;
+                line[4*x + 3] = value & 0xFF;
+            }
+            file.write((const char *)line.data(), line.size());
+        }
+
+    size_t dataSize = (size_t)width * height * numChannels * sizeof(float);
+    if (dataSize % FITS_BLOCK_SIZE)
+        file.write(std::string(FITS_BLOCK_SIZE - dataSize % FITS_BLOCK_SIZE, '\0').data(),
+                   FITS_BLOCK_SIZE - dataSize % FITS_BLOCK_SIZE);
+
+    return file ? SKRY_SUCCESS : SKRY_CANNOT_CREATE_FILE;
+}
+
+static uint8_t PaethPredictor(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = std::abs(p - a);
+    int pb = std::abs(p - b);
+    int pc = std::abs(p - c);
+
+    if (pa <= pb && pa <= pc)
+        return a;
+    else if (pb <= pc)
+        return b;
+    else
+        return c;
+}
+
+/// Stores a line of 16-bit samples (of 'img' in 'pixFmt', see GetLine()) as big-endian in 'dest'
+static void GetBigEndianLine(const libskry::c_Image &img, size_t y, enum SKRY_pixel_format pixFmt, libskry::c_Image &buf,
+                             size_t numSamples, std::vector<uint8_t> &dest)
+{
+    const uint16_t *src = (const uint16_t *)GetLine(img, y, pixFmt, buf);
+    for (size_t i = 0; i < numSamples; i++)
+    {
+        dest[2*i] = src[i] >> 8;
+        dest[2*i + 1] = src[i] & 0xFF;
+    }
+}
+
+static void WritePngChunk(std::ofstream &file, const char *type, const std::vector<uint8_t> &data)
+{
+    std::vector<uint8_t> chunk;
+    AppendBigEndian32(chunk, data.size());
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    // CRC covers the chunk type and data
+    AppendBigEndian32(chunk, crc32(crc32(0, Z_NULL, 0), &chunk[4], data.size() + 4));
+
+    file.write((const char *)chunk.data(), chunk.size());
+}
+
+/** The zlib stream is assembled from independently deflated blocks of filtered lines.
+    Each block but the last is terminated with a sync flush (i.e. ends on a byte boundary),
+    so that the blocks can be concatenated. */
+static enum SKRY_result SavePng16(const libskry::c_Image &img, const char *fileName, enum SKRY_pixel_format pixFmt)
+{
+    size_t numChannels = NUM_CHANNELS[pixFmt];
+    if (BITS_PER_CHANNEL[pixFmt] != 16 || (numChannels != 1 && numChannels != 3))
+        return SKRY_UNSUPPORTED_PIXEL_FORMAT;
+
+    unsigned width = img.GetWidth();
+    unsigned height = img.GetHeight();
+    size_t bytesPerPixel = numChannels * sizeof(uint16_t);
+    size_t lineBytes = width * bytesPerPixel;
+    size_t linesPerBlock = std::max((size_t)1, COMPRESSION_BLOCK_SIZE / lineBytes);
+    size_t numBlocks = (height + linesPerBlock - 1) / linesPerBlock;
+
+    std::vector<std::vector<uint8_t>> blocks(numBlocks);
+    std::vector<uLong> blockAdler(numBlocks);
+    std::vector<size_t> blockFilteredSize(numBlocks);
+    int numFailed = 0;
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < (int)numBlocks; i++)
+    {
+        size_t y0 = i * linesPerBlock;
+        size_t y1 = std::min((size_t)height, y0 + linesPerBlock);
+
+        // Each line is preceded by the filter type
+        std::vector<uint8_t> filtered((y1 - y0) * (1 + lineBytes));
+        std::vector<uint8_t> prevLine(lineBytes, 0), currLine(lineBytes);
+        libskry::c_Image lineBuf;
+        if (y0 > 0)
+            GetBigEndianLine(img, y0 - 1, pixFmt, lineBuf, width * numChannels, prevLine);
+
+        uint8_t *out = filtered.data();
+        for (size_t y = y0; y < y1; y++)
+        {
+            GetBigEndianLine(img, y, pixFmt, lineBuf, width * numChannels, currLine);
+            *out++ = PNG_FILTER_PAETH;
+            for (size_t j = 0; j < lineBytes; j++)
+            {
+                int left = (j >= bytesPerPixel ? currLine[j - bytesPerPixel] : 0);
+                int upLeft = (j >= bytesPerPixel ? prevLine[j - bytesPerPixel] : 0);
+                *out++ = currLine[j] - PaethPredictor(left, prevLine[j], upLeft);
+            }
+            std::swap(prevLine, currLine);
+        }
+
+        blockFilteredSize[i] = filtered.size();
+        blockAdler[i] = adler32(adler32(0, Z_NULL, 0), filtered.data(), filtered.size());
+
+        bool isLast = (i == (int)numBlocks - 1);
+        z_stream strm;
+        std::memset(&strm, 0, sizeof(strm));
+        // Negative window bits: raw deflate data, without zlib header and trailer
+        bool ok = (Z_OK == deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY));
+        if (ok)
+        {
+            // Leave room for the sync flush marker
+            blocks[i].resize(deflateBound(&strm, filtered.size()) + 16);
+            strm.next_in = filtered.data();
+            strm.avail_in = filtered.size();
+            strm.next_out = blocks[i].data();
+            strm.avail_out = blocks[i].size();
+
+            int result = deflate(&strm, isLast ? Z_FINISH : Z_SYNC_FLUSH);
+            ok = (isLast ? result == Z_STREAM_END : result == Z_OK && strm.avail_out > 0);
+            blocks[i].resize(strm.total_out);
+            deflateEnd(&strm);
+        }
+
+        if (!ok)
+        {
+            #pragma omp atomic
+            numFailed++;
+        }
+    }
+
+    if (numFailed)
+        return SKRY_OUT_OF_MEMORY;
+
+    std::vector<uint8_t> idat = { 0x78, 0x9C }; // zlib header: deflate, 32 KiB window, default compression
+    uLong adler = adler32(0, Z_NULL, 0);
+    for (size_t i = 0; i < numBlocks; i++)
+    {
+        idat.insert(idat.end(), blocks[i].begin(), blocks[i].end());
+        adler = adler32_combine(adler, blockAdler[i], blockFilteredSize[i]);
+        std::vector<uint8_t>().swap(blocks[i]);
+    }
+    AppendBigEndian32(idat, adler);
+
+    std::vector<uint8_t> ihdr;
+    AppendBigEndian32(ihdr, width);
+    AppendBigEndian32(ihdr, height);
+    ihdr.push_back(16); // bit depth
+    ihdr.push_back(numChannels == 1 ? 0 : 2); // color type: grayscale or RGB
+    ihdr.push_back(0); // compression method: deflate
+    ihdr.push_back(0); // filter method: adaptive
+    ihdr.push_back(0); // no interlace
+
+    std::ofstream file(fileName, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+    if (!file)
+        return SKRY_CANNOT_CREATE_FILE;
+
+    const uint8_t signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    file.write((const char *)signature, sizeof(signature));
+    WritePngChunk(file, "IHDR", ihdr);
+    WritePngChunk(file, "IDAT", idat);
+    WritePngChunk(file, "IEND", std::vector<uint8_t>());
+
+    return file ? SKRY_SUCCESS : SKRY_CANNOT_CREATE_FILE;
+}
+
+/// Saves 'img' in a format implemented by Stackistry, converting its lines to 'pixFmt' one at a time
+static enum SKRY_result SaveNonNative(const libskry::c_Image &img, const char *fileName, OutputFormat outputFmt,
+                                      enum SKRY_pixel_format pixFmt)
+{
+    if (outputFmt == OutputFormat::TIFF_16_DEFLATE)
+        return SaveTiffDeflate(img, fileName, pixFmt);
+    else if (outputFmt == OutputFormat::PNG_16)
+        return SavePng16(img, fileName, pixFmt);
+    else if (outputFmt == OutputFormat::TIFF_32F)
+        return SaveTiff32F(img, fileName, pixFmt);
+    else if (outputFmt == OutputFormat::FITS_32F)
+        return SaveFits32F(img, fileName, pixFmt);
+    else
+        return SKRY_UNSUPPORTED_FILE_FORMAT;
+}
+
+enum SKRY_result Save(const libskry::c_Image &img, const char *fileName, OutputFormat outputFmt)
+{
+    if (IsNative(outputFmt))
+        return img.Save(fileName, GetSkryFormat(outputFmt));
+    else
+        return SaveNonNative(img, fileName, outputFmt, img.GetPixelFormat());
+}
+
+enum SKRY_result ConvertAndSave(const libskry::c_Image &img, const char *fileName, OutputFormat outputFmt)
+{
+    enum SKRY_pixel_format srcPixFmt = img.GetPixelFormat();
+    enum SKRY_pixel_format pixFmt = Utils::FindMatchingFormat(outputFmt, NUM_CHANNELS[srcPixFmt]);
+    if (pixFmt == SKRY_PIX_INVALID)
+        return SKRY_UNSUPPORTED_PIXEL_FORMAT;
+    else if (pixFmt == srcPixFmt)
+        return Save(img, fileName, outputFmt);
+    // Raw color images cannot be demosaiced line by line
+    else if (!IsNative(outputFmt) && (srcPixFmt < SKRY_PIX_CFA_MIN || srcPixFmt > SKRY_PIX_CFA_MAX))
+        return SaveNonNative(img, fileName, outputFmt, pixFmt);
+    else
+        return Save(libskry::c_Image::ConvertPixelFormat(img, pixFmt), fileName, outputFmt);
+}
+
+} // namespace OutputFmt
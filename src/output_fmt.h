@@ -0,0 +1,76 @@
+/*
+Stackistry - astronomical image stacking
+Copyright (C) 2016, 2017 Filip Szczerek <ga.software@yahoo.com>
+
+This file is part of Stackistry.
+
+Stackistry is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Stackistry is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Stackistry.  If not, see <http://www.gnu.org/licenses/>.
+
+File description:
+    Output formats header.
+*/
+
+#ifndef STACKISTRY_OUTPUT_FORMATS_HEADER
+#define STACKISTRY_OUTPUT_FORMATS_HEADER
+
+#include <skry/skry_cpp.hpp>
+
+
+/// Output format of saved images
+/** Formats saved by libskry correspond to values of SKRY_output_format (see OutputFmt::GetSkryFormat()),
+    the remaining ones are implemented by Stackistry. */
+enum class OutputFormat
+{
+    INVALID = 0,
+
+    // Saved by libskry
+    BMP_8,
+    PNG_8,
+    TIFF_16,
+
+    // Implemented by Stackistry
+    TIFF_16_DEFLATE, ///< 16-bit TIFF, deflate-compressed with horizontal differencing predictor
+    PNG_16,          ///< 16-bit PNG
+    TIFF_32F,        ///< 32-bit floating-point TIFF (uncompressed)
+    FITS_32F         ///< 32-bit floating-point FITS
+};
+
+namespace OutputFmt
+{
+    /// Returns the libskry format corresponding to 'outputFmt'; SKRY_OUTP_FMT_INVALID if it is implemented by Stackistry
+    enum SKRY_output_format GetSkryFormat(OutputFormat outputFmt);
+
+    /// Returns the format corresponding to libskry's 'skryFmt'; OutputFormat::INVALID if there is none
+    OutputFormat FromSkryFormat(enum SKRY_output_format skryFmt);
+
+    /// Returns 'true' if 'outputFmt' is saved by libskry (and such files can be loaded by libskry)
+    bool IsNative(OutputFormat outputFmt);
+
+    /// Returns the number of bits per channel of pixel data saved in 'outputFmt'
+    size_t GetBitsPerChannel(OutputFormat outputFmt);
+
+    /// Saves 'img' in 'outputFmt'
+    /** 'img' has to be in the pixel format returned by Utils::FindMatchingFormat() for 'outputFmt'.
+        Compression of formats implemented by Stackistry is performed in parallel
+        (independently compressed image strips). */
+    enum SKRY_result Save(const libskry::c_Image &img, const char *fileName, OutputFormat outputFmt);
+
+    /// Saves 'img' in 'outputFmt', converting it to the pixel format returned by Utils::FindMatchingFormat()
+    /** If 'img' is already in that format (e.g. a floating-point stack saved as OutputFormat::TIFF_32F or FITS_32F),
+        it is saved directly. Formats implemented by Stackistry convert the image line by line while saving
+        (except for raw color images), so no full-size converted copy is created either. */
+    enum SKRY_result ConvertAndSave(const libskry::c_Image &img, const char *fileName, OutputFormat outputFmt);
+}
+
+#endif // STACKISTRY_OUTPUT_FORMATS_HEADER
@@ -0,0 +1,120 @@
+/*
+Stackistry - astronomical image stacking
+Copyright (C) 2016, 2017 Filip Szczerek <ga.software@yahoo.com>
+
+This file is part of Stackistry.
+
+Stackistry is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Stackistry is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Stackistry.  If not, see <http://www.gnu.org/licenses/>.
+
+File description:
+    Background output writer implementation.
+*/
+
+#include <utility>
+
+#include "output_writer.h"
+
+
+c_OutputWriter::c_OutputWriter(size_t maxQueued)
+: m_MaxQueued(maxQueued)
+{
+    m_Thread = Glib::Threads::Thread::create(sigc::mem_fun(*this, &c_OutputWriter::ThreadFunc));
+}
+
+c_OutputWriter::~c_OutputWriter()
+{
+    { Glib::Threads::Mutex::Lock lock(m_Mtx);
+        m_Finish = true;
+        m_CondQueued.signal();
+    }
+    m_Thread->join();
+}
+
+bool c_OutputWriter::Enqueue(unsigned id, const WriteFunc_t &write, const std::string &destPath)
+{
+    Glib::Threads::Mutex::Lock lock(m_Mtx);
+
+    if (m_Queue.size() >= m_MaxQueued)
+        return false;
+
+    m_Queue.push_back({ id, write, destPath });
+    m_CondQueued.signal();
+    return true;
+}
+
+void c_OutputWriter::Flush()
+{
+    Glib::Threads::Mutex::Lock lock(m_Mtx);
+
+    while (!m_Queue.empty() || !m_CurrentPath.empty())
+        m_CondWritten.wait(m_Mtx);
+}
+
+std::set<std::string> c_OutputWriter::GetPendingPaths() const
+{
+    Glib::Threads::Mutex::Lock lock(m_Mtx);
+
+    std::set<std::string> paths;
+    if (!m_CurrentPath.empty())
+        paths.insert(m_CurrentPath);
+
+    for (const Output_t &output: m_Queue)
+        paths.insert(output.destPath);
+
+    return paths;
+}
+
+std::vector<c_OutputWriter::Result_t> c_OutputWriter::GetResults()
+{
+    Glib::Threads::Mutex::Lock lock(m_Mtx);
+
+    std::vector<Result_t> results;
+    results.swap(m_Results);
+    return results;
+}
+
+void c_OutputWriter::ConnectWrittenSignal(const sigc::slot<void> &slot)
+{
+    m_Dispatcher.connect(slot);
+}
+
+void c_OutputWriter::ThreadFunc()
+{
+    Glib::Threads::Mutex::Lock lock(m_Mtx);
+    while (true)
+    {
+        while (!m_Finish && m_Queue.empty())
+            m_CondQueued.wait(m_Mtx);
+
+        // When finishing, the remaining files are still written
+        if (m_Queue.empty())
+            break;
+
+        Output_t output = std::move(m_Queue.front());
+        m_Queue.pop_front();
+        m_CurrentPath = output.destPath;
+
+        lock.release();
+
+        enum SKRY_result result = output.write();
+        output.write = nullptr; // releases the captured data before Flush() may return
+
+        lock.acquire();
+
+        m_CurrentPath.clear();
+        m_Results.push_back({ output.id, output.destPath, result });
+        m_CondWritten.broadcast();
+        m_Dispatcher();
+    }
+}
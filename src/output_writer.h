@@ -0,0 +1,106 @@
+/*
+Stackistry - astronomical image stacking
+Copyright (C) 2016, 2017 Filip Szczerek <ga.software@yahoo.com>
+
+This file is part of Stackistry.
+
+Stackistry is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Stackistry is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Stackistry.  If not, see <http://www.gnu.org/licenses/>.
+
+File description:
+    Background output writer header.
+*/
+
+#ifndef STACKISTRY_OUTPUT_WRITER_HEADER
+#define STACKISTRY_OUTPUT_WRITER_HEADER
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <glibmm/dispatcher.h>
+#include <glibmm/threads.h>
+#include <skry/skry.h>
+
+
+/// Writes output files (stacked images, frame quality data) in a background thread
+/** Files are written in the order they were queued. The queue is bounded: Enqueue()
+    does not accept a file while the max. number of files is waiting to be written.
+    Must be created and used by the main thread. */
+class c_OutputWriter
+{
+public:
+    struct Result_t
+    {
+        unsigned id; ///< Value passed to Enqueue()
+        std::string destPath;
+        enum SKRY_result result;
+    };
+
+    /// Creates a file; called in the writer thread, so it must not access data modified by other threads
+    typedef std::function<enum SKRY_result ()> WriteFunc_t;
+
+    c_OutputWriter(size_t maxQueued);
+    c_OutputWriter(const c_OutputWriter &) = delete;
+    c_OutputWriter &operator=(const c_OutputWriter &) = delete;
+
+    /// Writes all queued files and stops the writer thread
+    ~c_OutputWriter();
+
+    /// Queues 'write' to be called to create 'destPath'
+    /** 'id' identifies the corresponding result returned by GetResults(). Returns 'false'
+        (without queuing) if the queue is full. 'write' is destroyed before Flush() returns. */
+    bool Enqueue(unsigned id, const WriteFunc_t &write, const std::string &destPath);
+
+    /// Waits until all queued files have been written
+    void Flush();
+
+    /// Returns destination paths of the files queued or being written
+    std::set<std::string> GetPendingPaths() const;
+
+    /// Returns (and removes) the results of files written since the previous call
+    std::vector<Result_t> GetResults();
+
+    /// Connects a slot called in the main thread after a file has been written
+    void ConnectWrittenSignal(const sigc::slot<void> &slot);
+
+private:
+    struct Output_t
+    {
+        unsigned id;
+        WriteFunc_t write;
+        std::string destPath;
+    };
+
+    size_t m_MaxQueued;
+
+    std::deque<Output_t> m_Queue;
+    /// Destination path of the file being written; empty if none
+    std::string m_CurrentPath;
+    std::vector<Result_t> m_Results;
+    bool m_Finish = false;
+
+    mutable Glib::Threads::Mutex m_Mtx; ///< Access guard for the variables above
+    Glib::Threads::Cond m_CondQueued; ///< Signaled when a file has been queued (or the thread is to finish)
+    Glib::Threads::Cond m_CondWritten; ///< Signaled when a file has been written
+    Glib::Threads::Thread *m_Thread = nullptr;
+
+    Glib::Dispatcher m_Dispatcher;
+
+    void ThreadFunc();
+};
+
+#endif // STACKISTRY_OUTPUT_WRITER_HEADER
@@ -93,6 +93,12 @@ void c_PreferencesDlg::InitControls()
     m_ExportInactiveFramesQuality.show();
     get_content_area()->pack_start(m_ExportInactiveFramesQuality, Gtk::PackOptions::PACK_SHRINK, Utils::Const::widgetPaddingInPixels);
 
+    m_BinaryQualityExport.set_label(_("Export quality data automatically in binary format"));
+    m_BinaryQualityExport.set_tooltip_text(_("Compact columnar format, faster to write and parse for long recordings; text is used otherwise"));
+    m_BinaryQualityExport.set_active(Configuration::BinaryQualityExport);
+    m_BinaryQualityExport.show();
+    get_content_area()->pack_start(m_BinaryQualityExport, Gtk::PackOptions::PACK_SHRINK, Utils::Const::widgetPaddingInPixels);
+
     m_NumQualHistBins.set_adjustment(Gtk::Adjustment::create(Configuration::NumQualityHistogramBins, 10, Utils::Const::MaxQualityHistogramBins,
             1, 10, 10));
     get_content_area()->pack_start(*Utils::PackIntoBox<Gtk::HBox>(
@@ -100,6 +106,42 @@ void c_PreferencesDlg::InitControls()
               &m_NumQualHistBins }),
             Gtk::PackOptions::PACK_SHRINK, Utils::Const::widgetPaddingInPixels);
 
+    m_MaxConcurrentJobs.set_adjustment(Gtk::Adjustment::create(Configuration::MaxConcurrentJobs, 1, Utils::Const::MaxConcurrentJobsLimit,
+            1, 1, 0));
+    get_content_area()->pack_start(*Utils::PackIntoBox<Gtk::HBox>(
+            { Gtk::manage(new Gtk::Label(_("Max. number of jobs processed simultaneously:"))),
+              &m_MaxConcurrentJobs }),
+            Gtk::PackOptions::PACK_SHRINK, Utils::Const::widgetPaddingInPixels);
+
+    m_ReadAheadBufferSize.set_adjustment(Gtk::Adjustment::create(Configuration::ReadAheadBufferSizeMB, 0, Utils::Const::MaxReadAheadBufferSizeMB,
+            16, 64, 0));
+    m_ReadAheadBufferSize.set_tooltip_text(_("Amount of frame data read from disk in advance during processing; 0 disables reading ahead"));
+    get_content_area()->pack_start(*Utils::PackIntoBox<Gtk::HBox>(
+            { Gtk::manage(new Gtk::Label(_("Frame read-ahead buffer size (MiB):"))),
+              &m_ReadAheadBufferSize }),
+            Gtk::PackOptions::PACK_SHRINK, Utils::Const::widgetPaddingInPixels);
+
+    m_FrameCacheSize.set_adjustment(Gtk::Adjustment::create(Configuration::FrameCacheSizeMB, 0, Utils::Const::MaxFrameCacheSizeMB,
+            64, 1024, 0));
+    m_FrameCacheSize.set_tooltip_text(_("Memory used for keeping decoded frames shown in frame selection and the best frame preview; 0 disables caching"));
+    get_content_area()->pack_start(*Utils::PackIntoBox<Gtk::HBox>(
+            { Gtk::manage(new Gtk::Label(_("Decoded frame cache size (MiB):"))),
+              &m_FrameCacheSize }),
+            Gtk::PackOptions::PACK_SHRINK, Utils::Const::widgetPaddingInPixels);
+
+    m_CompactFrameCache.set_label(_("Keep 8-bit frames in their original format in the cache (uses less memory)"));
+    m_CompactFrameCache.set_active(Configuration::CompactFrameCache);
+    m_CompactFrameCache.show();
+    get_content_area()->pack_start(m_CompactFrameCache, Gtk::PackOptions::PACK_SHRINK, Utils::Const::widgetPaddingInPixels);
+
+    m_MaxNotificationRate.set_adjustment(Gtk::Adjustment::create(Configuration::MaxNotificationRate, 1, Utils::Const::MaxNotificationRateLimit,
+            1, 10, 0));
+    m_MaxNotificationRate.set_tooltip_text(_("Progress updates are shown at most this many times per second; phase changes are always shown immediately"));
+    get_content_area()->pack_start(*Utils::PackIntoBox<Gtk::HBox>(
+            { Gtk::manage(new Gtk::Label(_("Max. progress updates per second:"))),
+              &m_MaxNotificationRate }),
+            Gtk::PackOptions::PACK_SHRINK, Utils::Const::widgetPaddingInPixels);
+
     auto separator = Gtk::manage(new Gtk::Separator());
     separator->show();
     get_content_area()->pack_end(*separator, Gtk::PackOptions::PACK_SHRINK, Utils::Const::widgetPaddingInPixels);
@@ -117,7 +159,13 @@ void c_PreferencesDlg::OnResponse(int responseId)
     if (responseId == Gtk::ResponseType::RESPONSE_OK)
     {
         Configuration::ExportInactiveFramesQuality = m_ExportInactiveFramesQuality.get_active();
+        Configuration::BinaryQualityExport = m_BinaryQualityExport.get_active();
         Configuration::NumQualityHistogramBins = (size_t)m_NumQualHistBins.get_value();
+        Configuration::MaxConcurrentJobs = (size_t)m_MaxConcurrentJobs.get_value();
+        Configuration::ReadAheadBufferSizeMB = (size_t)m_ReadAheadBufferSize.get_value();
+        Configuration::FrameCacheSizeMB = (size_t)m_FrameCacheSize.get_value();
+        Configuration::CompactFrameCache = m_CompactFrameCache.get_active();
+        Configuration::MaxNotificationRate = (unsigned)m_MaxNotificationRate.get_value();
     }
 }
 
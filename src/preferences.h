@@ -40,7 +40,13 @@ class c_PreferencesDlg: public Gtk::Dialog, public Utils::Types::IValidatedInput
     Gtk::Scale m_ToolIconSize;
     Gtk::ComboBoxText m_UILanguage;
     Gtk::CheckButton m_ExportInactiveFramesQuality;
+    Gtk::CheckButton m_BinaryQualityExport;
     Gtk::SpinButton m_NumQualHistBins;
+    Gtk::SpinButton m_MaxConcurrentJobs;
+    Gtk::SpinButton m_ReadAheadBufferSize;
+    Gtk::SpinButton m_FrameCacheSize;
+    Gtk::CheckButton m_CompactFrameCache;
+    Gtk::SpinButton m_MaxNotificationRate;
 
     void InitControls();
 
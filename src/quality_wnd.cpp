@@ -22,6 +22,8 @@ File description:
 */
 
 #include <algorithm>
+#include <cmath>
+#include <cstddef>
 #include <cstdlib>
 
 #include <glibmm/i18n.h>
@@ -43,6 +45,11 @@ namespace Color
 const double chronoLineWidth = 2.0;
 const double sortedLineWidth = 3.0;
 
+/// Min. number of frame intervals across the graph's width
+const double minVisibleFrames = 8;
+/// Change of the visible frame range per mouse wheel step
+const double zoomStep = 1.25;
+
 c_QualityWindow::c_QualityWindow()
 {
     set_title(_("Frame Quality"));
@@ -52,6 +59,11 @@ c_QualityWindow::c_QualityWindow()
     m_DrawItems.sorted = true;
     m_DrawItems.histogram = true;
 
+    m_View.first = 0;
+    m_View.count = 1;
+    m_EnvelopeGeneration = 0;
+    m_SortedEnvelopeOutdated = false;
+
     resize(640, 480);
     Utils::RestorePosSize(Configuration::QualityWndPosSize, *this);
 
@@ -69,6 +81,13 @@ void c_QualityWindow::InitControls()
 
 
     m_DrawArea.signal_draw().connect(sigc::mem_fun(*this, &c_QualityWindow::OnDraw));
+    m_DrawArea.add_events(Gdk::EventMask::SCROLL_MASK
+                          | Gdk::EventMask::BUTTON_PRESS_MASK
+                          | Gdk::EventMask::BUTTON1_MOTION_MASK);
+    m_DrawArea.signal_scroll_event().connect(sigc::mem_fun(*this, &c_QualityWindow::OnScroll));
+    m_DrawArea.signal_button_press_event().connect(sigc::mem_fun(*this, &c_QualityWindow::OnButtonPress));
+    m_DrawArea.signal_motion_notify_event().connect(sigc::mem_fun(*this, &c_QualityWindow::OnMotion));
+    m_DrawArea.set_tooltip_text(_("Scroll to zoom, drag to pan, double-click to show all frames"));
     Utils::SetBackgroundColor(m_DrawArea, Gdk::RGBA("white"));
     m_DrawArea.show();
     contents->pack_start(m_DrawArea, Gtk::PackOptions::PACK_EXPAND_WIDGET, Utils::Const::widgetPaddingInPixels);
@@ -126,18 +145,52 @@ void c_QualityWindow::InitControls()
     add(*contents);
 }
 
+/// Draws the values within the visible range, using at most 2 segments per pixel column
 static
 void DrawGraph(const Cairo::RefPtr<Cairo::Context> &cr,
                const std::vector<SKRY_quality_t> &values,
-               int height, double lineWidth, const GdkRGBA &color,
-               double hstep, double vscale, double minValue)
+               const Utils::Types::c_MinMaxPyramid<SKRY_quality_t> &envelope,
+               double viewFirst, double viewCount,
+               int width, int height, double lineWidth, const GdkRGBA &color,
+               double vscale, double minValue)
 {
     cr->set_dash(std::vector<double>{ } , 0);
     Utils::SetColor(cr, color);
     cr->set_line_width(lineWidth);
-    cr->move_to(0, height - vscale * (values[0] - minValue));
-    for (size_t i = 1; i < values.size(); i++)
-        cr->line_to(i * hstep, height - vscale * (values[i] - minValue));
+
+    double hstep = width / viewCount;
+    ptrdiff_t lastIdx = values.size() - 1;
+
+    if (hstep >= 1.0)
+    {
+        // Sparse values: a segment between each pair of neighboring values (including the ones just outside)
+        ptrdiff_t first = std::max((ptrdiff_t)0, (ptrdiff_t)std::floor(viewFirst));
+        ptrdiff_t last = std::min(lastIdx, (ptrdiff_t)std::ceil(viewFirst + viewCount));
+
+        cr->move_to((first - viewFirst) * hstep, height - vscale * (values[first] - minValue));
+        for (ptrdiff_t i = first + 1; i <= last; i++)
+            cr->line_to((i - viewFirst) * hstep, height - vscale * (values[i] - minValue));
+    }
+    else
+    {
+        // Dense values: a vertical segment spanning the min. and max. of values in each pixel column
+        for (int x = 0; x < width; x++)
+        {
+            ptrdiff_t first = std::max((ptrdiff_t)0, (ptrdiff_t)std::floor(viewFirst + x / hstep));
+            ptrdiff_t last = std::min(lastIdx, (ptrdiff_t)std::floor(viewFirst + (x + 1) / hstep));
+            if (first > last)
+                break;
+
+            std::pair<SKRY_quality_t, SKRY_quality_t> minMax = envelope.GetMinMax(first, last + 1);
+            double yMax = height - vscale * (minMax.second - minValue);
+            double yMin = height - vscale * (minMax.first - minValue);
+            if (x == 0)
+                cr->move_to(x, yMax);
+            else
+                cr->line_to(x, yMax);
+            cr->line_to(x, yMin);
+        }
+    }
 
     cr->stroke();
 }
@@ -183,8 +236,12 @@ void DrawGrid(const Cairo::RefPtr<Cairo::Context> &cr, int width, int height, co
 
 bool c_QualityWindow::OnDraw(const Cairo::RefPtr<Cairo::Context>& cr)
 {
-    if (!m_Job || m_Job->quality.framesChrono.empty())
+    if (!m_Job || m_Job->quality.framesChrono.empty()
+        // Quality data has changed and Update() has not been called yet
+        || m_Job->quality.framesChrono.size() != m_ChronoEnvelope.GetSize())
+    {
         return false; // fall back to default - fill with background color
+    }
 
     int width = m_DrawArea.get_width(),
         height = m_DrawArea.get_height();
@@ -205,13 +262,21 @@ bool c_QualityWindow::OnDraw(const Cairo::RefPtr<Cairo::Context>& cr)
     else
     {
         double vscale = height  / (m_MaxQ - m_MinQ);
-        double hstep = (double)width / (m_Job->quality.framesChrono.size() - 1);
+
+        // Re-created only here, so that it is not done for every update of the quality data in between
+        if (m_DrawItems.sorted && m_SortedEnvelopeOutdated)
+        {
+            m_SortedEnvelope.CreateFromData(m_Job->quality.framesSorted);
+            m_SortedEnvelopeOutdated = false;
+        }
 
         if (m_DrawItems.sorted)
-            DrawGraph(cr, m_Job->quality.framesSorted, height, sortedLineWidth, Color::sortedGraph, hstep, vscale, m_MinQ);
+            DrawGraph(cr, m_Job->quality.framesSorted, m_SortedEnvelope, m_View.first, m_View.count,
+                      width, height, sortedLineWidth, Color::sortedGraph, vscale, m_MinQ);
 
         if (m_DrawItems.chrono)
-            DrawGraph(cr, m_Job->quality.framesChrono, height, chronoLineWidth, Color::chronoGraph, hstep, vscale, m_MinQ);
+            DrawGraph(cr, m_Job->quality.framesChrono, m_ChronoEnvelope, m_View.first, m_View.count,
+                      width, height, chronoLineWidth, Color::chronoGraph, vscale, m_MinQ);
     }
 
     return true;
@@ -236,25 +301,120 @@ void c_QualityWindow::SetJob(std::shared_ptr<Job_t> job)
     Update();
 }
 
+void c_QualityWindow::ResetView()
+{
+    m_View.first = 0;
+    m_View.count = std::max((size_t)1, m_ChronoEnvelope.GetSize()) - 1;
+    if (m_View.count == 0)
+        m_View.count = 1;
+
+    if (is_visible())
+        queue_draw();
+}
+
+void c_QualityWindow::ClampView()
+{
+    double maxCount = std::max(1.0, (double)m_ChronoEnvelope.GetSize() - 1);
+
+    m_View.count = std::max(std::min(maxCount, minVisibleFrames), std::min(m_View.count, maxCount));
+    m_View.first = std::max(0.0, std::min(m_View.first, maxCount - m_View.count));
+}
+
+bool c_QualityWindow::OnScroll(GdkEventScroll *event)
+{
+    if (m_ChronoEnvelope.GetSize() < 2
+        || event->direction != GDK_SCROLL_UP && event->direction != GDK_SCROLL_DOWN)
+    {
+        return false;
+    }
+
+    // Keep the frame under the pointer in place
+    double relX = event->x / std::max(1, m_DrawArea.get_width());
+    double frameAtPointer = m_View.first + relX * m_View.count;
+
+    m_View.count *= (event->direction == GDK_SCROLL_UP ? 1 / zoomStep : zoomStep);
+    ClampView();
+    m_View.first = frameAtPointer - relX * m_View.count;
+    ClampView();
+
+    m_DrawArea.queue_draw();
+    return true;
+}
+
+bool c_QualityWindow::OnButtonPress(GdkEventButton *event)
+{
+    if (event->button != Utils::Const::MouseButtons::left)
+        return false;
+
+    if (event->type == GDK_2BUTTON_PRESS)
+        ResetView();
+    else
+    {
+        m_Drag.startX = event->x;
+        m_Drag.startFirst = m_View.first;
+    }
+    return true;
+}
+
+bool c_QualityWindow::OnMotion(GdkEventMotion *event)
+{
+    if (!(event->state & GDK_BUTTON1_MASK))
+        return false;
+
+    m_View.first = m_Drag.startFirst - (event->x - m_Drag.startX) / std::max(1, m_DrawArea.get_width()) * m_View.count;
+    ClampView();
+
+    m_DrawArea.queue_draw();
+    return true;
+}
+
 /** Should be called when contents of the previously set job may have changed.
     Redraws the graph. */
 void c_QualityWindow::Update()
 {
     if (m_Job && !m_Job->quality.framesChrono.empty())
     {
-        auto minmaxq = std::minmax_element(m_Job->quality.framesChrono.begin(),
-                                           m_Job->quality.framesChrono.end());
-        m_MinQ = *minmaxq.first;
-        m_MaxQ = *minmaxq.second;
+        const JobStats_t &stats = GetJobStats();
+        m_MinQ = stats.minQ;
+        m_MaxQ = stats.maxQ;
+        m_Histogram = stats.histogram;
+
+        const std::vector<SKRY_quality_t> &framesChrono = m_Job->quality.framesChrono;
+        size_t numPrevFrames = m_ChronoEnvelope.GetSize();
+
+        if (m_EnvelopeJob.lock() != m_Job
+            || m_EnvelopeGeneration != m_Job->quality.generation
+            || numPrevFrames > framesChrono.size())
+        {
+            m_ChronoEnvelope.CreateFromData(framesChrono);
+            m_SortedEnvelopeOutdated = true;
+            m_EnvelopeJob = m_Job;
+            m_EnvelopeGeneration = m_Job->quality.generation;
+            ResetView();
+        }
+        else if (numPrevFrames < framesChrono.size())
+        {
+            // Frames have been appended during quality estimation; if all were shown, keep showing all
+            bool showingAll = (m_View.first == 0 && m_View.count >= std::max(1.0, (double)numPrevFrames - 1));
+
+            m_ChronoEnvelope.AppendData(framesChrono.data() + numPrevFrames, framesChrono.size() - numPrevFrames);
+            m_SortedEnvelopeOutdated = true;
 
-        m_Histogram.CreateFromData(std::min((size_t)Configuration::NumQualityHistogramBins, m_Job->quality.framesChrono.size()),
-                                   m_Job->quality.framesChrono, m_MinQ, m_MaxQ);
+            if (showingAll)
+                ResetView();
+            else
+                ClampView();
+        }
 
         m_JobName.set_text(m_Job->sourcePath);
-        m_Export.set_sensitive(true);
+        m_Export.set_sensitive(IsQualityDataComplete(*m_Job));
     }
     else
     {
+        m_ChronoEnvelope.CreateFromData({ });
+        m_SortedEnvelope.CreateFromData({ });
+        m_SortedEnvelopeOutdated = false;
+        m_EnvelopeJob.reset();
         m_JobName.set_text("");
         m_Export.set_sensitive(false);
     }
@@ -262,3 +422,53 @@ void c_QualityWindow::Update()
     if (is_visible())
         queue_draw();
 }
+
+const c_QualityWindow::JobStats_t &c_QualityWindow::GetJobStats()
+{
+    // Forget the statistics of deleted jobs (their addresses may be reused by new jobs)
+    for (auto it = m_StatsCache.begin(); it != m_StatsCache.end();)
+    {
+        if (it->second.job.expired())
+            it = m_StatsCache.erase(it);
+        else
+            ++it;
+    }
+
+    const std::vector<SKRY_quality_t> &quality = m_Job->quality.framesChrono;
+    size_t numBins = std::min((size_t)Configuration::NumQualityHistogramBins, quality.size());
+
+    JobStats_t &stats = m_StatsCache[m_Job.get()];
+    bool isValid = (stats.job.lock() == m_Job
+                    && stats.qualityGeneration == m_Job->quality.generation
+                    && stats.numBins == numBins
+                    && stats.numFrames <= quality.size());
+
+    if (isValid && stats.numFrames < quality.size())
+    {
+        // New frames have been appended; if they do not extend the quality range, the bins remain valid
+        auto minmaxNew = std::minmax_element(quality.begin() + stats.numFrames, quality.end());
+        if (*minmaxNew.first >= stats.minQ && *minmaxNew.second <= stats.maxQ)
+        {
+            stats.histogram.AddData(quality.data() + stats.numFrames, quality.size() - stats.numFrames,
+                                    stats.minQ, stats.maxQ);
+            stats.numFrames = quality.size();
+        }
+        else
+            isValid = false;
+    }
+
+    if (!isValid)
+    {
+        auto minmaxq = std::minmax_element(quality.begin(), quality.end());
+        stats.minQ = *minmaxq.first;
+        stats.maxQ = *minmaxq.second;
+        stats.histogram.CreateFromData(numBins, quality, stats.minQ, stats.maxQ);
+
+        stats.job = m_Job;
+        stats.qualityGeneration = m_Job->quality.generation;
+        stats.numFrames = quality.size();
+        stats.numBins = numBins;
+    }
+
+    return stats;
+}
@@ -24,6 +24,7 @@ File description:
 #ifndef STACKISTRY_QUALITY_WINDOW_HEADER
 #define STACKISTRY_QUALITY_WINDOW_HEADER
 
+#include <map>
 #include <memory>
 
 #include <gtkmm/button.h>
@@ -47,6 +48,44 @@ private:
     SKRY_quality_t m_MinQ, m_MaxQ;
     Utils::Types::c_Histogram m_Histogram;
 
+    /// Statistics of a job's quality data; recalculated only when the data change
+    /** When frames are appended (during quality estimation), only the new ones are added to the histogram. */
+    struct JobStats_t
+    {
+        std::weak_ptr<Job_t> job;
+        size_t qualityGeneration; ///< Value of 'Job_t::quality.generation' the statistics were calculated for
+        size_t numFrames; ///< Number of frames the statistics include
+        size_t numBins;
+        SKRY_quality_t minQ, maxQ;
+        Utils::Types::c_Histogram histogram;
+    };
+
+    /// Keys are used only for identification and are never dereferenced
+    std::map<const Job_t*, JobStats_t> m_StatsCache;
+
+    /// Used to draw only as many segments as there are pixels across the graph
+    Utils::Types::c_MinMaxPyramid<SKRY_quality_t> m_ChronoEnvelope, m_SortedEnvelope;
+
+    /// Job and quality data the envelopes have been created for
+    std::weak_ptr<Job_t> m_EnvelopeJob;
+    size_t m_EnvelopeGeneration;
+    /// If 'true', 'm_SortedEnvelope' is re-created before drawing (new values can be anywhere in the sorted order)
+    bool m_SortedEnvelopeOutdated;
+
+    /// Visible range of the frame axis
+    struct
+    {
+        double first; ///< Frame index at the left edge of the graph
+        double count; ///< Number of frame intervals across the graph's width
+    } m_View;
+
+    /// State of panning the graph with the mouse
+    struct
+    {
+        double startX; ///< Pointer position when dragging started
+        double startFirst; ///< Value of 'm_View.first' when dragging started
+    } m_Drag;
+
     Gtk::DrawingArea m_DrawArea;
     Gtk::Label m_JobName;
     Gtk::Button m_Export;
@@ -59,10 +98,22 @@ private:
     // Internal signal handlers -------------
 
     bool OnDraw(const Cairo::RefPtr<Cairo::Context>& cr);
+    bool OnScroll(GdkEventScroll *event);
+    bool OnButtonPress(GdkEventButton *event);
+    bool OnMotion(GdkEventMotion *event);
     // --------------------------------------
 
     void InitControls();
 
+    /// Returns cached statistics of the current job's quality data, recalculating them if needed
+    const JobStats_t &GetJobStats();
+
+    /// Shows all frames
+    void ResetView();
+
+    /// Keeps the visible range within the available frames
+    void ClampView();
+
     ExportSignal_t m_ExportSignal;
 
 public:
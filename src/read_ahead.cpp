@@ -0,0 +1,378 @@
+/*
+Stackistry - astronomical image stacking
+Copyright (C) 2016, 2017 Filip Szczerek <ga.software@yahoo.com>
+
+This file is part of Stackistry.
+
+Stackistry is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Stackistry is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Stackistry.  If not, see <http://www.gnu.org/licenses/>.
+
+File description:
+    Frame read-ahead implementation.
+*/
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+#include "read_ahead.h"
+
+
+namespace Worker
+{
+
+/// Size of a single read performed by the read-ahead thread
+const size_t READ_CHUNK_SIZE = 1 << 20;
+
+const size_t NO_FILE = std::numeric_limits<size_t>::max();
+
+/// Location of a frame's data in a video file
+struct VideoFrame_t
+{
+    std::streamoff offset;
+    size_t size;
+};
+
+const size_t SER_HEADER_SIZE = 178;
+const char SER_SIGNATURE[] = "LUCAM-RECORDER";
+/// SER color IDs starting from this value denote 3-channel (RGB or BGR) frames
+const uint32_t SER_FIRST_RGB_COLOR_ID = 100;
+
+const size_t AVI_CHUNK_HEADER_SIZE = 8;
+const size_t AVI_INDEX_ENTRY_SIZE = 16;
+
+static uint32_t GetLE32(const char *bytes)
+{
+    const unsigned char *b = reinterpret_cast<const unsigned char *>(bytes);
+    return (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+/// Fills 'frames' with locations of all frames of a SER file; returns false if 'file' is not a valid SER file
+/** Frames in a SER file have equal size and directly follow the header (an optional trailer follows the frames). */
+static bool GetSerFrames(std::ifstream &file, std::streamoff fileSize, size_t imgCount, std::vector<VideoFrame_t> &frames)
+{
+    char header[SER_HEADER_SIZE];
+    file.clear();
+    if (!file.seekg(0) || !file.read(header, SER_HEADER_SIZE)
+        || 0 != std::memcmp(header, SER_SIGNATURE, sizeof(SER_SIGNATURE) - 1))
+    {
+        return false;
+    }
+
+    uint32_t colorId = GetLE32(header + 18);
+    uint32_t width = GetLE32(header + 26);
+    uint32_t height = GetLE32(header + 30);
+    uint32_t bitsPerChannel = GetLE32(header + 34);
+
+    size_t frameSize = (size_t)width * height
+                       * (colorId >= SER_FIRST_RGB_COLOR_ID ? 3 : 1)
+                       * (bitsPerChannel > 8 ? 2 : 1);
+    if (frameSize == 0 || (std::streamoff)SER_HEADER_SIZE + (std::streamoff)(imgCount * frameSize) > fileSize)
+        return false;
+
+    for (size_t i = 0; i < imgCount; i++)
+        frames.push_back({ (std::streamoff)(SER_HEADER_SIZE + i * frameSize), frameSize });
+
+    return true;
+}
+
+/// Returns true if 'id' is the FOURCC of an AVI video data chunk ("##db" or "##dc")
+static bool IsAviVideoChunk(const char *id)
+{
+    return id[2] == 'd' && (id[3] == 'b' || id[3] == 'c');
+}
+
+static bool ReadAviChunkHeader(std::ifstream &file, std::streamoff pos, char *id, uint32_t &size)
+{
+    char header[AVI_CHUNK_HEADER_SIZE];
+    file.clear();
+    if (!file.seekg(pos) || !file.read(header, AVI_CHUNK_HEADER_SIZE))
+        return false;
+
+    std::memcpy(id, header, 4);
+    size = GetLE32(header + 4);
+    return true;
+}
+
+/// Returns the position of the chunk following the one at 'pos' of size 'size' (chunks are word-aligned)
+static std::streamoff GetNextAviChunk(std::streamoff pos, uint32_t size)
+{
+    return pos + AVI_CHUNK_HEADER_SIZE + size + (size & 1);
+}
+
+/// Appends locations of video chunks from the AVI "movi" list whose contents occupy [pos; end)
+static void ScanAviMoviList(std::ifstream &file, std::streamoff pos, std::streamoff end, std::vector<VideoFrame_t> &frames)
+{
+    char id[4];
+    uint32_t size;
+    while (pos + (std::streamoff)AVI_CHUNK_HEADER_SIZE <= end && ReadAviChunkHeader(file, pos, id, size))
+    {
+        if (0 == std::memcmp(id, "LIST", 4))
+        {
+            // Descend into a "rec " list
+            pos += AVI_CHUNK_HEADER_SIZE + 4;
+            continue;
+        }
+
+        if (IsAviVideoChunk(id))
+            frames.push_back({ pos + (std::streamoff)AVI_CHUNK_HEADER_SIZE, size });
+
+        pos = GetNextAviChunk(pos, size);
+    }
+}
+
+/// Fills 'frames' with locations of all frames of an AVI file; returns false if 'file' is not a valid AVI file
+/** Frame locations are taken from the legacy index ("idx1") if it covers all frames; otherwise (e.g. in
+    OpenDML files exceeding the first RIFF chunk) the chunks of all "movi" lists are scanned. */
+static bool GetAviFrames(std::ifstream &file, std::streamoff fileSize, size_t imgCount, std::vector<VideoFrame_t> &frames)
+{
+    char id[4];
+    uint32_t size;
+    char listType[4];
+
+    if (!ReadAviChunkHeader(file, 0, id, size) || 0 != std::memcmp(id, "RIFF", 4)
+        || !file.read(listType, 4) || 0 != std::memcmp(listType, "AVI ", 4))
+    {
+        return false;
+    }
+
+    /// Contents of "movi" lists: position of the "movi" FOURCC and end
+    std::vector<std::pair<std::streamoff, std::streamoff>> moviLists;
+    std::vector<char> index;
+
+    std::streamoff pos = AVI_CHUNK_HEADER_SIZE + 4;
+    while (pos + (std::streamoff)AVI_CHUNK_HEADER_SIZE <= fileSize && ReadAviChunkHeader(file, pos, id, size))
+    {
+        if (0 == std::memcmp(id, "RIFF", 4))
+        {
+            // Descend into an "AVIX" extension of an OpenDML file
+            pos += AVI_CHUNK_HEADER_SIZE + 4;
+            continue;
+        }
+        else if (0 == std::memcmp(id, "LIST", 4))
+        {
+            if (file.read(listType, 4) && 0 == std::memcmp(listType, "movi", 4))
+                moviLists.push_back({ pos + (std::streamoff)AVI_CHUNK_HEADER_SIZE,
+                                      std::min(pos + (std::streamoff)AVI_CHUNK_HEADER_SIZE + size, fileSize) });
+        }
+        else if (0 == std::memcmp(id, "idx1", 4) && index.empty() && pos + (std::streamoff)AVI_CHUNK_HEADER_SIZE + size <= fileSize)
+        {
+            index.resize(size);
+            if (!file.read(index.data(), size))
+                index.clear();
+        }
+
+        pos = GetNextAviChunk(pos, size);
+    }
+
+    if (moviLists.empty())
+        return false;
+
+    if (!index.empty())
+    {
+        for (size_t i = 0; i + AVI_INDEX_ENTRY_SIZE <= index.size(); i += AVI_INDEX_ENTRY_SIZE)
+            if (IsAviVideoChunk(&index[i]))
+                frames.push_back({ (std::streamoff)GetLE32(&index[i + 8]), GetLE32(&index[i + 12]) });
+
+        // Index offsets point at chunk headers and are usually relative to the first "movi" FOURCC,
+        // but can also be absolute; check which one matches the first indexed chunk
+        bool indexValid = false;
+        if (frames.size() == imgCount && imgCount > 0)
+        {
+            for (std::streamoff base: { moviLists[0].first, (std::streamoff)0 })
+                if (ReadAviChunkHeader(file, base + frames[0].offset, id, size) && IsAviVideoChunk(id))
+                {
+                    for (VideoFrame_t &frame: frames)
+                        frame.offset += base + AVI_CHUNK_HEADER_SIZE;
+                    indexValid = true;
+                    break;
+                }
+        }
+
+        if (indexValid)
+            return true;
+
+        frames.clear();
+    }
+
+    for (auto &movi: moviLists)
+        ScanAviMoviList(file, movi.first + 4, movi.second, frames);
+
+    return frames.size() == imgCount;
+}
+
+c_ReadAhead::c_ReadAhead(const Job_t &job, size_t bufferSize)
+: m_BufferSize(bufferSize), m_OpenFileIdx(NO_FILE)
+{
+    const uint8_t *activeFlags = job.imgSeq.GetImgActiveFlags();
+    size_t imgCount = job.imgSeq.GetImageCount();
+
+    if (job.imgSeq.GetType() == SKRY_IMG_SEQ_IMAGE_FILES)
+    {
+        if (job.sourceFileNames.size() != imgCount)
+            return;
+
+        m_FileNames = job.sourceFileNames;
+        for (size_t i = 0; i < imgCount; i++)
+            if (activeFlags[i])
+                m_Frames.push_back({ i, i, 0, 0, 0 });
+    }
+    else
+    {
+        // Frame locations are taken from the container's structure; for other formats (decoded by libav)
+        // they are not known without demuxing, so such videos are not read ahead
+        std::ifstream file(job.sourcePath, std::ios_base::in | std::ios_base::binary);
+        if (!file || !file.seekg(0, std::ios_base::end))
+            return;
+
+        std::streamoff fileSize = file.tellg();
+        if (fileSize <= 0 || imgCount == 0)
+            return;
+
+        std::vector<VideoFrame_t> frames;
+        if (!GetSerFrames(file, fileSize, imgCount, frames))
+        {
+            frames.clear();
+            if (!GetAviFrames(file, fileSize, imgCount, frames))
+                return;
+        }
+
+        m_FileNames.push_back(job.sourcePath);
+        for (size_t i = 0; i < imgCount; i++)
+            if (activeFlags[i] && frames[i].size > 0) // empty chunks denote dropped frames
+                m_Frames.push_back({ i, 0, frames[i].offset, frames[i].size, 0 });
+    }
+
+    if (!m_Frames.empty() && m_BufferSize > 0)
+        m_Thread = Glib::Threads::Thread::create(sigc::mem_fun(*this, &c_ReadAhead::ThreadFunc));
+}
+
+c_ReadAhead::~c_ReadAhead()
+{
+    if (m_Thread)
+    {
+        { Glib::Threads::Mutex::Lock lock(m_Mtx);
+            m_Finish = true;
+            m_Cond.signal();
+        }
+        m_Thread->join();
+    }
+}
+
+void c_ReadAhead::Restart()
+{
+    Glib::Threads::Mutex::Lock lock(m_Mtx);
+
+    m_CurrentFrame = 0;
+    m_NextFrame = 1;
+    m_BytesAhead = 0;
+    m_Generation++;
+    m_Cond.signal();
+}
+
+void c_ReadAhead::SetCurrentImage(size_t imgIdx)
+{
+    auto frame = std::lower_bound(m_Frames.begin(), m_Frames.end(), imgIdx,
+                                  [](const FrameLocation_t &f, size_t idx) { return f.imgIdx < idx; });
+    size_t newCurrent = frame - m_Frames.begin();
+
+    Glib::Threads::Mutex::Lock lock(m_Mtx);
+
+    if (newCurrent <= m_CurrentFrame)
+        return;
+
+    if (newCurrent >= m_NextFrame)
+    {
+        // Processing has caught up with reading ahead
+        m_NextFrame = newCurrent + 1;
+        m_BytesAhead = 0;
+    }
+    else
+    {
+        // The new current frame is no longer ahead either
+        for (size_t i = m_CurrentFrame + 1; i <= newCurrent; i++)
+            m_BytesAhead -= m_Frames[i].bytesAhead;
+    }
+    m_CurrentFrame = newCurrent;
+    m_Cond.signal();
+}
+
+void c_ReadAhead::ThreadFunc()
+{
+    m_ReadBuf.resize(READ_CHUNK_SIZE);
+
+    Glib::Threads::Mutex::Lock lock(m_Mtx);
+    while (true)
+    {
+        while (!m_Finish && (m_NextFrame >= m_Frames.size() || m_BytesAhead >= m_BufferSize))
+            m_Cond.wait(m_Mtx);
+
+        if (m_Finish)
+            break;
+
+        size_t frameIdx = m_NextFrame;
+        size_t generation = m_Generation;
+        FrameLocation_t frame = m_Frames[frameIdx];
+
+        lock.release();
+        size_t bytesRead = ReadFrame(frame);
+        lock.acquire();
+
+        if (frame.size == 0)
+            m_Frames[frameIdx].size = bytesRead;
+
+        if (generation == m_Generation && frameIdx == m_NextFrame)
+        {
+            m_NextFrame++;
+            m_Frames[frameIdx].bytesAhead = bytesRead;
+            m_BytesAhead += bytesRead;
+        }
+    }
+
+    m_File.close();
+}
+
+size_t c_ReadAhead::ReadFrame(const FrameLocation_t &frame)
+{
+    if (frame.fileIdx != m_OpenFileIdx)
+    {
+        m_File.close();
+        m_File.clear();
+        m_File.open(m_FileNames[frame.fileIdx], std::ios_base::in | std::ios_base::binary);
+        m_OpenFileIdx = frame.fileIdx;
+    }
+    else
+        m_File.clear();
+
+    if (!m_File || !m_File.seekg(frame.offset))
+        return 0;
+
+    size_t bytesRead = 0;
+    while (frame.size == 0 || bytesRead < frame.size)
+    {
+        size_t toRead = READ_CHUNK_SIZE;
+        if (frame.size != 0)
+            toRead = std::min(toRead, frame.size - bytesRead);
+
+        m_File.read(m_ReadBuf.data(), toRead);
+        bytesRead += m_File.gcount();
+        if (!m_File)
+            break;
+    }
+
+    return bytesRead;
+}
+
+} // namespace Worker
@@ -0,0 +1,111 @@
+/*
+Stackistry - astronomical image stacking
+Copyright (C) 2016, 2017 Filip Szczerek <ga.software@yahoo.com>
+
+This file is part of Stackistry.
+
+Stackistry is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+Stackistry is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Stackistry.  If not, see <http://www.gnu.org/licenses/>.
+
+File description:
+    Frame read-ahead header.
+*/
+
+#ifndef STACKISTRY_READ_AHEAD_HEADER
+#define STACKISTRY_READ_AHEAD_HEADER
+
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <glibmm/threads.h>
+
+#include "job.h"
+
+
+namespace Worker
+{
+    /// Reads the source data of a job's upcoming frames in a background thread
+    /** Frames are read and decoded by libskry during each processing step; the read-ahead
+        thread loads the data of active frames following the current one into the operating
+        system's file cache, so that disk reads overlap with processing. At most 'bufferSize'
+        bytes of frame data are read ahead of the current frame. Frames are not decoded in advance,
+        as libskry cannot accept already decoded frames.
+
+        Frames of videos are located using the container's structure (frame size and header of SER,
+        the index or chunks of AVI); videos in other formats are not read ahead.
+
+        Must be created and used by the thread which performs the processing. */
+    class c_ReadAhead
+    {
+    public:
+        c_ReadAhead(const Job_t &job, size_t bufferSize);
+        c_ReadAhead(const c_ReadAhead &) = delete;
+        c_ReadAhead &operator=(const c_ReadAhead &) = delete;
+
+        /// Stops the read-ahead thread
+        ~c_ReadAhead();
+
+        /// Continues reading ahead from the first active frame; to be called before each pass over the image sequence
+        void Restart();
+
+        /// Indicates the frame being processed ('imgIdx': absolute index in the image sequence)
+        void SetCurrentImage(size_t imgIdx);
+
+    private:
+        struct FrameLocation_t
+        {
+            size_t imgIdx; ///< Absolute index in the image sequence
+            size_t fileIdx; ///< Index in 'm_FileNames'
+            std::streamoff offset;
+            /// Amount of data to read; if 0, the whole file is read (and its size stored here afterwards)
+            size_t size;
+            /// Amount of data read ahead during the current pass (included in 'm_BytesAhead')
+            size_t bytesAhead;
+        };
+
+        std::vector<std::string> m_FileNames;
+
+        /// Locations of active frames in sequence order
+        std::vector<FrameLocation_t> m_Frames;
+
+        size_t m_BufferSize;
+
+        /// Index in 'm_Frames' of the frame being processed
+        size_t m_CurrentFrame = 0;
+        /// Index in 'm_Frames' of the next frame to read ahead; the frame being processed is read by libskry itself
+        size_t m_NextFrame = 1;
+        /// Amount of frame data read ahead of 'm_CurrentFrame', i.e. of frames after it and before 'm_NextFrame'
+        size_t m_BytesAhead = 0;
+        /// Incremented on each Restart(); used to discard a frame read in the meantime
+        size_t m_Generation = 0;
+        bool m_Finish = false;
+
+        Glib::Threads::Mutex m_Mtx; ///< Access guard for the variables above
+        Glib::Threads::Cond m_Cond; ///< Signaled when the read-ahead thread may continue
+        Glib::Threads::Thread *m_Thread = nullptr;
+
+        // Used only by the read-ahead thread
+        std::ifstream m_File;
+        size_t m_OpenFileIdx;
+        std::vector<char> m_ReadBuf;
+
+        void ThreadFunc();
+
+        /// Returns the number of bytes read
+        size_t ReadFrame(const FrameLocation_t &frame);
+    };
+}
+
+#endif // STACKISTRY_READ_AHEAD_HEADER
@@ -32,6 +32,7 @@ File description:
 #include <gtkmm/textview.h>
 
 #include "config.h"
+#include "frame_cache.h"
 #include "settings_dlg.h"
 #include "utils.h"
 
@@ -93,7 +94,7 @@ c_SettingsDlg::c_SettingsDlg(const std::vector<std::string> &jobNames, const Job
     size_t index = 0;
     for (auto &descr: Utils::Vars::outputFormatDescription)
     {
-        if (descr.skryOutpFmt == firstJob.outputFmt)
+        if (descr.outputFmt == firstJob.outputFmt)
             m_AutoSaveOutputFormat.set_active(index);
         else
             index++;
@@ -145,11 +146,12 @@ void c_SettingsDlg::ApplySettings(Job_t &job)
     job.flatFieldFileName = m_FlatFieldChooser.get_filename();
     job.quality.criterion = (enum SKRY_quality_criterion)m_QualityCriterion.get_active_row_number();
     job.quality.threshold = m_QualityThreshold.get_value_as_int();
-    job.outputFmt = Utils::Vars::outputFormatDescription[m_AutoSaveOutputFormat.get_active_row_number()].skryOutpFmt;
+    job.outputFmt = Utils::Vars::outputFormatDescription[m_AutoSaveOutputFormat.get_active_row_number()].outputFmt;
     job.cfaPattern = m_TreatMonoAsCFA.get_active()
                      ? (enum SKRY_CFA_pattern)m_CFAPattern.get_active_row_number()
                      : SKRY_CFA_NONE;
     job.imgSeq.ReinterpretAsCFA(job.cfaPattern);
+    FrameCache::Invalidate(job.frameCacheId);
 
     job.automaticAnchorPlacement = (m_VideoStbAnchorsMode.get_active_row_number() == 0);
     if (job.automaticAnchorPlacement)
@@ -316,7 +318,7 @@ void c_SettingsDlg::InitControls(const std::vector<std::string> &jobNames)
         Gtk::PackOptions::PACK_SHRINK, Utils::Const::widgetPaddingInPixels);
 
     m_ExportQualityData.set_label(_("Export frame quality data"));
-    m_ExportQualityData.set_tooltip_text(_("Save frame quality data to a text file in the same location as the image stack"));
+    m_ExportQualityData.set_tooltip_text(_("Save frame quality data to a file (text or binary, see Preferences) in the same location as the image stack"));
     m_ExportQualityData.show();
     get_content_area()->pack_start(m_ExportQualityData, Gtk::PackOptions::PACK_SHRINK, Utils::Const::widgetPaddingInPixels);
 
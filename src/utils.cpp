@@ -21,7 +21,10 @@ File description:
     Utility functions implementation.
 */
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <cstdint>
 #include <cstring>
 #include <iostream>
 #include <memory>
@@ -30,9 +33,12 @@ File description:
 #include <cairomm/surface.h>
 #include <glibmm/i18n.h>
 #include <glibmm/miscutils.h>
+#ifndef STACKISTRY_HEADLESS
 #include <gtkmm/cssprovider.h>
 
 #include "config.h"
+#endif
+#include "output_fmt.h"
 #include "utils.h"
 
 
@@ -68,6 +74,129 @@ Cairo::RefPtr<Cairo::ImageSurface> ConvertImgToSurface(const libskry::c_Image &i
     return surface;
 }
 
+/// Indices of color channels used by DownscaleImgToSurface()
+enum { CH_RED = 0, CH_GREEN, CH_BLUE };
+
+/// Adds the channel values of pixels [x0; x1) of an interleaved line to 'sum'
+template <typename T, size_t NumChannels, size_t RIdx, size_t GIdx, size_t BIdx>
+static void AccumulateLine(const void *line, unsigned x0, unsigned x1, float sum[3], unsigned /*y*/, const unsigned * /*cfaChannel*/, unsigned count[3])
+{
+    const T *pix = static_cast<const T *>(line) + x0 * NumChannels;
+    float r = 0, g = 0, b = 0;
+    for (unsigned x = x0; x < x1; x++, pix += NumChannels)
+    {
+        r += pix[RIdx];
+        g += pix[GIdx];
+        b += pix[BIdx];
+    }
+    sum[CH_RED] += r;
+    sum[CH_GREEN] += g;
+    sum[CH_BLUE] += b;
+    for (size_t ch = 0; ch < 3; ch++)
+        count[ch] += x1 - x0;
+}
+
+/// Adds the values of pixels [x0; x1) of a raw color line to the corresponding channels of 'sum'
+/** 'cfaChannel' element [2*(y%2) + x%2]: color channel of pixel (x, y). */
+template <typename T>
+static void AccumulateCfaLine(const void *line, unsigned x0, unsigned x1, float sum[3], unsigned y, const unsigned *cfaChannel, unsigned count[3])
+{
+    const T *pix = static_cast<const T *>(line);
+    const unsigned *rowChannel = cfaChannel + 2 * (y & 1);
+    for (unsigned x = x0; x < x1; x++)
+    {
+        sum[rowChannel[x & 1]] += pix[x];
+        count[rowChannel[x & 1]]++;
+    }
+}
+
+typedef void AccumulateLineFunc_t(const void *line, unsigned x0, unsigned x1, float sum[3], unsigned y, const unsigned *cfaChannel, unsigned count[3]);
+
+Cairo::RefPtr<Cairo::ImageSurface> DownscaleImgToSurface(const libskry::c_Image &img, const struct SKRY_rect &rect, double zoomFactor)
+{
+    if (zoomFactor >= 1.0 || zoomFactor <= 0.0)
+        return Cairo::RefPtr<Cairo::ImageSurface>(nullptr);
+
+    AccumulateLineFunc_t *accumulateLine = nullptr;
+    float scale = 1.0f; ///< Converts the channel values to [0; 255]
+    unsigned cfaChannel[4] = { };
+
+    enum SKRY_pixel_format pixFmt = img.GetPixelFormat();
+    switch (pixFmt)
+    {
+    case SKRY_PIX_MONO8:   accumulateLine = AccumulateLine<uint8_t,  1, 0, 0, 0>; break;
+    case SKRY_PIX_MONO16:  accumulateLine = AccumulateLine<uint16_t, 1, 0, 0, 0>; scale = 1.0f/257; break;
+    case SKRY_PIX_MONO32F: accumulateLine = AccumulateLine<float,    1, 0, 0, 0>; scale = 255.0f; break;
+    case SKRY_PIX_RGB8:    accumulateLine = AccumulateLine<uint8_t,  3, 0, 1, 2>; break;
+    case SKRY_PIX_RGB16:   accumulateLine = AccumulateLine<uint16_t, 3, 0, 1, 2>; scale = 1.0f/257; break;
+    case SKRY_PIX_RGB32F:  accumulateLine = AccumulateLine<float,    3, 0, 1, 2>; scale = 255.0f; break;
+    case SKRY_PIX_BGRA8:   accumulateLine = AccumulateLine<uint8_t,  4, 2, 1, 0>; break;
+
+    case SKRY_PIX_CFA_RGGB8:  case SKRY_PIX_CFA_GRBG8:  case SKRY_PIX_CFA_GBRG8:  case SKRY_PIX_CFA_BGGR8:
+    case SKRY_PIX_CFA_RGGB16: case SKRY_PIX_CFA_GRBG16: case SKRY_PIX_CFA_GBRG16: case SKRY_PIX_CFA_BGGR16:
+        {
+            // Each destination pixel has to cover at least one 2x2 block of the color filter array
+            if (zoomFactor > 0.5)
+                return Cairo::RefPtr<Cairo::ImageSurface>(nullptr);
+
+            const unsigned patterns[4][4] = { { CH_RED, CH_GREEN, CH_GREEN, CH_BLUE },    // RGGB
+                                              { CH_GREEN, CH_RED, CH_BLUE, CH_GREEN },    // GRBG
+                                              { CH_GREEN, CH_BLUE, CH_RED, CH_GREEN },    // GBRG
+                                              { CH_BLUE, CH_GREEN, CH_GREEN, CH_RED } };
+            bool is8bit = (pixFmt <= SKRY_PIX_CFA_BGGR8);
+            const unsigned *pattern = patterns[is8bit ? pixFmt - SKRY_PIX_CFA_RGGB8 : pixFmt - SKRY_PIX_CFA_RGGB16];
+            std::copy(pattern, pattern + 4, cfaChannel);
+
+            if (is8bit)
+                accumulateLine = AccumulateCfaLine<uint8_t>;
+            else
+            {
+                accumulateLine = AccumulateCfaLine<uint16_t>;
+                scale = 1.0f/257;
+            }
+        }
+        break;
+
+    default: return Cairo::RefPtr<Cairo::ImageSurface>(nullptr);
+    }
+
+    unsigned destWidth = std::max(1u, (unsigned)(zoomFactor * rect.width));
+    unsigned destHeight = std::max(1u, (unsigned)(zoomFactor * rect.height));
+
+    // Element [i]: the first source column (row) of destination column (row) 'i'; the last element is the end of 'rect'
+    std::vector<unsigned> srcX(destWidth + 1), srcY(destHeight + 1);
+    for (unsigned i = 0; i <= destWidth; i++)
+        srcX[i] = rect.x + (unsigned)((uint64_t)i * rect.width / destWidth);
+    for (unsigned i = 0; i <= destHeight; i++)
+        srcY[i] = rect.y + (unsigned)((uint64_t)i * rect.height / destHeight);
+
+    Cairo::RefPtr<Cairo::ImageSurface> surface = Cairo::ImageSurface::create(Cairo::Format::FORMAT_RGB24, destWidth, destHeight);
+    surface->flush();
+
+    for (unsigned destY = 0; destY < destHeight; destY++)
+    {
+        uint32_t *destLine = reinterpret_cast<uint32_t *>(surface->get_data() + destY * surface->get_stride());
+
+        for (unsigned destX = 0; destX < destWidth; destX++)
+        {
+            float sum[3] = { 0, 0, 0 };
+            unsigned count[3] = { 0, 0, 0 };
+
+            for (unsigned y = srcY[destY]; y < srcY[destY + 1]; y++)
+                accumulateLine(img.GetLine(y), srcX[destX], srcX[destX + 1], sum, y, cfaChannel, count);
+
+            uint32_t value[3];
+            for (size_t ch = 0; ch < 3; ch++)
+                value[ch] = (uint32_t)std::min(255.0f, std::max(0.0f, count[ch] ? scale * sum[ch] / count[ch] + 0.5f : 0.0f));
+
+            destLine[destX] = (value[CH_RED] << 16) | (value[CH_GREEN] << 8) | value[CH_BLUE];
+        }
+    }
+    surface->mark_dirty();
+
+    return surface;
+}
+
 Cairo::Rectangle DrawAnchorPoint(const Cairo::RefPtr<Cairo::Context> &cr, int x, int y)
 {
     cr->set_source_rgb(0.5, 0.2, 1);
@@ -92,9 +221,13 @@ void EnumerateSupportedOutputFmts()
 
     for (size_t i = 0; i < numFmts; i++)
     {
+        OutputFormat outputFmt = OutputFmt::FromSkryFormat((enum SKRY_output_format)supportedFmts[i]);
+        if (outputFmt == OutputFormat::INVALID)
+            continue; // not known to this version of Stackistry
+
         Vars::outputFormatDescription.push_back(Vars::OutputFormatDescr_t());
         Vars::OutputFormatDescr_t &descr = Vars::outputFormatDescription.back();
-        descr.skryOutpFmt = (enum SKRY_output_format)supportedFmts[i];
+        descr.outputFmt = outputFmt;
 
         switch (supportedFmts[i])
         {
@@ -117,8 +250,17 @@ void EnumerateSupportedOutputFmts()
             break;
         }
     }
+
+    // Formats implemented by Stackistry
+    Vars::outputFormatDescription.push_back({ OutputFormat::TIFF_16_DEFLATE, _("TIFF 16-bit (deflate-compressed)"),
+                                              { "*.tif", "*.tiff" }, ".tif" });
+    Vars::outputFormatDescription.push_back({ OutputFormat::PNG_16, _("PNG 16-bit"), { "*.png" }, ".png" });
+    Vars::outputFormatDescription.push_back({ OutputFormat::TIFF_32F, _("TIFF 32-bit floating-point"), { "*.tif", "*.tiff" }, ".tif" });
+    Vars::outputFormatDescription.push_back({ OutputFormat::FITS_32F, _("FITS 32-bit floating-point"), { "*.fits", "*.fit", "*.fts" }, ".fits" });
 }
 
+#ifndef STACKISTRY_HEADLESS
+
 void RestorePosSize(const Gdk::Rectangle &posSize, Gtk::Window &wnd)
 {
     //TODO: check if visible on any screen
@@ -137,12 +279,14 @@ void SavePosSize(const Gtk::Window &wnd, c_Property<Gdk::Rectangle> &destination
     destination = posSize;
 }
 
-enum SKRY_pixel_format FindMatchingFormat(enum SKRY_output_format outputFmt, size_t numChannels)
+#endif // STACKISTRY_HEADLESS
+
+enum SKRY_pixel_format FindMatchingFormat(OutputFormat outputFmt, size_t numChannels)
 {
     for (int i = SKRY_PIX_INVALID+1; i < SKRY_NUM_PIX_FORMATS; i++)
         if (i != SKRY_PIX_PAL8
             && NUM_CHANNELS[i] == numChannels
-            && OUTPUT_FMT_BITS_PER_CHANNEL[outputFmt] == BITS_PER_CHANNEL[i])
+            && OutputFmt::GetBitsPerChannel(outputFmt) == BITS_PER_CHANNEL[i])
         {
             return (SKRY_pixel_format)i;
         }
@@ -150,17 +294,19 @@ enum SKRY_pixel_format FindMatchingFormat(enum SKRY_output_format outputFmt, siz
     return SKRY_PIX_INVALID;
 }
 
-const Vars::OutputFormatDescr_t &GetOutputFormatDescr(enum SKRY_output_format outpFmt)
+const Vars::OutputFormatDescr_t &GetOutputFormatDescr(OutputFormat outpFmt)
 {
     for (auto &descr: Vars::outputFormatDescription)
     {
-        if (descr.skryOutpFmt == outpFmt)
+        if (descr.outputFmt == outpFmt)
             return descr;
     }
 
     assert(0);
 }
 
+#ifndef STACKISTRY_HEADLESS
+
 Glib::RefPtr<Gdk::Pixbuf> LoadIconFromFile(const char *fileName, int width, int height)
 {
     try
@@ -177,6 +323,8 @@ Glib::RefPtr<Gdk::Pixbuf> LoadIconFromFile(const char *fileName, int width, int
     return Glib::RefPtr<Gdk::Pixbuf>(nullptr);
 }
 
+#endif // STACKISTRY_HEADLESS
+
 void SetAppLaunchPath(const char *appLaunchPath)
 {
     Vars::appLaunchPath = appLaunchPath;
@@ -234,6 +382,14 @@ Cairo::Filter GetFilter(Const::InterpolationMethod interpolationMethod)
     return cairoFilter[(int)interpolationMethod];
 }
 
+double ClockSec()
+{
+    return 1.0/1000000 * std::chrono::duration_cast<std::chrono::microseconds>
+               (std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+}
+
+#ifndef STACKISTRY_HEADLESS
+
 void SetBackgroundColor(Gtk::Widget &w, const Gdk::RGBA &color)
 {
     Glib::RefPtr<Gtk::CssProvider> css = Gtk::CssProvider::create();
@@ -251,4 +407,6 @@ void SetColor(const Cairo::RefPtr<Cairo::Context> &cr, const GdkRGBA &color)
     cr->set_source_rgba(color.red, color.green, color.blue, color.alpha);
 }
 
+#endif // STACKISTRY_HEADLESS
+
 }
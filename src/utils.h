@@ -31,13 +31,18 @@ File description:
 #include <vector>
 
 #include <cairomm/context.h>
+#include <glibmm/ustring.h>
+#ifndef STACKISTRY_HEADLESS
 #include <gdkmm/pixbuf.h>
 #include <gdkmm/rgba.h>
 #include <gdkmm/rectangle.h>
 #include <gtkmm/box.h>
 #include <gtkmm/window.h>
+#endif
 #include <skry/skry_cpp.hpp>
 
+#include "output_fmt.h"
+
 
 namespace Utils
 {
@@ -80,20 +85,38 @@ namespace Types
         template<typename T>
         void CreateFromData(size_t numBins, const std::vector<T> &vals, T valMin, T valMax)
         {
-            assert(valMax >= valMin);
             Bins.assign(numBins, 0);
+            MaxBinCount = 0;
+            AddData(vals.data(), vals.size(), valMin, valMax);
+        }
 
-            for (const T &v: vals)
+        /// Adds 'count' values to the bins; 'valMin' and 'valMax' have to be the same as passed to CreateFromData()
+        template<typename T>
+        void AddData(const T *vals, size_t count, T valMin, T valMax)
+        {
+            assert(valMax >= valMin);
+            const size_t numBins = Bins.size();
+            if (numBins == 0)
+                return;
+
+            // Bin indices are calculated in chunks by a branch-free loop (so that the compiler
+            // can vectorize it), then the bins are incremented in a separate pass
+            const size_t CHUNK_LEN = 256;
+            std::array<T, CHUNK_LEN> binIdx;
+            const T scale = (valMax > valMin) ? static_cast<T>(numBins) / (valMax - valMin) : T(0);
+            const T lastBin = static_cast<T>(numBins - 1);
+
+            for (size_t chunkStart = 0; chunkStart < count; chunkStart += CHUNK_LEN)
             {
-                size_t binIdx;
-                if (v == valMin)
-                    binIdx = 0;
-                else if (v == valMax)
-                    binIdx = numBins - 1;
-                else
-                    binIdx = static_cast<size_t>((v - valMin) / (valMax - valMin) * numBins);
-
-                Bins[binIdx]++;
+                const size_t chunkLen = std::min(CHUNK_LEN, count - chunkStart);
+                const T *v = vals + chunkStart;
+
+                for (size_t i = 0; i < chunkLen; i++)
+                    binIdx[i] = std::min((v[i] - valMin) * scale, lastBin);
+
+                for (size_t i = 0; i < chunkLen; i++)
+                    if (v[i] >= valMin && v[i] <= valMax)
+                        Bins[static_cast<size_t>(binIdx[i])]++;
             }
 
             MaxBinCount = *std::max_element(Bins.begin(), Bins.end());
@@ -103,6 +126,83 @@ namespace Types
 
         const std::vector<size_t> &GetBins() const { return Bins; }
     };
+
+    /// Min/max envelope pyramid of a sequence of values
+    /** Level 0 contains the values themselves; each element of level k+1 holds the min. and max.
+        of two elements of level k. Allows finding the min. and max. of any range of values in O(log n). */
+    template<typename T>
+    class c_MinMaxPyramid
+    {
+        std::vector<std::vector<std::pair<T, T>>> Levels;
+
+    public:
+
+        void CreateFromData(const std::vector<T> &vals)
+        {
+            Levels.clear();
+            AppendData(vals.data(), vals.size());
+        }
+
+        /// Appends values at the end; only the elements of higher levels covering the new values are updated
+        void AppendData(const T *vals, size_t count)
+        {
+            if (Levels.empty())
+                Levels.emplace_back();
+
+            size_t firstChanged = Levels[0].size();
+            for (size_t i = 0; i < count; i++)
+                Levels[0].emplace_back(vals[i], vals[i]);
+
+            for (size_t level = 0; Levels[level].size() > 1; level++)
+            {
+                if (level + 1 == Levels.size())
+                    Levels.emplace_back();
+
+                const std::vector<std::pair<T, T>> &prev = Levels[level];
+                std::vector<std::pair<T, T>> &next = Levels[level + 1];
+
+                firstChanged /= 2;
+                next.resize((prev.size() + 1) / 2);
+                for (size_t i = firstChanged; i < next.size(); i++)
+                {
+                    next[i] = prev[2*i];
+                    if (2*i + 1 < prev.size())
+                    {
+                        next[i].first = std::min(next[i].first, prev[2*i + 1].first);
+                        next[i].second = std::max(next[i].second, prev[2*i + 1].second);
+                    }
+                }
+            }
+        }
+
+        size_t GetSize() const { return Levels.empty() ? 0 : Levels[0].size(); }
+
+        /// Returns the min. and max. of values [first; last); the range must not be empty
+        std::pair<T, T> GetMinMax(size_t first, size_t last) const
+        {
+            assert(first < last && last <= GetSize());
+
+            std::pair<T, T> result = Levels[0][first];
+            for (size_t level = 0; first < last; level++, first /= 2, last /= 2)
+            {
+                // Elements not covered by a whole element of the next level are combined at this level
+                if (first % 2)
+                {
+                    result.first = std::min(result.first, Levels[level][first].first);
+                    result.second = std::max(result.second, Levels[level][first].second);
+                    first++;
+                }
+                if (last % 2)
+                {
+                    last--;
+                    result.first = std::min(result.first, Levels[level][last].first);
+                    result.second = std::max(result.second, Levels[level][last].second);
+                }
+            }
+
+            return result;
+        }
+    };
 }
 
 namespace Const
@@ -122,10 +222,34 @@ namespace Const
 
     const size_t MaxQualityHistogramBins = 2048;
 
+    /// Max. rate at which processing visualization images are rendered
+    const double maxVisualizationFPS = 25.0;
+
+    /// Upper limit of the number of jobs processed concurrently
+    const size_t MaxConcurrentJobsLimit = 16;
+
+    /// Upper limit of the frame read-ahead buffer size (in MiB)
+    const size_t MaxReadAheadBufferSizeMB = 4096;
+
+    /// Upper limit of the decoded frame cache size (in MiB)
+    const size_t MaxFrameCacheSizeMB = 256*1024;
+
+    /// Upper limit of the max. number of progress notifications per second
+    const unsigned MaxNotificationRateLimit = 1000;
+
+    /// Max. number of stacked images waiting to be written by c_OutputWriter
+    const size_t MaxQueuedOutputs = 4;
+
+    /// Max. number of finished jobs whose checkpoint (Job_t::checkpoint) is kept in memory
+    const size_t MaxRetainedCheckpoints = 4;
+
+    /// Number of frames decoded in advance by c_FrameLoader when browsing a sequence
+    const size_t NumPrefetchedFrames = 4;
+
     namespace Defaults
     {
         const OutputSaveMode saveMode = SOURCE_PATH;
-        const enum SKRY_output_format outputFmt = SKRY_TIFF_16;
+        const OutputFormat outputFmt = OutputFormat::TIFF_16;
         const enum SKRY_img_alignment_method alignmentMethod = SKRY_IMG_ALGN_ANCHORS;
         const int referencePointSpacing = 40; ///< Value in pixels
         const float placementBrightnessThreshold = 0.33f;
@@ -137,6 +261,10 @@ namespace Const
         const unsigned refPtStructureScale = 1;
         const float refPtStructureThreshold = 1.2;
         const size_t NumQualityHistogramBins = 32;
+        const size_t MaxConcurrentJobs = 1;
+        const size_t ReadAheadBufferSizeMB = 64;
+        const size_t FrameCacheSizeMB = 512;
+        const unsigned MaxNotificationRate = 20; ///< Value in notifications per second
     }
 
     struct Language_t
@@ -159,7 +287,7 @@ namespace Vars
 {
     struct OutputFormatDescr_t
     {
-        enum SKRY_output_format skryOutpFmt;
+        OutputFormat outputFmt;
         Glib::ustring name;
         std::vector<Glib::ustring> patterns;
         std::string defaultExtension;
@@ -172,27 +300,41 @@ namespace Vars
 
 Cairo::RefPtr<Cairo::ImageSurface> ConvertImgToSurface(const libskry::c_Image &img);
 
+/// Converts the fragment 'rect' of 'img' to a surface downscaled by 'zoomFactor' in a single pass
+/** Each destination pixel is the average of the corresponding box of source pixels; raw color
+    images are averaged per color channel (without demosaicing). Supported formats: MONO8/16/32F,
+    RGB8/16/32F, BGRA8 and CFA (the latter requires 'zoomFactor' <= 0.5). Returns null if
+    'zoomFactor' >= 1 or the format is not supported. */
+Cairo::RefPtr<Cairo::ImageSurface> DownscaleImgToSurface(const libskry::c_Image &img, const struct SKRY_rect &rect, double zoomFactor);
+
 /// Returns the affected area of 'cr' (can be used for e.g. selective refresh on screen)
 Cairo::Rectangle DrawAnchorPoint(const Cairo::RefPtr<Cairo::Context> &cr, int x, int y);
 
 void EnumerateSupportedOutputFmts();
 
-void SavePosSize(const Gtk::Window &wnd, Types::c_Property<Gdk::Rectangle> &destination);
-void RestorePosSize(const Gdk::Rectangle &posSize, Gtk::Window &wnd);
-
-enum SKRY_pixel_format FindMatchingFormat(enum SKRY_output_format outputFmt, size_t numChannels);
+enum SKRY_pixel_format FindMatchingFormat(OutputFormat outputFmt, size_t numChannels);
 
-const Vars::OutputFormatDescr_t &GetOutputFormatDescr(enum SKRY_output_format);
-
-/// Loads specified file from the 'icons' subdirectory
-Glib::RefPtr<Gdk::Pixbuf> LoadIconFromFile(const char *fileName, ///< Just the filename+extension
-                                           int width, int height);
+const Vars::OutputFormatDescr_t &GetOutputFormatDescr(OutputFormat);
 
 void SetAppLaunchPath(const char *appLaunchPath);
 
 /// Returns a localized error message
 std::string GetErrorMsg(enum SKRY_result errorCode);
 
+/// Returns current time in seconds; used as libskry's clock function
+double ClockSec();
+
+Cairo::Filter GetFilter(Const::InterpolationMethod interpolationMethod);
+
+#ifndef STACKISTRY_HEADLESS
+
+void SavePosSize(const Gtk::Window &wnd, Types::c_Property<Gdk::Rectangle> &destination);
+void RestorePosSize(const Gdk::Rectangle &posSize, Gtk::Window &wnd);
+
+/// Loads specified file from the 'icons' subdirectory
+Glib::RefPtr<Gdk::Pixbuf> LoadIconFromFile(const char *fileName, ///< Just the filename+extension
+                                           int width, int height);
+
 template <class GtkBoxClass>
 GtkBoxClass *PackIntoBox(std::vector<Gtk::Widget*> widgets, bool showAll = true)
 {
@@ -207,13 +349,12 @@ GtkBoxClass *PackIntoBox(std::vector<Gtk::Widget*> widgets, bool showAll = true)
     return box;
 }
 
-
-Cairo::Filter GetFilter(Const::InterpolationMethod interpolationMethod);
-
 void SetBackgroundColor(Gtk::Widget &w, const Gdk::RGBA &color);
 
 void SetColor(const Cairo::RefPtr<Cairo::Context> &cr, const GdkRGBA &color);
 
+#endif // STACKISTRY_HEADLESS
+
 }
 
 #endif // STACKISTRY_UTILS_HEADER
@@ -35,6 +35,8 @@ File description:
 #include <glibmm/threads.h>
 #include <glibmm/timer.h>
 
+#include "frame_cache.h"
+#include "read_ahead.h"
 #include "utils.h"
 #include "worker.h"
 
@@ -42,564 +44,1112 @@ File description:
 namespace Worker
 {
 
-namespace Vars
-{
-    /// Currently processed job
-    static Job_t *job;
-    static bool abortRequested = false;
-    static size_t step;
-
-    /// Used only when returning the best-quality image to the main thread
-    static libskry::c_ImageAlignment *imgAlign = nullptr;
-    static libskry::c_QualityEstimation *qualEst = nullptr;
+#define LOCK() Glib::Threads::RecMutex::Lock lock(m_Mtx)
 
-    static bool isWorkerRunning = false;
-    static ProcPhase procPhase = ProcPhase::IDLE;
-    static Glib::Threads::Thread *workerThread;
-    static Glib::Dispatcher dispatcher;
-    static Cairo::RefPtr<Cairo::ImageSurface> visualizationImg;
-    static bool enableVisualization = false;
-    static bool isWaitingForReferencePoints;
-    static enum SKRY_result lastResult;
-    static Glib::Threads::RecMutex mtx; ///< Access guard for shared variables
-    /// Used for notification by main thread that reference points have been provided
-    static Glib::Threads::Mutex mtxRefPt;
-    static Glib::Threads::Cond condRefPt;
-    /// Current zoom factor specified in the main window's visualization widget
-    static double zoomFactor = 1.0;
-    /// Current zoom interpolation method specified in the main window's visualization widget
-    static auto interpolationMethod = Utils::Const::Defaults::interpolation;
-}
+/// Length (in seconds) of the interval over which the processing rate is measured
+const double RATE_SAMPLE_INTERVAL = 1.0;
 
-#define LOCK() Glib::Threads::RecMutex::Lock lock(Vars::mtx)
+/// Weight of the most recent measurement in the smoothed processing rate
+const double RATE_SMOOTHING = 0.3;
 
-void WorkerThreadFunc();
+/// Quality data being estimated is fetched when the new values number at least 1/QUALITY_FETCH_GROWTH_DIVISOR
+/// of those already streamed...
+const size_t QUALITY_FETCH_GROWTH_DIVISOR = 8;
 
-static libskry::c_Image GetAlignedCurrentImage(
-    const libskry::c_ImageSequence &imgSeq,
-    const libskry::c_ImageAlignment &imgAlignment);
+/// ...or when this many seconds have passed since the previous fetch
+const double QUALITY_FETCH_INTERVAL = 1.0;
 
 // Function definitions ----------------------------
 
+c_ProcessingContext::~c_ProcessingContext()
+{
+    AbortProcessing();
+}
+
 /// Used by the main thread to indicate the current visualization zoom factor
-void SetZoomFactor(double zoom, Utils::Const::InterpolationMethod interpolationMethod)
+void c_ProcessingContext::SetZoomFactor(double zoom, Utils::Const::InterpolationMethod interpolationMethod)
 {
     LOCK();
-    Vars::zoomFactor = zoom;
-    Vars::interpolationMethod = interpolationMethod;
+    m_ZoomFactor = zoom;
+    m_InterpolationMethod = interpolationMethod;
 }
 
 /// Returns the last values set with SetZoomFactor()
-std::tuple<double, Utils::Const::InterpolationMethod> GetZoomFactor()
+std::tuple<double, Utils::Const::InterpolationMethod> c_ProcessingContext::GetZoomFactor()
 {
     LOCK();
 
-    return std::make_tuple(Vars::zoomFactor, Vars::interpolationMethod);
+    return std::make_tuple(m_ZoomFactor, m_InterpolationMethod);
 }
 
+void c_ProcessingContext::SetReadAheadBufferSize(size_t bytes)
+{
+    LOCK();
+
+    m_ReadAheadBufferSize = bytes;
+}
 
-Glib::Threads::Mutex &GetRefPtNotificationMtx()
+void c_ProcessingContext::SetMaxNotificationRate(unsigned notificationsPerSec)
 {
-    return Vars::mtxRefPt;
+    LOCK();
+
+    m_NotificationInterval = 1.0 / std::max(notificationsPerSec, 1u);
 }
 
-void AbortProcessing()
+void c_ProcessingContext::AbortProcessing()
 {
-    { LOCK();
-        Vars::abortRequested = true;
-    }
+    RequestAbort();
     WaitUntilFinished();
 }
 
-ProcPhase GetPhase()
+void c_ProcessingContext::RequestAbort()
 {
-    return Vars::procPhase;
+    m_AbortRequested = true;
+    SetPaused(false);
+
+    // Wake up the worker thread if it waits for reference points
+    Glib::Threads::Mutex::Lock lock(m_MtxRefPt);
+    m_CondRefPt.signal();
 }
 
-void NotifyMainThread()
+void c_ProcessingContext::SetPaused(bool paused)
 {
-    Vars::dispatcher();
+    Glib::Threads::Mutex::Lock lock(m_MtxPause);
+    m_Paused = paused;
+    if (!paused)
+        m_CondPause.signal();
 }
 
-void StartProcessingPhase(ProcPhase newPhase)
+bool c_ProcessingContext::IsPaused() const
 {
-    Vars::procPhase = newPhase;
-    Vars::step = 0;
+    return m_Paused;
 }
 
-void SetVisualizationEnabled(bool enabled)
+void c_ProcessingContext::WaitWhilePaused()
 {
-    LOCK();
-    Vars::enableVisualization = enabled;
+    Glib::Threads::Mutex::Lock lock(m_MtxPause);
+
+    if (!m_Paused)
+        return;
+
+    // Show the progress made before pausing
+    if (m_IsNotificationPending)
+        NotifyMainThread();
+
+    double pauseStart = Utils::ClockSec();
+    while (m_Paused)
+        m_CondPause.wait(m_MtxPause);
+
+    // Time spent paused does not count towards the processing rate
+    double pauseDuration = Utils::ClockSec() - pauseStart;
+    m_PhaseStartTime += pauseDuration;
+    m_RateSampleTime += pauseDuration;
 }
 
-void ConnectProgressSignal(const sigc::slot<void>& slot)
+ProcPhase c_ProcessingContext::GetPhase() const
 {
-    Vars::dispatcher.connect(slot);
+    return GetProgress().phase;
 }
 
-bool IsRunning()
+void c_ProcessingContext::PublishProgress()
 {
-    return Vars::isWorkerRunning;
+    unsigned seq = m_ProgressSeq.load(std::memory_order_relaxed);
+    m_ProgressSeq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    m_PublishedPhase.store((int)m_ProcPhase, std::memory_order_relaxed);
+    m_PublishedStep.store(m_Step, std::memory_order_relaxed);
+    m_PublishedTotal.store(m_Job ? m_Job->imgSeq.GetActiveImageCount() : 0, std::memory_order_relaxed);
+    m_PublishedResult.store(m_LastResult, std::memory_order_relaxed);
+    m_PublishedIsRunning.store(m_IsWorkerRunning, std::memory_order_relaxed);
+    m_PublishedFramesPerSec.store(m_FramesPerSec, std::memory_order_relaxed);
+    m_PublishedRemainingTime.store(m_IsWorkerRunning ? EstimateRemainingTime() : -1.0, std::memory_order_relaxed);
+
+    m_ProgressSeq.store(seq + 2, std::memory_order_release);
 }
 
-size_t GetStep()
+Progress_t c_ProcessingContext::GetProgress() const
 {
-    return Vars::step;
+    Progress_t progress;
+    unsigned seqBefore, seqAfter;
+    do
+    {
+        seqBefore = m_ProgressSeq.load(std::memory_order_acquire);
+
+        progress.phase = (ProcPhase)m_PublishedPhase.load(std::memory_order_relaxed);
+        progress.step = m_PublishedStep.load(std::memory_order_relaxed);
+        progress.total = m_PublishedTotal.load(std::memory_order_relaxed);
+        progress.result = (enum SKRY_result)m_PublishedResult.load(std::memory_order_relaxed);
+        progress.isRunning = m_PublishedIsRunning.load(std::memory_order_relaxed);
+        progress.framesPerSec = m_PublishedFramesPerSec.load(std::memory_order_relaxed);
+        progress.remainingTime = m_PublishedRemainingTime.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        seqAfter = m_ProgressSeq.load(std::memory_order_relaxed);
+    } while ((seqBefore & 1) || seqBefore != seqAfter);
+
+    progress.visualizationGeneration = m_VisualizationGeneration.load(std::memory_order_acquire);
+
+    return progress;
+}
+
+void c_ProcessingContext::NotifyMainThread()
+{
+    PublishProgress();
+    if (m_NotificationsEnabled)
+    {
+        m_LastNotificationTime = Utils::ClockSec();
+        m_LastNotifiedPhase = m_ProcPhase;
+        m_IsNotificationPending = false;
+        m_Dispatcher();
+    }
 }
 
-void WaitUntilFinished()
+void c_ProcessingContext::NotifyProgress()
 {
-    if (Vars::workerThread)
+    UpdateFramesPerSec();
+
+    if (!m_NotificationsEnabled)
     {
-        Vars::workerThread->join();
-        Vars::workerThread = 0;
+        PublishProgress();
+        return;
+    }
+
+    if (IsNotificationDue())
+        NotifyMainThread();
+    else
+    {
+        // The main thread will read the latest progress on the next notification
+        PublishProgress();
+        m_IsNotificationPending = true;
     }
 }
 
-ProcPhase GetProcessingPhase()
+bool c_ProcessingContext::IsNotificationDue() const
 {
-    return Vars::procPhase;
+    return m_NotificationsEnabled
+        && (m_ProcPhase != m_LastNotifiedPhase
+            || Utils::ClockSec() - m_LastNotificationTime >= m_NotificationInterval);
+}
+
+void c_ProcessingContext::StartProcessingPhase(ProcPhase newPhase)
+{
+    m_ProcPhase = newPhase;
+    m_Step = 0;
+
+    m_PhaseStartTime = m_RateSampleTime = Utils::ClockSec();
+    m_RateSampleStep = 0;
+    m_FramesPerSec = 0.0;
 }
 
-void StartProcessing(Job_t *job)
+void c_ProcessingContext::FinishProcessingPhase()
+{
+    double duration = Utils::ClockSec() - m_PhaseStartTime;
+    if (duration <= 0.0 || m_Step == 0)
+        return;
+
+    if (m_Job->phaseFramesPerSec.size() < (size_t)ProcPhase::NUM_PHASES)
+        m_Job->phaseFramesPerSec.resize((size_t)ProcPhase::NUM_PHASES, 0.0);
+
+    m_Job->phaseFramesPerSec[(size_t)m_ProcPhase] = m_Step / duration;
+}
+
+void c_ProcessingContext::UpdateFramesPerSec()
+{
+    double now = Utils::ClockSec();
+    double interval = now - m_RateSampleTime;
+    if (interval < RATE_SAMPLE_INTERVAL)
+        return;
+
+    double rate = (m_Step - m_RateSampleStep) / interval;
+    if (m_FramesPerSec > 0.0)
+        m_FramesPerSec = RATE_SMOOTHING * rate + (1.0 - RATE_SMOOTHING) * m_FramesPerSec;
+    else
+        m_FramesPerSec = rate;
+
+    m_RateSampleTime = now;
+    m_RateSampleStep = m_Step;
+}
+
+double c_ProcessingContext::EstimateRemainingTime() const
+{
+    if (m_ProcPhase == ProcPhase::IDLE || m_FramesPerSec <= 0.0)
+        return -1.0;
+
+    size_t total = m_Job->imgSeq.GetActiveImageCount();
+    double remaining = (total - std::min(m_Step, total)) / m_FramesPerSec;
+
+    // Subsequent phases are estimated using their rates from the previous run (if any)
+    for (size_t phase = (size_t)m_ProcPhase + 1; phase < (size_t)ProcPhase::NUM_PHASES; phase++)
+    {
+        double rate = m_FramesPerSec;
+        if (phase < m_PrevPhaseFramesPerSec.size() && m_PrevPhaseFramesPerSec[phase] > 0.0)
+            rate = m_PrevPhaseFramesPerSec[phase];
+
+        remaining += total / rate;
+    }
+
+    return remaining;
+}
+
+void c_ProcessingContext::SetVisualizationEnabled(bool enabled)
+{
+    LOCK();
+    m_EnableVisualization = enabled;
+}
+
+void c_ProcessingContext::ConnectProgressSignal(const sigc::slot<void>& slot)
+{
+    m_Dispatcher.connect(slot);
+}
+
+bool c_ProcessingContext::IsRunning() const
+{
+    return GetProgress().isRunning;
+}
+
+bool c_ProcessingContext::IsIdle() const
+{
+    return !GetProgress().isRunning && !m_WorkerThread;
+}
+
+size_t c_ProcessingContext::GetStep() const
+{
+    return GetProgress().step;
+}
+
+void c_ProcessingContext::WaitUntilFinished()
+{
+    if (m_WorkerThread)
+    {
+        m_WorkerThread->join();
+        m_WorkerThread = nullptr;
+    }
+    StopVisualizationThread();
+}
+
+void c_ProcessingContext::InitProcessing(Job_t *job)
 {
     job->quality.framesChrono.clear();
     job->quality.framesSorted.clear();
+    job->quality.imgOffsets.clear();
+    job->quality.streamed.clear();
+    job->quality.generation++;
     job->qualityDataReadyNotification = false;
 
-    Vars::visualizationImg = Cairo::RefPtr<Cairo::ImageSurface>(nullptr);
+    { Glib::Threads::Mutex::Lock lock(m_MtxVisualization);
+        m_VisualizationImg = Cairo::RefPtr<Cairo::ImageSurface>(nullptr);
+        m_IsVisualizationImgNew = false;
+        m_PendingSnapshot.reset();
+    }
+    m_LastSnapshotTime = 0.0;
 
-    job->stackedImg = libskry::c_Image();
+    job->stackedImg.reset();
     job->bestFragmentsImg = libskry::c_Image();
 
-    Vars::job = job;
+    m_Job = job;
+    m_Step = 0;
+    m_ProcPhase = ProcPhase::IDLE;
 
-    Vars::isWorkerRunning = true;
-    Vars::abortRequested = false;
-    Vars::workerThread = Glib::Threads::Thread::create(sigc::ptr_fun(&WorkerThreadFunc));
+    m_LastResult = SKRY_SUCCESS;
+
+    m_LastNotificationTime = 0.0;
+    m_LastNotifiedPhase = ProcPhase::IDLE;
+    m_IsNotificationPending = false;
+    m_FramesPerSec = 0.0;
+    m_PrevPhaseFramesPerSec = job->phaseFramesPerSec;
+
+    m_IsWorkerRunning = true;
+    m_AbortRequested = false;
+
+    PublishProgress();
 }
 
-/// Returns a version of 'srcImg' scaled by Vars::zoomFactor
-Cairo::RefPtr<Cairo::ImageSurface> GetScaledImg(const libskry::c_Image &srcImg)
+void c_ProcessingContext::StartProcessing(Job_t *job)
+{
+    assert(IsIdle());
+
+    InitProcessing(job);
+    m_NotificationsEnabled = true;
+    m_FinishVisualizationThread = false;
+    m_VisualizationThread = Glib::Threads::Thread::create(sigc::mem_fun(*this, &c_ProcessingContext::VisualizationThreadFunc));
+    m_WorkerThread = Glib::Threads::Thread::create(sigc::mem_fun(*this, &c_ProcessingContext::WorkerThreadFunc));
+}
+
+void c_ProcessingContext::RunProcessing(Job_t *job)
+{
+    InitProcessing(job);
+    m_NotificationsEnabled = false;
+    WorkerThreadFunc();
+    m_NotificationsEnabled = true;
+}
+
+/// Returns a version of 'srcImg' scaled by 'zoomFactor'
+static
+Cairo::RefPtr<Cairo::ImageSurface> GetScaledImg(const libskry::c_Image &srcImg,
+                                                double zoomFactor,
+                                                Utils::Const::InterpolationMethod interpolationMethod)
 {
     auto src = Cairo::SurfacePattern::create(Utils::ConvertImgToSurface(srcImg));
-    src->set_matrix(Cairo::scaling_matrix(1 / Vars::zoomFactor, 1 / Vars::zoomFactor));
-    src->set_filter(Utils::GetFilter(Vars::interpolationMethod));
+    src->set_matrix(Cairo::scaling_matrix(1 / zoomFactor, 1 / zoomFactor));
+    src->set_filter(Utils::GetFilter(interpolationMethod));
 
     auto scaledImg = Cairo::ImageSurface::create(Cairo::Format::FORMAT_RGB24,
-                                                 Vars::zoomFactor * srcImg.GetWidth(),
-                                                 Vars::zoomFactor * srcImg.GetHeight());
+                                                 zoomFactor * srcImg.GetWidth(),
+                                                 zoomFactor * srcImg.GetHeight());
 
     Cairo::RefPtr<Cairo::Context> cr = Cairo::Context::create(scaledImg);
     cr->set_source(src);
-    cr->rectangle(0, 0, Vars::zoomFactor * srcImg.GetWidth(),
-                        Vars::zoomFactor * srcImg.GetHeight());
+    cr->rectangle(0, 0, zoomFactor * srcImg.GetWidth(),
+                        zoomFactor * srcImg.GetHeight());
     cr->fill();
 
     return scaledImg;
 }
 
-static void CreateImgAlignmentVisualization(const libskry::c_ImageAlignment &imgAlignment)
+/// Returns the fragment of 'img' specified by 'rect'
+static
+libskry::c_Image GetCroppedImage(const libskry::c_Image &img, const struct SKRY_rect &rect)
 {
-    Vars::visualizationImg = GetScaledImg(Vars::job->imgSeq.GetCurrentImage());
-    Cairo::RefPtr<Cairo::Context> cr = Cairo::Context::create(Vars::visualizationImg);
+    struct SKRY_palette srcPal;
+    img.GetPalette(srcPal);
+    libskry::c_Image croppedImg(rect.width, rect.height, img.GetPixelFormat(), &srcPal, false);
+    libskry::c_Image::ResizeAndTranslate(img, croppedImg, rect.x, rect.y,
+                                         rect.width, rect.height, 0, 0, false);
+    return croppedImg;
+}
 
-    if (imgAlignment.GetAlignmentMethod() == SKRY_IMG_ALGN_ANCHORS)
-    {
-        auto anchors = imgAlignment.GetAnchors();
+/// Returns the fragment of 'img' specified by 'rect' converted to BGRA8
+/** Only the fragment is converted (for raw color images: the fragment and a margin needed for demosaicing). */
+static
+libskry::c_Image GetConvertedFragment(const libskry::c_Image &img, const struct SKRY_rect &rect)
+{
+    enum SKRY_pixel_format pixFmt = img.GetPixelFormat();
 
-        for (size_t i = 0; i < anchors.size(); i++)
-            if (imgAlignment.IsAnchorValid(i))
-                Utils::DrawAnchorPoint(cr, Vars::zoomFactor * anchors[i].x,
-                                           Vars::zoomFactor * anchors[i].y);
-    }
-    else if (imgAlignment.GetAlignmentMethod() == SKRY_IMG_ALGN_CENTROID)
+    if (pixFmt == SKRY_PIX_BGRA8)
+        return GetCroppedImage(img, rect);
+
+    if (pixFmt < SKRY_PIX_CFA_MIN || pixFmt > SKRY_PIX_CFA_MAX)
     {
-        auto centroid = imgAlignment.GetCentroid();
-        Utils::DrawAnchorPoint(cr, Vars::zoomFactor * centroid.x,
-                                   Vars::zoomFactor * centroid.y);
+        // Convert straight into the output image
+        libskry::c_Image convertedImg(rect.width, rect.height, SKRY_PIX_BGRA8, nullptr, false);
+        libskry::c_Image::ConvertPixelFormatOfSubimage(img, convertedImg, rect.x, rect.y,
+                                                       rect.width, rect.height, 0, 0);
+        return convertedImg;
     }
+
+    // Demosaic the fragment with a margin, so that pixels at its borders are interpolated
+    // the same way as in the whole image; the margin's origin has even coordinates, so that
+    // the filter pattern is preserved
+    const int DEMOSAIC_MARGIN = 2;
+    int x0 = std::max(0, rect.x - DEMOSAIC_MARGIN) & ~1;
+    int y0 = std::max(0, rect.y - DEMOSAIC_MARGIN) & ~1;
+    int x1 = std::min((int)img.GetWidth(), rect.x + (int)rect.width + DEMOSAIC_MARGIN);
+    int y1 = std::min((int)img.GetHeight(), rect.y + (int)rect.height + DEMOSAIC_MARGIN);
+
+    libskry::c_Image demosaicedImg(x1 - x0, y1 - y0, SKRY_PIX_BGRA8, nullptr, false);
+    libskry::c_Image::ConvertPixelFormatOfSubimage(img, demosaicedImg, x0, y0, x1 - x0, y1 - y0, 0, 0,
+                                                   SKRY_DEMOSAIC_HQLINEAR);
+
+    return GetCroppedImage(demosaicedImg, { rect.x - x0, rect.y - y0, rect.width, rect.height });
 }
 
-static void CreateQualityEstimationVisualization(
-    const libskry::c_ImageSequence &imgSeq,
-    const libskry::c_ImageAlignment &imgAlignment,
-    const libskry::c_QualityEstimation &qualEstimation)
+/// Returns the fragment of an image which corresponds to the intersection of all images after alignment
+static
+struct SKRY_rect GetAlignedImageRect(
+    size_t imgIdx, ///< Image index within the active images' subset
+    const libskry::c_ImageAlignment &imgAlignment)
 {
-    Vars::visualizationImg = GetScaledImg(GetAlignedCurrentImage(imgSeq, imgAlignment));
+    struct SKRY_rect intersection = imgAlignment.GetIntersection();
+    struct SKRY_point offset = imgAlignment.GetImageOffset(imgIdx);
 
-    //TODO: draw something?.. e.g. image in grayscale with quality color-mapped
+    return { intersection.x + offset.x, intersection.y + offset.y, intersection.width, intersection.height };
 }
 
 static
 libskry::c_Image GetAlignedImage(
     size_t imgIdx, ///< Image index within the active images' subset
+    FrameCache::SeqId_t seqId, ///< Identifies 'imgSeq' in FrameCache
     const libskry::c_ImageSequence &imgSeq,
     const libskry::c_ImageAlignment &imgAlignment)
 {
-    libskry::c_Image img = imgSeq.GetImageByIdx(imgSeq.GetAbsoluteImgIdx(imgIdx));
+    FrameCache::ImagePtr_t img = FrameCache::GetImageAsCached(seqId, imgSeq, imgSeq.GetAbsoluteImgIdx(imgIdx));
     if (!img)
         return libskry::c_Image();
 
-    img = libskry::c_Image::ConvertPixelFormat(img, SKRY_PIX_BGRA8, SKRY_DEMOSAIC_HQLINEAR);
+    return GetConvertedFragment(*img, GetAlignedImageRect(imgIdx, imgAlignment));
+}
 
-    struct SKRY_rect intersection = imgAlignment.GetIntersection();
+bool c_ProcessingContext::IsSnapshotNeeded()
+{
+    if (!m_EnableVisualization || !m_VisualizationThread)
+        return false;
 
-    struct SKRY_point offset = imgAlignment.GetImageOffset(imgIdx);
-    int xmin = intersection.x + offset.x;
-    int ymin = intersection.y + offset.y;
+    // Do not capture more often than the visualization can be shown
+    if (Utils::ClockSec() - m_LastSnapshotTime < 1.0 / Utils::Const::maxVisualizationFPS)
+        return false;
 
-    struct SKRY_palette srcPal;
-    img.GetPalette(srcPal);
-    libskry::c_Image alignedImg(intersection.width, intersection.height, img.GetPixelFormat(), &srcPal, false);
-    libskry::c_Image::ResizeAndTranslate(img, alignedImg, xmin, ymin,
-                                         intersection.width, intersection.height, 0, 0, false);
-    return alignedImg;
+    // The main thread has not retrieved the previous image yet
+    Glib::Threads::Mutex::Lock lock(m_MtxVisualization);
+    return !m_IsVisualizationImgNew;
 }
 
-static libskry::c_Image GetAlignedCurrentImage(
-    const libskry::c_ImageSequence &imgSeq,
-    const libskry::c_ImageAlignment &imgAlignment)
+std::unique_ptr<c_ProcessingContext::VisualizationSnapshot_t> c_ProcessingContext::CreateSnapshot(ProcPhase phase) const
 {
-    return GetAlignedImage(imgSeq.GetCurrentImgIdxWithinActiveSubset(), imgSeq, imgAlignment);
+    std::unique_ptr<VisualizationSnapshot_t> snapshot(new VisualizationSnapshot_t());
+
+    snapshot->phase = phase;
+    snapshot->crop = false;
+    snapshot->zoomFactor = m_ZoomFactor;
+    snapshot->interpolationMethod = m_InterpolationMethod;
+    // libskry does not expose the frame decoded during the step, so the current frame is read and decoded
+    // again; this is bounded by IsSnapshotNeeded() (at most 'maxVisualizationFPS' times per second and only
+    // with visualization enabled). Conversion to BGRA8 and scaling are left to the visualization thread.
+    if (phase != ProcPhase::IMAGE_STACKING)
+        snapshot->img = m_Job->imgSeq.GetCurrentImage();
+
+    return snapshot;
 }
 
-static void CreateRefPtAlignmentVisualization(
-    const libskry::c_ImageSequence &imgSeq,
+void c_ProcessingContext::PublishSnapshot(std::unique_ptr<VisualizationSnapshot_t> snapshot)
+{
+    m_LastSnapshotTime = Utils::ClockSec();
+
+    if (!snapshot->img)
+        return;
+
+    Glib::Threads::Mutex::Lock lock(m_MtxVisualization);
+    m_PendingSnapshot = std::move(snapshot);
+    m_CondVisualization.signal();
+}
+
+void c_ProcessingContext::CaptureImgAlignmentSnapshot(const libskry::c_ImageAlignment &imgAlignment)
+{
+    std::unique_ptr<VisualizationSnapshot_t> snapshot = CreateSnapshot(ProcPhase::IMAGE_ALIGNMENT);
+
+    if (imgAlignment.GetAlignmentMethod() == SKRY_IMG_ALGN_ANCHORS)
+    {
+        auto anchors = imgAlignment.GetAnchors();
+
+        for (size_t i = 0; i < anchors.size(); i++)
+            if (imgAlignment.IsAnchorValid(i))
+                snapshot->points.push_back(anchors[i]);
+    }
+    else if (imgAlignment.GetAlignmentMethod() == SKRY_IMG_ALGN_CENTROID)
+        snapshot->points.push_back(imgAlignment.GetCentroid());
+
+    PublishSnapshot(std::move(snapshot));
+}
+
+void c_ProcessingContext::CaptureQualityEstimationSnapshot(const libskry::c_ImageAlignment &imgAlignment)
+{
+    std::unique_ptr<VisualizationSnapshot_t> snapshot = CreateSnapshot(ProcPhase::QUALITY_ESTIMATION);
+
+    snapshot->crop = true;
+    snapshot->cropRect = GetAlignedImageRect(m_Job->imgSeq.GetCurrentImgIdxWithinActiveSubset(), imgAlignment);
+
+    //TODO: draw something?.. e.g. image in grayscale with quality color-mapped
+
+    PublishSnapshot(std::move(snapshot));
+}
+
+void c_ProcessingContext::StreamQualityData(const libskry::c_QualityEstimation &qualEstimation, size_t numEstimated)
+{
+    // Values already passed are either in 'framesChrono' or still waiting in 'streamed'
+    size_t numStreamed = m_Job->quality.framesChrono.size() + m_Job->quality.streamed.size();
+    if (numEstimated <= numStreamed)
+        return;
+
+    // libskry provides the quality of all frames at once, so fetching it at every notification
+    // would take time quadratic in the number of frames
+    if (numEstimated < m_Job->imgSeq.GetActiveImageCount()
+        && (numEstimated - numStreamed) * QUALITY_FETCH_GROWTH_DIVISOR < numStreamed
+        && Utils::ClockSec() - m_LastQualityFetchTime < QUALITY_FETCH_INTERVAL)
+    {
+        return;
+    }
+    m_LastQualityFetchTime = Utils::ClockSec();
+
+    std::vector<SKRY_quality_t> quality = qualEstimation.GetImagesQuality();
+    numEstimated = std::min(numEstimated, quality.size());
+    if (numEstimated > numStreamed)
+        m_Job->quality.streamed.insert(m_Job->quality.streamed.end(),
+                                       quality.begin() + numStreamed, quality.begin() + numEstimated);
+}
+
+void c_ProcessingContext::CaptureRefPtAlignmentSnapshot(
     const libskry::c_ImageAlignment &imgAlignment,
     const libskry::c_RefPointAlignment &refPtAlignment)
 {
-    Vars::visualizationImg = GetScaledImg(GetAlignedCurrentImage(imgSeq, imgAlignment));
-    Cairo::RefPtr<Cairo::Context> cr = Cairo::Context::create(Vars::visualizationImg);
-
-    const double RADIUS_VALID_POS = 4.0;
-    const double RADIUS_INVALID_POS = 2.0;
+    std::unique_ptr<VisualizationSnapshot_t> snapshot = CreateSnapshot(ProcPhase::REF_POINT_ALIGNMENT);
 
-    int imgIdx = imgSeq.GetCurrentImgIdxWithinActiveSubset();
+    int imgIdx = m_Job->imgSeq.GetCurrentImgIdxWithinActiveSubset();
 
-    cr->set_line_width(1);
+    snapshot->crop = true;
+    snapshot->cropRect = GetAlignedImageRect(imgIdx, imgAlignment);
 
     for (int i = 0; i < refPtAlignment.GetNumReferencePoints(); i++)
     {
         bool isValid;
-        struct SKRY_point pos = refPtAlignment.GetReferencePointPos(i, imgIdx, isValid);
-
-        if (isValid)
-            cr->set_source_rgb(0.8, 0.15, 1);
-        else
-            cr->set_source_rgb(0.9, 0.3, 0.3);
-
-        cr->arc(Vars::zoomFactor * pos.x,
-                Vars::zoomFactor * pos.y,
-                isValid ? RADIUS_VALID_POS : RADIUS_INVALID_POS, 0, 2*M_PI);
-        cr->stroke();
+        snapshot->points.push_back(refPtAlignment.GetReferencePointPos(i, imgIdx, isValid));
+        snapshot->pointValid.push_back(isValid);
     }
+
+    PublishSnapshot(std::move(snapshot));
 }
 
-static void CreateStackingVisualization(
+void c_ProcessingContext::CaptureStackingSnapshot(
     const libskry::c_Stacking &stacking,
     const libskry::c_RefPointAlignment &refPtAlignment)
 {
-    Vars::visualizationImg = GetScaledImg(stacking.GetPartialImageStack());
-    Cairo::RefPtr<Cairo::Context> cr = Cairo::Context::create(Vars::visualizationImg);
+    std::unique_ptr<VisualizationSnapshot_t> snapshot = CreateSnapshot(ProcPhase::IMAGE_STACKING);
 
+    snapshot->img = stacking.GetPartialImageStack();
 
     const struct SKRY_triangle *triangles = SKRY_get_triangles(refPtAlignment.GetTriangulation());
     const struct SKRY_point_flt *verts = stacking.GetRefPtStackingPositions();
     size_t numStackedTris;
     const size_t *stackedTris = stacking.GetCurrentStepStackedTriangles(numStackedTris);
 
-    cr->set_line_cap(Cairo::LineCap::LINE_CAP_ROUND);
-    cr->set_source_rgb(0.6, 0.2, 0.7);
     for (size_t i = 0; i < numStackedTris; i++)
     {
-        const struct SKRY_point_flt &v0 = verts[triangles[stackedTris[i]].v0],
-                                    &v1 = verts[triangles[stackedTris[i]].v1],
-                                    &v2 = verts[triangles[stackedTris[i]].v2];
+        snapshot->triangleVertices.push_back(verts[triangles[stackedTris[i]].v0]);
+        snapshot->triangleVertices.push_back(verts[triangles[stackedTris[i]].v1]);
+        snapshot->triangleVertices.push_back(verts[triangles[stackedTris[i]].v2]);
+    }
+
+    PublishSnapshot(std::move(snapshot));
+}
+
+Cairo::RefPtr<Cairo::ImageSurface> c_ProcessingContext::RenderSnapshot(const VisualizationSnapshot_t &snapshot)
+{
+    const double zoom = snapshot.zoomFactor;
+
+    struct SKRY_rect rect = { 0, 0, snapshot.img.GetWidth(), snapshot.img.GetHeight() };
+    if (snapshot.crop)
+        rect = snapshot.cropRect;
+
+    // Downscaling is done directly from the source pixel format; Cairo is used for magnification
+    // (or if the format is not supported)
+    Cairo::RefPtr<Cairo::ImageSurface> visImg = Utils::DownscaleImgToSurface(snapshot.img, rect, zoom);
+    if (!visImg)
+    {
+        if (snapshot.crop || snapshot.img.GetPixelFormat() != SKRY_PIX_BGRA8)
+            visImg = GetScaledImg(GetConvertedFragment(snapshot.img, rect), zoom, snapshot.interpolationMethod);
+        else
+            visImg = GetScaledImg(snapshot.img, zoom, snapshot.interpolationMethod);
+    }
+
+    Cairo::RefPtr<Cairo::Context> cr = Cairo::Context::create(visImg);
+
+    switch (snapshot.phase)
+    {
+    case ProcPhase::IMAGE_ALIGNMENT:
+        for (const struct SKRY_point &anchor: snapshot.points)
+            Utils::DrawAnchorPoint(cr, zoom * anchor.x, zoom * anchor.y);
+        break;
+
+    case ProcPhase::REF_POINT_ALIGNMENT:
+        {
+            const double RADIUS_VALID_POS = 4.0;
+            const double RADIUS_INVALID_POS = 2.0;
+
+            cr->set_line_width(1);
+
+            for (size_t i = 0; i < snapshot.points.size(); i++)
+            {
+                if (snapshot.pointValid[i])
+                    cr->set_source_rgb(0.8, 0.15, 1);
+                else
+                    cr->set_source_rgb(0.9, 0.3, 0.3);
+
+                cr->arc(zoom * snapshot.points[i].x,
+                        zoom * snapshot.points[i].y,
+                        snapshot.pointValid[i] ? RADIUS_VALID_POS : RADIUS_INVALID_POS, 0, 2*M_PI);
+                cr->stroke();
+            }
+        }
+        break;
+
+    case ProcPhase::IMAGE_STACKING:
+        cr->set_line_cap(Cairo::LineCap::LINE_CAP_ROUND);
+        cr->set_source_rgb(0.6, 0.2, 0.7);
+        for (size_t i = 0; i + 2 < snapshot.triangleVertices.size(); i += 3)
+        {
+            const struct SKRY_point_flt &v0 = snapshot.triangleVertices[i],
+                                        &v1 = snapshot.triangleVertices[i+1],
+                                        &v2 = snapshot.triangleVertices[i+2];
+
+            cr->move_to(zoom * v0.x, zoom * v0.y);
+            cr->line_to(zoom * v1.x, zoom * v1.y);
+            cr->line_to(zoom * v2.x, zoom * v2.y);
+            cr->line_to(zoom * v0.x, zoom * v0.y);
+            cr->stroke();
+        }
+        break;
+
+    default: break;
+    }
+
+    return visImg;
+}
+
+void c_ProcessingContext::VisualizationThreadFunc()
+{
+    while (true)
+    {
+        std::unique_ptr<VisualizationSnapshot_t> snapshot;
+
+        { Glib::Threads::Mutex::Lock lock(m_MtxVisualization);
+
+            while (!m_PendingSnapshot && !m_FinishVisualizationThread)
+                m_CondVisualization.wait(m_MtxVisualization);
+
+            if (m_FinishVisualizationThread)
+                return;
+
+            snapshot = std::move(m_PendingSnapshot);
+        }
+
+        Cairo::RefPtr<Cairo::ImageSurface> visImg = RenderSnapshot(*snapshot);
 
-        cr->move_to(Vars::zoomFactor * v0.x, Vars::zoomFactor * v0.y);
-        cr->line_to(Vars::zoomFactor * v1.x, Vars::zoomFactor * v1.y);
-        cr->line_to(Vars::zoomFactor * v2.x, Vars::zoomFactor * v2.y);
-        cr->line_to(Vars::zoomFactor * v0.x, Vars::zoomFactor * v0.y);
-        cr->stroke();
+        { Glib::Threads::Mutex::Lock lock(m_MtxVisualization);
+            m_VisualizationImg = visImg;
+            m_IsVisualizationImgNew = true;
+        }
+        m_VisualizationGeneration.fetch_add(1, std::memory_order_release);
+        // Not NotifyMainThread(), the progress record is published only by the worker thread
+        if (m_NotificationsEnabled)
+            m_Dispatcher();
     }
 }
 
-bool IsVisualizationEnabled()
+void c_ProcessingContext::StopVisualizationThread()
 {
-    return Vars::enableVisualization;
+    if (m_VisualizationThread)
+    {
+        { Glib::Threads::Mutex::Lock lock(m_MtxVisualization);
+            m_FinishVisualizationThread = true;
+            m_CondVisualization.signal();
+        }
+        m_VisualizationThread->join();
+        m_VisualizationThread = nullptr;
+    }
+}
+
+bool c_ProcessingContext::IsVisualizationEnabled() const
+{
+    return m_EnableVisualization;
 }
 
 /// Returns true if the main thread needs to provide reference points
-bool IsWaitingForReferencePoints()
+bool c_ProcessingContext::IsWaitingForReferencePoints() const
 {
-    return Vars::isWaitingForReferencePoints;
+    return m_IsWaitingForReferencePoints;
 }
 
 /// Notifies the worker thread that it may continue
-void NotifyReferencePointsSet()
+void c_ProcessingContext::NotifyReferencePointsSet()
 {
-    Vars::isWaitingForReferencePoints = false;
-    Glib::Threads::Mutex::Lock lock(Vars::mtxRefPt);
-    Vars::condRefPt.signal();
+    Glib::Threads::Mutex::Lock lock(m_MtxRefPt);
+    m_IsWaitingForReferencePoints = false;
+    m_CondRefPt.signal();
 }
 
 /// Can be called after quality estimation completes
-libskry::c_Image GetBestQualityAlignedImage()
+libskry::c_Image c_ProcessingContext::GetBestQualityAlignedImage() const
 {
-    return GetAlignedImage(Vars::qualEst->GetBestImageIdx(),
-                           Vars::job->imgSeq,
-                           *Vars::imgAlign);
+    return GetAlignedImage(m_QualEst->GetBestImageIdx(),
+                           m_Job->frameCacheId,
+                           m_Job->imgSeq,
+                           *m_ImgAlign);
 
 }
 
 class c_PtrReset
 {
+    libskry::c_ImageAlignment *&m_ImgAlign;
+    libskry::c_QualityEstimation *&m_QualEst;
+
 public:
+    c_PtrReset(libskry::c_ImageAlignment *&imgAlign, libskry::c_QualityEstimation *&qualEst)
+    : m_ImgAlign(imgAlign), m_QualEst(qualEst)
+    { }
+
     ~c_PtrReset()
     {
-        Vars::imgAlign = nullptr;
-        Vars::qualEst = nullptr;
+        m_ImgAlign = nullptr;
+        m_QualEst = nullptr;
     }
 };
 
 #define CHECK_ABORT()                                  \
     do {                                               \
-        if (Vars::abortRequested)                      \
+        if (m_AbortRequested)                          \
         {                                              \
-            Vars::abortRequested = false;              \
-            Vars::isWorkerRunning = false;             \
-            Vars::isWaitingForReferencePoints = false; \
+            m_AbortRequested = false;                  \
+            m_IsWorkerRunning = false;                 \
+            m_IsWaitingForReferencePoints = false;     \
+            NotifyMainThread();                        \
             return;                                    \
         }                                              \
     } while (0)
 
-void WorkerThreadFunc()
+void c_ProcessingContext::WorkerThreadFunc()
 {
-    c_PtrReset ptrReset;
+    c_PtrReset ptrReset(m_ImgAlign, m_QualEst);
 
-    libskry::c_ImageAlignment imgAlignment(
-            Vars::job->imgSeq,
-            Vars::job->alignmentMethod,
-            Vars::job->anchors,
-            Utils::Const::imgAlignmentRefBlockSize/2,
-            Utils::Const::imgAlignmentRefBlockSize/2,
-            Utils::Const::Defaults::placementBrightnessThreshold);
-
-    if (!imgAlignment)
-    {
-        std::cerr << "Could not initialize image alignment." << std::endl;
-        { LOCK();
-            Vars::isWorkerRunning = false;
-            NotifyMainThread();
-            return;
-        }
+    size_t readAheadBufferSize;
+    { LOCK();
+        readAheadBufferSize = m_ReadAheadBufferSize;
     }
+    // Each of the processing phases below performs a pass over the active images
+    c_ReadAhead readAhead(*m_Job, readAheadBufferSize);
 
-    Vars::imgAlign = &imgAlignment;
-
+    // Processing resumes after the last phase completed in a previous run (even if it was
+    // stopped), as long as the source data and settings of the completed phases have not changed
+    std::string alignmentKey = GetAlignmentKey(*m_Job);
+    Checkpoint_t *checkpoint;
     { LOCK();
-        StartProcessingPhase(ProcPhase::IMAGE_ALIGNMENT);
+        if (!m_Job->checkpoint || alignmentKey.empty() || m_Job->checkpoint->alignmentKey != alignmentKey)
+        {
+            m_Job->checkpoint.reset(new Checkpoint_t());
+            m_Job->checkpoint->alignmentKey = alignmentKey;
+        }
+        checkpoint = m_Job->checkpoint.get();
+        CHECK_ABORT();
     }
-    while (SKRY_SUCCESS == (Vars::lastResult = imgAlignment.Step()))
+
+    // Quality data of an earlier run with unchanged source data and settings are shown right away. The phases
+    // producing them are performed anyway: the subsequent ones need libskry's image alignment and quality
+    // estimation objects, which cannot be restored from the cache file.
+    bool qualityCached = false;
+    if (!checkpoint->qualEstimation)
     {
+        std::vector<struct SKRY_point> cachedImgOffsets;
+        std::vector<SKRY_quality_t> cachedQuality;
+        if (ReadAlignmentCache(*m_Job, alignmentKey, cachedImgOffsets, cachedQuality))
         { LOCK();
-            CHECK_ABORT();
-            Vars::step++;
-            if (Vars::enableVisualization)
-                CreateImgAlignmentVisualization(imgAlignment);
+            // Estimated values will not be streamed again (see StreamQualityData())
+            m_Job->quality.streamed = std::move(cachedQuality);
+            if (!m_NotificationsEnabled)
+                MergeStreamedQualityData(*m_Job);
+            NotifyMainThread();
+            qualityCached = true;
         }
-        NotifyMainThread();
-    }
-    if (Vars::lastResult != SKRY_LAST_STEP)
-    { LOCK();
-        Vars::isWorkerRunning = false;
-        NotifyMainThread();
-        return;
     }
 
-    libskry::c_QualityEstimation qualEstimation(imgAlignment, /*TODO: make it a param*/40, 3);
-    if (!qualEstimation)
+    if (!checkpoint->imgAlignment)
     {
-        std::cerr << "Could not initialize quality estimation." << std::endl;
+        std::unique_ptr<libskry::c_ImageAlignment> newImgAlignment(new libskry::c_ImageAlignment(
+            m_Job->imgSeq,
+            m_Job->alignmentMethod,
+            m_Job->anchors,
+            Utils::Const::imgAlignmentRefBlockSize/2,
+            Utils::Const::imgAlignmentRefBlockSize/2,
+            Utils::Const::Defaults::placementBrightnessThreshold));
+
+        if (!*newImgAlignment)
+        {
+            std::cerr << "Could not initialize image alignment." << std::endl;
+            { LOCK();
+                m_IsWorkerRunning = false;
+                NotifyMainThread();
+                return;
+            }
+        }
+
+        m_ImgAlign = newImgAlignment.get();
+
+        { LOCK();
+            CHECK_ABORT(); // initialization of the phase may have taken long
+            StartProcessingPhase(ProcPhase::IMAGE_ALIGNMENT);
+        }
+        while (SKRY_SUCCESS == (m_LastResult = newImgAlignment->Step()))
+        {
+            readAhead.SetCurrentImage(m_Job->imgSeq.GetCurrentImgIdx());
+            WaitWhilePaused();
+            { LOCK();
+                CHECK_ABORT();
+                m_Step++;
+                if (IsSnapshotNeeded())
+                    CaptureImgAlignmentSnapshot(*newImgAlignment);
+            }
+            NotifyProgress();
+        }
+        if (m_LastResult != SKRY_LAST_STEP)
         { LOCK();
-            Vars::isWorkerRunning = false;
-            Vars::lastResult = SKRY_OUT_OF_MEMORY;
+            m_IsWorkerRunning = false;
             NotifyMainThread();
             return;
         }
-    }
-    Vars::qualEst = &qualEstimation;
-
 
-    { LOCK();
-        StartProcessingPhase(ProcPhase::QUALITY_ESTIMATION);
-    }
-    while (SKRY_SUCCESS == (Vars::lastResult = qualEstimation.Step()))
-    {
         { LOCK();
-            CHECK_ABORT();
-            Vars::step++;
-            if (Vars::enableVisualization)
-                CreateQualityEstimationVisualization(Vars::job->imgSeq, imgAlignment, qualEstimation);
+            FinishProcessingPhase();
+            checkpoint->imgAlignment = std::move(newImgAlignment);
         }
-        NotifyMainThread();
+        readAhead.Restart();
     }
-    { LOCK();
+    libskry::c_ImageAlignment &imgAlignment = *checkpoint->imgAlignment;
+    m_ImgAlign = &imgAlignment;
 
-        if (Vars::lastResult != SKRY_LAST_STEP)
+    bool qualityEstimated = false;
+    if (!checkpoint->qualEstimation)
+    {
+        std::unique_ptr<libskry::c_QualityEstimation> newQualEstimation(
+            new libskry::c_QualityEstimation(imgAlignment, /*TODO: make it a param*/40, 3));
+        if (!*newQualEstimation)
         {
-            Vars::isWorkerRunning = false;
+            std::cerr << "Could not initialize quality estimation." << std::endl;
+            { LOCK();
+                m_IsWorkerRunning = false;
+                m_LastResult = SKRY_OUT_OF_MEMORY;
+                NotifyMainThread();
+                return;
+            }
+        }
+        m_QualEst = newQualEstimation.get();
+
+        { LOCK();
+            CHECK_ABORT(); // initialization of the phase may have taken long
+            StartProcessingPhase(ProcPhase::QUALITY_ESTIMATION);
+        }
+        while (SKRY_SUCCESS == (m_LastResult = newQualEstimation->Step()))
+        {
+            readAhead.SetCurrentImage(m_Job->imgSeq.GetCurrentImgIdx());
+            WaitWhilePaused();
+            { LOCK();
+                CHECK_ABORT();
+                m_Step++;
+                if (IsSnapshotNeeded())
+                    CaptureQualityEstimationSnapshot(imgAlignment);
+                // Let the quality graph show the frames estimated so far
+                if (IsNotificationDue())
+                    StreamQualityData(*newQualEstimation, m_Step);
+            }
+            NotifyProgress();
+        }
+        if (m_LastResult != SKRY_LAST_STEP)
+        { LOCK();
+            m_IsWorkerRunning = false;
             NotifyMainThread();
             return;
         }
-        else
-        {
-            Vars::job->bestFragmentsImg = qualEstimation.GetBestFragmentsImage();
 
-            Vars::job->quality.framesChrono = qualEstimation.GetImagesQuality();
-            Vars::job->quality.framesSorted = Vars::job->quality.framesChrono;
+        { LOCK();
+            FinishProcessingPhase();
+            checkpoint->qualEstimation = std::move(newQualEstimation);
+        }
+        qualityEstimated = true;
+    }
+    libskry::c_QualityEstimation &qualEstimation = *checkpoint->qualEstimation;
+    m_QualEst = &qualEstimation;
+
+    { LOCK();
+        m_Job->bestFragmentsImg = qualEstimation.GetBestFragmentsImage();
 
-            // Sort descending
-            std::sort(Vars::job->quality.framesSorted.begin(),
-                      Vars::job->quality.framesSorted.end(),
-                      [](const SKRY_quality_t &a, const SKRY_quality_t &b) { return a > b; });
+        StreamQualityData(qualEstimation, m_Job->imgSeq.GetActiveImageCount());
+        // Without notifications there is no main thread to append the data
+        if (!m_NotificationsEnabled)
+            MergeStreamedQualityData(*m_Job);
 
-            Vars::job->qualityDataReadyNotification = true;
-            NotifyMainThread(); // in order to refresh the quality graph window
-        }
+        m_Job->quality.imgOffsets.resize(m_Job->imgSeq.GetActiveImageCount());
+        for (size_t i = 0; i < m_Job->quality.imgOffsets.size(); i++)
+            m_Job->quality.imgOffsets[i] = imgAlignment.GetImageOffset(i);
+
+        m_Job->qualityDataReadyNotification = true;
+        NotifyMainThread(); // in order to refresh the quality graph window
     }
 
-    if (!Vars::job->automaticRefPointsPlacement && Vars::job->refPoints.empty())
+    if (qualityEstimated && !qualityCached)
+    {
+        // Let the results be shown after the job is added again (see LoadAlignmentCache())
+        std::vector<struct SKRY_point> imgOffsets(m_Job->imgSeq.GetActiveImageCount());
+        for (size_t i = 0; i < imgOffsets.size(); i++)
+            imgOffsets[i] = imgAlignment.GetImageOffset(i);
+
+        if (!SaveAlignmentCache(*m_Job, alignmentKey, imgOffsets, qualEstimation.GetImagesQuality()))
+            std::cerr << "Could not save the alignment cache file." << std::endl;
+    }
+
+    // Start reading ahead also while waiting for reference points
+    readAhead.Restart();
+
+    if (!m_Job->automaticRefPointsPlacement && m_Job->refPoints.empty())
     {
         { LOCK();
-            Vars::isWaitingForReferencePoints = true;
+            CHECK_ABORT();
+            m_IsWaitingForReferencePoints = true;
             NotifyMainThread();
         }
 
-        { Glib::Threads::Mutex::Lock lock(Vars::mtxRefPt);
+        { Glib::Threads::Mutex::Lock lock(m_MtxRefPt);
+
+            while (m_IsWaitingForReferencePoints && !m_AbortRequested)
+                m_CondRefPt.wait(m_MtxRefPt);
+        }
+
+        { LOCK();
+            CHECK_ABORT();
 
-            Vars::condRefPt.wait(Vars::mtxRefPt);
-            if (Vars::job->refPoints.empty()) // the user canceled the "Select ref. points" dialog
+            if (m_Job->refPoints.empty()) // the user canceled the "Select ref. points" dialog
             {
-                Vars::job->automaticRefPointsPlacement = true;
+                m_Job->automaticRefPointsPlacement = true;
             }
         }
     }
 
-    libskry::c_RefPointAlignment refPtAlignment(qualEstimation,
-                                                Vars::job->refPoints,
-
-                                                Vars::job->quality.criterion,
-                                                Vars::job->quality.threshold,
+    std::string refPtAlignmentKey = GetRefPtAlignmentKey(*m_Job);
+    if (checkpoint->refPtAlignment && checkpoint->refPtAlignmentKey != refPtAlignmentKey)
+    { LOCK();
+        checkpoint->refPtAlignment.reset();
+    }
 
-                                                Vars::job->refPtBlockSize,
-                                                Vars::job->refPtSearchRadius,
-                                                &Vars::lastResult,
-                                                Vars::job->refPtAutoPlacementParams.brightnessThreshold,
-                                                Vars::job->refPtAutoPlacementParams.structureThreshold,
-                                                Vars::job->refPtAutoPlacementParams.structureScale,
-                                                Vars::job->refPtAutoPlacementParams.spacing);
-    if (!refPtAlignment)
+    if (!checkpoint->refPtAlignment)
     {
-        std::cerr << "Could not initialize reference point alignment." << std::endl;
+        std::unique_ptr<libskry::c_RefPointAlignment> newRefPtAlignment(
+            new libskry::c_RefPointAlignment(qualEstimation,
+                                             m_Job->refPoints,
+
+                                             m_Job->quality.criterion,
+                                             m_Job->quality.threshold,
+
+                                             m_Job->refPtBlockSize,
+                                             m_Job->refPtSearchRadius,
+                                             &m_LastResult,
+                                             m_Job->refPtAutoPlacementParams.brightnessThreshold,
+                                             m_Job->refPtAutoPlacementParams.structureThreshold,
+                                             m_Job->refPtAutoPlacementParams.structureScale,
+                                             m_Job->refPtAutoPlacementParams.spacing));
+        if (!*newRefPtAlignment)
+        {
+            std::cerr << "Could not initialize reference point alignment." << std::endl;
+            { LOCK();
+                m_IsWorkerRunning = false;
+                m_LastResult = SKRY_OUT_OF_MEMORY;
+                NotifyMainThread();
+                return;
+            }
+        }
+        { LOCK();
+            CHECK_ABORT(); // initialization of the phase may have taken long
+            StartProcessingPhase(ProcPhase::REF_POINT_ALIGNMENT);
+        }
+        while (SKRY_SUCCESS == (m_LastResult = newRefPtAlignment->Step()))
+        {
+            readAhead.SetCurrentImage(m_Job->imgSeq.GetCurrentImgIdx());
+            WaitWhilePaused();
+            { LOCK();
+                CHECK_ABORT();
+                m_Step++;
+                if (IsSnapshotNeeded())
+                    CaptureRefPtAlignmentSnapshot(imgAlignment, *newRefPtAlignment);
+            }
+            NotifyProgress();
+        }
+        if (m_LastResult != SKRY_LAST_STEP)
         { LOCK();
-            Vars::isWorkerRunning = false;
-            Vars::lastResult = SKRY_OUT_OF_MEMORY;
+            m_IsWorkerRunning = false;
             NotifyMainThread();
             return;
         }
-    }
-    { LOCK();
-        StartProcessingPhase(ProcPhase::REF_POINT_ALIGNMENT);
-    }
-    while (SKRY_SUCCESS == (Vars::lastResult = refPtAlignment.Step()))
-    {
+
         { LOCK();
-            CHECK_ABORT();
-            Vars::step++;
-            if (Vars::enableVisualization)
-                CreateRefPtAlignmentVisualization(Vars::job->imgSeq, imgAlignment, refPtAlignment);
+            FinishProcessingPhase();
+            checkpoint->refPtAlignment = std::move(newRefPtAlignment);
+            checkpoint->refPtAlignmentKey = refPtAlignmentKey;
         }
-        NotifyMainThread();
-    }
-    if (Vars::lastResult != SKRY_LAST_STEP)
-    { LOCK();
-        Vars::isWorkerRunning = false;
-        NotifyMainThread();
-        return;
+        readAhead.Restart();
     }
+    libskry::c_RefPointAlignment &refPtAlignment = *checkpoint->refPtAlignment;
 
     libskry::c_Image flatField;
-    if (!Vars::job->flatFieldFileName.empty())
+    if (!m_Job->flatFieldFileName.empty())
     {
-        flatField = libskry::c_Image::Load(Vars::job->flatFieldFileName.c_str(), &Vars::lastResult);
+        flatField = libskry::c_Image::Load(m_Job->flatFieldFileName.c_str(), &m_LastResult);
         if (!flatField)
         {
-            std::cerr << "Could not load flat-field from " << Vars::job->flatFieldFileName << std::endl;
-            NotifyMainThread();
-            return;
+            std::cerr << "Could not load flat-field from " << m_Job->flatFieldFileName << std::endl;
+            { LOCK();
+                m_IsWorkerRunning = false;
+                NotifyMainThread();
+                return;
+            }
         }
     }
 
     libskry::c_Stacking stacking(refPtAlignment,
-                                 Vars::job->flatFieldFileName.empty() ? nullptr : &flatField,
-                                 &Vars::lastResult);
+                                 m_Job->flatFieldFileName.empty() ? nullptr : &flatField,
+                                 &m_LastResult);
     if (!stacking)
     {
         std::cerr << "Could not initialize stacking." << std::endl;
         { LOCK();
-            Vars::isWorkerRunning = false;
+            m_IsWorkerRunning = false;
             NotifyMainThread();
             return;
         }
     }
     { LOCK();
+        CHECK_ABORT();
         StartProcessingPhase(ProcPhase::IMAGE_STACKING);
     }
-    while (SKRY_SUCCESS == (Vars::lastResult = stacking.Step()))
+    while (SKRY_SUCCESS == (m_LastResult = stacking.Step()))
     {
+        readAhead.SetCurrentImage(m_Job->imgSeq.GetCurrentImgIdx());
+        WaitWhilePaused();
         { LOCK();
             CHECK_ABORT();
-            Vars::step++;
-            if (Vars::enableVisualization)
-                CreateStackingVisualization(stacking, refPtAlignment);
+            m_Step++;
+            if (IsSnapshotNeeded())
+                CaptureStackingSnapshot(stacking, refPtAlignment);
         }
-        NotifyMainThread();
+        NotifyProgress();
     }
 
     { LOCK();
-        Vars::job->stackedImg = stacking.GetFinalImageStack();
+        FinishProcessingPhase();
+        libskry::c_Image stack = stacking.GetFinalImageStack();
+        if (stack)
+            m_Job->stackedImg = std::make_shared<const libskry::c_Image>(std::move(stack));
     }
-    if (!Vars::job->stackedImg)
+    if (!m_Job->stackedImg)
     {
         std::cerr << "Failed to obtain the final image stack." << std::endl;
     }
 
     { LOCK();
-        Vars::abortRequested = false;
-        Vars::isWorkerRunning = false;
-        Vars::isWaitingForReferencePoints = false;
+        m_AbortRequested = false;
+        m_IsWorkerRunning = false;
+        m_IsWaitingForReferencePoints = false;
     }
     NotifyMainThread();
 }
 
-Glib::Threads::RecMutex &GetAccessGuard()
+Glib::Threads::RecMutex &c_ProcessingContext::GetAccessGuard()
 {
-    return Vars::mtx;
+    return m_Mtx;
 }
 
-const Cairo::RefPtr<Cairo::ImageSurface> &GetVisualizationImage()
+Cairo::RefPtr<Cairo::ImageSurface> c_ProcessingContext::GetVisualizationImage() const
 {
-    return Vars::visualizationImg;
+    Glib::Threads::Mutex::Lock lock(m_MtxVisualization);
+    return m_VisualizationImg;
 }
 
-std::unique_ptr<int> sth;
+Cairo::RefPtr<Cairo::ImageSurface> c_ProcessingContext::GetNewVisualizationImage()
+{
+    Glib::Threads::Mutex::Lock lock(m_MtxVisualization);
+    if (!m_IsVisualizationImgNew)
+        return Cairo::RefPtr<Cairo::ImageSurface>(nullptr);
+
+    m_IsVisualizationImgNew = false;
+    return m_VisualizationImg;
+}
 
-enum SKRY_result GetLastResult()
+enum SKRY_result c_ProcessingContext::GetLastResult() const
 {
-    return Vars::lastResult;
+    return GetProgress().result;
 }
 
 std::string GetProcPhaseStr(ProcPhase phase)
@@ -615,4 +1165,60 @@ std::string GetProcPhaseStr(ProcPhase phase)
     }
 }
 
+// Default context wrappers ------------------------
+
+c_ProcessingContext &GetDefaultContext()
+{
+    static c_ProcessingContext defaultContext;
+    return defaultContext;
+}
+
+void StartProcessing(Job_t *job) { GetDefaultContext().StartProcessing(job); }
+
+void RunProcessing(Job_t *job) { GetDefaultContext().RunProcessing(job); }
+
+size_t GetStep() { return GetDefaultContext().GetStep(); }
+
+bool IsRunning() { return GetDefaultContext().IsRunning(); }
+
+void WaitUntilFinished() { GetDefaultContext().WaitUntilFinished(); }
+
+void ConnectProgressSignal(const sigc::slot<void>& slot) { GetDefaultContext().ConnectProgressSignal(slot); }
+
+Glib::Threads::RecMutex &GetAccessGuard() { return GetDefaultContext().GetAccessGuard(); }
+
+ProcPhase GetPhase() { return GetDefaultContext().GetPhase(); }
+
+Cairo::RefPtr<Cairo::ImageSurface> GetVisualizationImage() { return GetDefaultContext().GetVisualizationImage(); }
+
+void AbortProcessing() { GetDefaultContext().AbortProcessing(); }
+
+void RequestAbort() { GetDefaultContext().RequestAbort(); }
+
+void SetPaused(bool paused) { GetDefaultContext().SetPaused(paused); }
+bool IsPaused() { return GetDefaultContext().IsPaused(); }
+
+void SetVisualizationEnabled(bool enabled) { GetDefaultContext().SetVisualizationEnabled(enabled); }
+
+bool IsVisualizationEnabled() { return GetDefaultContext().IsVisualizationEnabled(); }
+
+bool IsWaitingForReferencePoints() { return GetDefaultContext().IsWaitingForReferencePoints(); }
+
+void NotifyReferencePointsSet() { GetDefaultContext().NotifyReferencePointsSet(); }
+
+libskry::c_Image GetBestQualityAlignedImage() { return GetDefaultContext().GetBestQualityAlignedImage(); }
+
+enum SKRY_result GetLastResult() { return GetDefaultContext().GetLastResult(); }
+
+void SetZoomFactor(double zoom, Utils::Const::InterpolationMethod interpolationMethod)
+{
+    GetDefaultContext().SetZoomFactor(zoom, interpolationMethod);
+}
+
+std::tuple<double, Utils::Const::InterpolationMethod> GetZoomFactor() { return GetDefaultContext().GetZoomFactor(); }
+
+void SetReadAheadBufferSize(size_t bytes) { GetDefaultContext().SetReadAheadBufferSize(bytes); }
+
+void SetMaxNotificationRate(unsigned notificationsPerSec) { GetDefaultContext().SetMaxNotificationRate(notificationsPerSec); }
+
 } // namespace Worker
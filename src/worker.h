@@ -25,12 +25,16 @@ File description:
 #ifndef STACKISTRY_WORKER_THREAD_HEADER
 #define STACKISTRY_WORKER_THREAD_HEADER
 
+#include <atomic>
+#include <memory>
 #include <string>
 #include <tuple>
 #include <vector>
 
 #include <cairomm/surface.h>
+#include <glibmm/dispatcher.h>
 #include <glibmm/threads.h>
+#include <skry/skry_cpp.hpp>
 
 #include "job.h"
 #include "utils.h"
@@ -42,8 +46,294 @@ namespace Worker
 
     std::string GetProcPhaseStr(ProcPhase phase);
 
+    /// Processing progress of a context
+    struct Progress_t
+    {
+        ProcPhase phase;
+        size_t step;
+        size_t total; ///< Number of steps in the current phase
+        enum SKRY_result result;
+        bool isRunning;
+        /// Incremented each time a new visualization image has been rendered
+        unsigned visualizationGeneration;
+        /// Recent processing rate in the current phase (in frames per second); 0 if not known yet
+        double framesPerSec;
+        /// Estimated time (in seconds) until the job is completed; negative if not known yet
+        double remainingTime;
+    };
+
+    /// Processing pipeline of a single job
+    /** Several contexts can process different jobs simultaneously, each in its own worker thread.
+        The context has to be created in the main thread. */
+    class c_ProcessingContext
+    {
+    public:
+        c_ProcessingContext() = default;
+        c_ProcessingContext(const c_ProcessingContext &) = delete;
+        c_ProcessingContext &operator=(const c_ProcessingContext &) = delete;
+
+        /// Aborts processing (if running)
+        ~c_ProcessingContext();
+
+        void StartProcessing(Job_t *job);
+
+        /// Processes 'job' in the calling thread; no progress notifications are sent
+        /** Used when there is no main loop to receive the notifications
+            (e.g. in the command-line version). */
+        void RunProcessing(Job_t *job);
+
+        /// Returns the most recently published progress
+        /** Does not block the worker thread; can be called by any thread without holding the access guard. */
+        Progress_t GetProgress() const;
+
+        size_t GetStep() const;
+
+        bool IsRunning() const;
+
+        /// Returns true if not running and the worker thread (if any) has been waited for
+        bool IsIdle() const;
+
+        /// Should be called only after checking that IsRunning returns 'false'
+        void WaitUntilFinished();
+
+        void ConnectProgressSignal(const sigc::slot<void>& slot);
+
+        /// Guards the context's state and the job being processed
+        Glib::Threads::RecMutex &GetAccessGuard();
+
+        ProcPhase GetPhase() const;
+
+        /// Returns the most recently rendered visualization image
+        Cairo::RefPtr<Cairo::ImageSurface> GetVisualizationImage() const;
+
+        /// Returns the visualization image if it has been rendered since the previous call, otherwise null
+        /** New visualization images are not rendered until the previous one is retrieved. */
+        Cairo::RefPtr<Cairo::ImageSurface> GetNewVisualizationImage();
+
+        /// Blocks until the worker thread finishes; calls WaitUntilFinished() internally
+        void AbortProcessing();
+
+        /// Makes the worker thread finish as soon as possible; does not wait for it
+        /** The main thread is notified when the worker has finished (IsRunning() returns false);
+            WaitUntilFinished() has to be called afterwards. Operations performed internally by libskry
+            (e.g. initialization of a processing phase) cannot be interrupted, abort is checked
+            after they complete. */
+        void RequestAbort();
+
+        /// Makes the worker thread wait (without using CPU) after the current step until unpaused
+        /** The processing state is kept; aborting also ends pause. */
+        void SetPaused(bool paused);
+        bool IsPaused() const;
+
+        void SetVisualizationEnabled(bool enabled);
+        bool IsVisualizationEnabled() const;
+
+        /// Returns true if the main thread needs to provide reference points
+        bool IsWaitingForReferencePoints() const;
+
+        /// Notifies the worker thread that it may continue
+        void NotifyReferencePointsSet();
+
+        /// Can be called after quality estimation completes
+        libskry::c_Image GetBestQualityAlignedImage() const;
+
+        enum SKRY_result GetLastResult() const;
+
+        /// Used by the main thread to indicate the current visualization zoom factor
+        void SetZoomFactor(double zoom, Utils::Const::InterpolationMethod interpolationMethod);
+
+        /// Returns the last values set with SetZoomFactor()
+        std::tuple<double, Utils::Const::InterpolationMethod> GetZoomFactor();
+
+        /// Sets the max. amount of frame data (in bytes) read ahead of the current frame; 0 disables reading ahead
+        /** Takes effect for subsequently started processing. */
+        void SetReadAheadBufferSize(size_t bytes);
+
+        /// Sets the max. number of progress notifications per second sent to the main thread
+        /** Notifications about processing steps exceeding the limit are coalesced; phase changes,
+            completion and requests for reference points are always notified immediately.
+            Has to be called when not processing. */
+        void SetMaxNotificationRate(unsigned notificationsPerSec);
+
+    private:
+        /// Data needed to render a single visualization image
+        /** Captured by the worker thread after a processing step; rendered by the visualization thread. */
+        struct VisualizationSnapshot_t
+        {
+            ProcPhase phase;
+
+            /// Current image (as decoded) or the partial image stack
+            libskry::c_Image img;
+
+            /// If true, 'img' is cropped to 'cropRect' before drawing
+            bool crop;
+            struct SKRY_rect cropRect;
+
+            /// Anchors or reference points
+            std::vector<struct SKRY_point> points;
+            std::vector<bool> pointValid;
+
+            /// Vertices of triangles stacked in the current step (3 per triangle)
+            std::vector<struct SKRY_point_flt> triangleVertices;
+
+            double zoomFactor;
+            Utils::Const::InterpolationMethod interpolationMethod;
+        };
+
+        /// Currently processed job
+        Job_t *m_Job = nullptr;
+        /// Checked by the worker thread between processing steps and time-consuming operations
+        std::atomic<bool> m_AbortRequested{false};
+        size_t m_Step = 0;
+
+        /// Used only when returning the best-quality image to the main thread
+        libskry::c_ImageAlignment *m_ImgAlign = nullptr;
+        libskry::c_QualityEstimation *m_QualEst = nullptr;
+
+        bool m_IsWorkerRunning = false;
+        ProcPhase m_ProcPhase = ProcPhase::IDLE;
+        Glib::Threads::Thread *m_WorkerThread = nullptr;
+        Glib::Dispatcher m_Dispatcher;
+        /// If 'false', 'm_Dispatcher' is not emitted (there is no main loop to receive the notifications)
+        bool m_NotificationsEnabled = true;
+        Cairo::RefPtr<Cairo::ImageSurface> m_VisualizationImg;
+        /// True if 'm_VisualizationImg' has not been retrieved by GetNewVisualizationImage() yet
+        bool m_IsVisualizationImgNew = false;
+        /// Set under 'm_Mtx'; atomic, because IsVisualizationEnabled() reads it without locking
+        std::atomic<bool> m_EnableVisualization{false};
+        /// Value of Utils::ClockSec() when the last visualization snapshot was captured
+        double m_LastSnapshotTime = 0.0;
+        /// Value of Utils::ClockSec() when quality data was last fetched by StreamQualityData()
+        double m_LastQualityFetchTime = 0.0;
+
+        Glib::Threads::Thread *m_VisualizationThread = nullptr;
+        /// Snapshot waiting to be rendered; replaced (dropped) if a newer one is captured in the meantime
+        std::unique_ptr<VisualizationSnapshot_t> m_PendingSnapshot;
+        bool m_FinishVisualizationThread = false;
+        /// Guards 'm_VisualizationImg', 'm_IsVisualizationImgNew', 'm_PendingSnapshot' and 'm_FinishVisualizationThread'
+        /** Never locked together with 'm_Mtx' by the visualization thread (the main thread
+            may wait for the worker to finish while holding 'm_Mtx'). */
+        mutable Glib::Threads::Mutex m_MtxVisualization;
+        /// Signaled when there is a snapshot to render or the visualization thread should finish
+        Glib::Threads::Cond m_CondVisualization;
+        std::atomic<bool> m_IsWaitingForReferencePoints{false};
+        enum SKRY_result m_LastResult = SKRY_SUCCESS;
+        Glib::Threads::RecMutex m_Mtx; ///< Access guard for shared variables
+        /// Used for notification by main thread that reference points have been provided
+        Glib::Threads::Mutex m_MtxRefPt;
+        Glib::Threads::Cond m_CondRefPt;
+        /// Set under 'm_MtxPause'; atomic, because IsPaused() reads it without locking
+        std::atomic<bool> m_Paused{false};
+        /// Used together with 'm_CondPause' when changing or waiting for 'm_Paused'
+        Glib::Threads::Mutex m_MtxPause;
+        /// Used for notification of the worker thread that processing has been unpaused
+        Glib::Threads::Cond m_CondPause;
+        /// Current zoom factor specified in the main window's visualization widget
+        double m_ZoomFactor = 1.0;
+        /// Current zoom interpolation method specified in the main window's visualization widget
+        Utils::Const::InterpolationMethod m_InterpolationMethod = Utils::Const::Defaults::interpolation;
+        size_t m_ReadAheadBufferSize = Utils::Const::Defaults::ReadAheadBufferSizeMB << 20;
+        /// Min. interval (in seconds) between step notifications
+        double m_NotificationInterval = 1.0 / Utils::Const::Defaults::MaxNotificationRate;
+
+        // Used only by the thread performing the processing
+        double m_LastNotificationTime = 0.0; ///< Value of Utils::ClockSec()
+        ProcPhase m_LastNotifiedPhase = ProcPhase::IDLE;
+        /// True if progress has been made since the last notification
+        bool m_IsNotificationPending = false;
+
+        // Processing rate measurement; used only by the thread performing the processing
+        /// Value of Utils::ClockSec() at the start of the current phase (shifted forward by the time spent paused)
+        double m_PhaseStartTime = 0.0;
+        double m_RateSampleTime = 0.0; ///< Start of the current rate measurement interval
+        size_t m_RateSampleStep = 0; ///< Step at the start of the current rate measurement interval
+        double m_FramesPerSec = 0.0; ///< Smoothed rate; 0 if not measured yet
+        /// Copy of Job_t::phaseFramesPerSec from before the processing started
+        std::vector<double> m_PrevPhaseFramesPerSec;
+
+        /// Progress record published by the worker thread (sequence lock)
+        /** 'm_ProgressSeq' is odd while the worker thread updates the fields below; readers retry
+            if it is odd or has changed during reading. */
+        std::atomic<unsigned> m_ProgressSeq{0};
+        std::atomic<int> m_PublishedPhase{(int)ProcPhase::IDLE};
+        std::atomic<size_t> m_PublishedStep{0};
+        std::atomic<size_t> m_PublishedTotal{0};
+        std::atomic<int> m_PublishedResult{SKRY_SUCCESS};
+        std::atomic<bool> m_PublishedIsRunning{false};
+        std::atomic<double> m_PublishedFramesPerSec{0.0};
+        std::atomic<double> m_PublishedRemainingTime{-1.0};
+        /// Updated by the visualization thread, separately from the sequence-locked fields
+        std::atomic<unsigned> m_VisualizationGeneration{0};
+
+        void InitProcessing(Job_t *job);
+        void WorkerThreadFunc();
+
+        /// Copies the worker's state to the published progress record; called only by the thread performing the processing
+        void PublishProgress();
+
+        /// Publishes the progress and notifies the main thread; called by the worker thread
+        void NotifyMainThread();
+
+        /// Publishes the progress after a processing step; notifies the main thread at most at the max. notification rate
+        void NotifyProgress();
+
+        /// Returns true if the next call to NotifyProgress() will notify the main thread
+        bool IsNotificationDue() const;
+        void StartProcessingPhase(ProcPhase newPhase);
+
+        /// Stores the current phase's average processing rate in the job; has to be called with 'm_Mtx' locked
+        void FinishProcessingPhase();
+
+        /// Updates the smoothed processing rate after a step
+        void UpdateFramesPerSec();
+
+        /// Returns the estimated time (in seconds) until the job is completed or a negative value if unknown
+        double EstimateRemainingTime() const;
+
+        /// Called by the worker thread between steps; returns when not paused
+        void WaitWhilePaused();
+
+        void VisualizationThreadFunc();
+        void StopVisualizationThread();
+
+        /// Returns true if a new visualization snapshot should be captured after the current step; has to be called with 'm_Mtx' locked
+        bool IsSnapshotNeeded();
+
+        /// Passes 'snapshot' to the visualization thread; has to be called with 'm_Mtx' locked
+        void PublishSnapshot(std::unique_ptr<VisualizationSnapshot_t> snapshot);
+
+        /// Creates a snapshot with the common fields filled in
+        std::unique_ptr<VisualizationSnapshot_t> CreateSnapshot(ProcPhase phase) const;
+
+        void CaptureImgAlignmentSnapshot(const libskry::c_ImageAlignment &imgAlignment);
+
+        void CaptureQualityEstimationSnapshot(const libskry::c_ImageAlignment &imgAlignment);
+
+        /// Appends quality of frames estimated since the previous call (up to 'numEstimated') to 'Job_t::quality.streamed'
+        /** Until all frames are estimated, the values may be left for a later call (see QUALITY_FETCH_GROWTH_DIVISOR).
+            Has to be called with 'm_Mtx' locked. */
+        void StreamQualityData(const libskry::c_QualityEstimation &qualEstimation, size_t numEstimated);
+
+        void CaptureRefPtAlignmentSnapshot(
+            const libskry::c_ImageAlignment &imgAlignment,
+            const libskry::c_RefPointAlignment &refPtAlignment);
+
+        void CaptureStackingSnapshot(
+            const libskry::c_Stacking &stacking,
+            const libskry::c_RefPointAlignment &refPtAlignment);
+
+        /// Called by the visualization thread
+        static Cairo::RefPtr<Cairo::ImageSurface> RenderSnapshot(const VisualizationSnapshot_t &snapshot);
+    };
+
+    /// Returns the default processing context; functions below operate on it
+    c_ProcessingContext &GetDefaultContext();
+
     void StartProcessing(Job_t *job);
 
+    /// See c_ProcessingContext::RunProcessing()
+    void RunProcessing(Job_t *job);
+
     size_t GetStep();
 
     bool IsRunning();
@@ -57,11 +347,16 @@ namespace Worker
 
     ProcPhase GetPhase();
 
-    const Cairo::RefPtr<Cairo::ImageSurface> &GetVisualizationImage();
+    Cairo::RefPtr<Cairo::ImageSurface> GetVisualizationImage();
 
     /// Blocks until the worker thread finishes; calls WaitUntilFinished() internally
     void AbortProcessing();
 
+    void RequestAbort();
+
+    void SetPaused(bool paused);
+    bool IsPaused();
+
     void SetVisualizationEnabled(bool enabled);
     bool IsVisualizationEnabled();
 
@@ -81,6 +376,10 @@ namespace Worker
 
     /// Returns the last values set with SetZoomFactor()
     std::tuple<double, Utils::Const::InterpolationMethod> GetZoomFactor();
+
+    void SetReadAheadBufferSize(size_t bytes);
+
+    void SetMaxNotificationRate(unsigned notificationsPerSec);
 }
 
 #endif // STACKISTRY_WORKER_THREAD_HEADER